@@ -0,0 +1,447 @@
+#ifndef VGC_ARENA_H
+#define VGC_ARENA_H
+
+// Snake arena: hundreds to thousands of bot snakes sharing one large board.
+//
+// Each snake is an index into flat arrays. Its body is a ring of board cells
+// in a shared pool, so moving costs one write at the head and one at the tail
+// whatever its length. The board is an ownership grid naming the snake (or
+// food) in every cell, so a head finds what it is about to hit with a single
+// lookup. Next heads go into a spatial hash keyed by cell, which turns
+// head-on collisions into a count per cell.
+//
+// A tick runs in passes separated by barriers, each split over worker
+// threads by snake index: choose moves and claim cells, decide who dies,
+// vacate tails and clear the dead, then place the new heads. Every pass
+// only reads state from the previous one or writes cells no other snake can
+// touch in the same pass, and the hash counts are commutative, so the result
+// is the same for any number of threads. Food and respawns are placed
+// afterwards in snake order from one seeded generator. Work per tick grows
+// with the number of snakes; a dead snake's body is cleared once, which is
+// paid for by the ticks it took to grow.
+//
+// A steered snake keeps the direction its player set instead of asking the
+// bot. Between ticks the claims are empty, so arena_save() and arena_load()
+// snapshot the whole arena as the board, the bodies, the snakes and the
+// counters, for rolling a two-player game back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+#define ARENA_MAX_LENGTH 128 // Body ring per snake, a power of two; longer snakes stop growing
+#define ARENA_START_LENGTH 2
+#define ARENA_CELLS_PER_SNAKE 64 // Board area allowed for each snake
+#define ARENA_MIN_SIDE 24
+#define ARENA_MAX_SIDE 2048
+#define ARENA_MAX_THREADS 16
+#define ARENA_SNAKES_PER_THREAD 256 // Fewer than this per thread is not worth a barrier
+#define ARENA_FOOD UINT32_MAX // Owner value of a food cell; snakes are id + 1, empty cells 0
+
+enum { ARENA_UP, ARENA_LEFT, ARENA_DOWN, ARENA_RIGHT };
+
+typedef struct {
+    uint32_t tail; // Ring position of the tail in the snake's body
+    uint32_t length; // 0 while dead
+    uint32_t next; // Cell the head moves into this tick
+    uint64_t rng;
+    uint8_t direction;
+    uint8_t eats; // Next head is food
+    uint8_t grows; // Eats and the ring has room
+    uint8_t dies;
+    uint8_t steered; // Turned by a player, never by arena_choose()
+    uint32_t deaths;
+} ArenaSnake;
+
+typedef struct {
+    atomic_uint cell; // Cell + 1, 0 if the slot is free
+    atomic_uint count; // Heads moving into that cell
+} ArenaClaim;
+
+typedef struct {
+    int rows, cols;
+    int count;
+    int food_target; // Food kept on the board
+    uint32_t *owner; // rows * cols
+    uint32_t *body; // count * ARENA_MAX_LENGTH cells
+    ArenaSnake *snakes;
+    ArenaClaim *claims; // Spatial hash of next heads
+    uint32_t claim_mask;
+    uint64_t rng; // Food and respawns, used by one thread only
+
+    int threads;
+    pthread_t workers[ARENA_MAX_THREADS];
+    pthread_barrier_t barrier;
+    pthread_mutex_t starting; // Held while workers are created; the barrier is sized for those that started
+    atomic_int running;
+
+    long tick;
+    long deaths, eaten, respawns;
+    int food;
+} Arena;
+
+typedef struct { // The arena's counters, as a snapshot holds them
+    uint64_t rng;
+    long tick, deaths, eaten, respawns;
+    int food;
+} ArenaCounters;
+
+static Arena arena;
+
+static inline uint64_t arena_random(uint64_t *state) { // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static inline uint32_t arena_head(const Arena *a, int i) {
+    const ArenaSnake *s = &a->snakes[i];
+    return a->body[(size_t)i * ARENA_MAX_LENGTH + ((s->tail + s->length - 1) & (ARENA_MAX_LENGTH - 1))];
+}
+
+static inline uint32_t arena_tail(const Arena *a, int i) {
+    return a->body[(size_t)i * ARENA_MAX_LENGTH + a->snakes[i].tail];
+}
+
+static inline int64_t arena_step(const Arena *a, uint32_t cell, int direction) { // Neighbouring cell, -1 off the board
+    int row = (int)(cell / (uint32_t)a->cols), col = (int)(cell % (uint32_t)a->cols);
+    if (direction == ARENA_UP) row--;
+    else if (direction == ARENA_DOWN) row++;
+    else if (direction == ARENA_LEFT) col--;
+    else col++;
+    if (row < 0 || row >= a->rows || col < 0 || col >= a->cols) return -1;
+    return (int64_t)row * a->cols + col;
+}
+
+static inline int arena_passable(const Arena *a, uint32_t cell) { // Free, food, or a tail that leaves this tick
+    uint32_t owner = a->owner[cell];
+    if (owner == 0 || owner == ARENA_FOOD) return 1;
+    int j = (int)owner - 1;
+    return !a->snakes[j].grows && arena_tail(a, j) == cell;
+}
+
+static inline void arena_choose(Arena *a, int i) { // Bot move: food if next to it, else any open cell, mostly straight on
+    ArenaSnake *s = &a->snakes[i];
+    uint32_t head = arena_head(a, i);
+    static const int turns[3] = { 0, 1, 3 }; // Straight, left, right; never back
+
+    uint64_t r = arena_random(&s->rng);
+    int first = (r & 7) == 0 ? 1 + (int)((r >> 3) & 1) : 0; // Turn now and then
+    int best = -1, best_score = -1;
+    for (int k = 0; k < 3; k++) {
+        int direction = (s->direction + turns[(first + k) % 3]) & 3;
+        int64_t cell = arena_step(a, head, direction);
+        if (cell < 0) continue;
+        uint32_t owner = a->owner[cell];
+        int score = owner == ARENA_FOOD ? 2 : owner == 0 ? 1 : 0;
+        if (score > best_score) {
+            best_score = score;
+            best = direction;
+        }
+    }
+    if (best >= 0) s->direction = (uint8_t)best;
+}
+
+static inline void arena_claim(Arena *a, uint32_t cell) { // Count one more head moving into cell
+    uint32_t slot = (cell * 0x9e3779b1u) & a->claim_mask;
+    while (1) {
+        ArenaClaim *c = &a->claims[slot];
+        unsigned int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&c->cell, &expected, cell + 1, memory_order_relaxed, memory_order_relaxed) ||
+            expected == cell + 1) {
+            atomic_fetch_add_explicit(&c->count, 1, memory_order_relaxed);
+            return;
+        }
+        slot = (slot + 1) & a->claim_mask;
+    }
+}
+
+static inline unsigned int arena_claims(const Arena *a, uint32_t cell) { // Heads moving into cell this tick
+    uint32_t slot = (cell * 0x9e3779b1u) & a->claim_mask;
+    while (1) {
+        const ArenaClaim *c = &a->claims[slot];
+        unsigned int key = atomic_load_explicit(&c->cell, memory_order_relaxed);
+        if (key == 0) return 0;
+        if (key == cell + 1) return atomic_load_explicit(&c->count, memory_order_relaxed);
+        slot = (slot + 1) & a->claim_mask;
+    }
+}
+
+static inline void arena_pass_move(Arena *a, int from, int to) { // Choose moves and claim the next cells
+    for (int i = from; i < to; i++) {
+        ArenaSnake *s = &a->snakes[i];
+        if (!s->length) continue;
+        if (!s->steered) arena_choose(a, i);
+        int64_t next = arena_step(a, arena_head(a, i), s->direction);
+        s->dies = next < 0;
+        s->next = next < 0 ? 0 : (uint32_t)next;
+        s->eats = !s->dies && a->owner[s->next] == ARENA_FOOD;
+        s->grows = s->eats && s->length < ARENA_MAX_LENGTH;
+        if (!s->dies) arena_claim(a, s->next);
+    }
+}
+
+static inline void arena_pass_collide(Arena *a, int from, int to) { // Head-on, head-into-body and wall collisions
+    for (int i = from; i < to; i++) {
+        ArenaSnake *s = &a->snakes[i];
+        if (!s->length || s->dies) continue;
+        s->dies = arena_claims(a, s->next) > 1 || !arena_passable(a, s->next);
+    }
+}
+
+static inline void arena_pass_vacate(Arena *a, int from, int to) { // Move tails on and clear the bodies of the dead
+    for (int i = from; i < to; i++) {
+        ArenaSnake *s = &a->snakes[i];
+        if (!s->length) continue;
+        uint32_t *body = &a->body[(size_t)i * ARENA_MAX_LENGTH];
+        if (s->dies) {
+            for (uint32_t k = 0; k < s->length; k++) {
+                uint32_t cell = body[(s->tail + k) & (ARENA_MAX_LENGTH - 1)];
+                if (a->owner[cell] == (uint32_t)i + 1) a->owner[cell] = 0;
+            }
+        } else if (!s->grows) {
+            uint32_t cell = body[s->tail];
+            if (a->owner[cell] == (uint32_t)i + 1) a->owner[cell] = 0;
+            s->tail = (s->tail + 1) & (ARENA_MAX_LENGTH - 1);
+            s->length--;
+        }
+    }
+}
+
+static inline void arena_pass_advance(Arena *a, int from, int to) { // Place the surviving heads
+    for (int i = from; i < to; i++) {
+        ArenaSnake *s = &a->snakes[i];
+        if (!s->length) continue;
+        if (s->dies) {
+            s->length = 0;
+            continue;
+        }
+        a->body[(size_t)i * ARENA_MAX_LENGTH + ((s->tail + s->length) & (ARENA_MAX_LENGTH - 1))] = s->next;
+        s->length++;
+        a->owner[s->next] = (uint32_t)i + 1;
+    }
+}
+
+static inline void arena_clear_claims(Arena *a, int part, int parts) {
+    size_t slots = (size_t)a->claim_mask + 1;
+    size_t from = slots * part / parts, to = slots * (part + 1) / parts;
+    memset(&a->claims[from], 0, (to - from) * sizeof(ArenaClaim));
+}
+
+static inline void arena_run_passes(Arena *a, int part) { // One tick's parallel work for one worker
+    int from = (int)((long)a->count * part / a->threads), to = (int)((long)a->count * (part + 1) / a->threads);
+    arena_pass_move(a, from, to);
+    pthread_barrier_wait(&a->barrier);
+    arena_pass_collide(a, from, to);
+    pthread_barrier_wait(&a->barrier);
+    arena_pass_vacate(a, from, to);
+    arena_clear_claims(a, part, a->threads);
+    pthread_barrier_wait(&a->barrier);
+    arena_pass_advance(a, from, to);
+}
+
+static inline void *arena_worker(void *arg) {
+    int part = (int)(intptr_t)arg;
+    pthread_mutex_lock(&arena.starting); // Wait until the barrier exists
+    pthread_mutex_unlock(&arena.starting);
+    while (1) {
+        pthread_barrier_wait(&arena.barrier); // Tick start
+        if (!atomic_load(&arena.running)) break;
+        arena_run_passes(&arena, part);
+        pthread_barrier_wait(&arena.barrier); // Tick end
+    }
+    return NULL;
+}
+
+static inline int64_t arena_free_cell(Arena *a, int need_right) { // Random empty cell, optionally with an empty cell to its right
+    for (int tries = 0; tries < 64; tries++) {
+        uint32_t cell = (uint32_t)(arena_random(&a->rng) % ((uint64_t)a->rows * a->cols));
+        if (a->owner[cell] != 0) continue;
+        if (need_right && ((int)(cell % a->cols) == a->cols - 1 || a->owner[cell + 1] != 0)) continue;
+        return cell;
+    }
+    return -1; // Crowded; try again next tick
+}
+
+static inline void arena_spawn(Arena *a, int i) { // Place a snake of ARENA_START_LENGTH heading right, if there is room
+    int64_t cell = arena_free_cell(a, 1);
+    if (cell < 0) return;
+
+    ArenaSnake *s = &a->snakes[i];
+    uint32_t *body = &a->body[(size_t)i * ARENA_MAX_LENGTH];
+    s->tail = 0;
+    s->length = ARENA_START_LENGTH;
+    s->direction = ARENA_RIGHT;
+    s->eats = s->grows = s->dies = 0;
+    body[0] = (uint32_t)cell;
+    body[1] = (uint32_t)cell + 1;
+    a->owner[cell] = a->owner[cell + 1] = (uint32_t)i + 1;
+}
+
+static inline void arena_settle(Arena *a) { // Serial end of a tick: count, respawn and restock in snake order
+    for (int i = 0; i < a->count; i++) {
+        ArenaSnake *s = &a->snakes[i];
+        if (s->eats && !s->dies) {
+            a->eaten++;
+            a->food--;
+        }
+        s->eats = s->grows = 0;
+        if (s->dies) {
+            a->deaths++;
+            s->deaths++;
+            s->dies = 0;
+        }
+        if (!s->length) {
+            arena_spawn(a, i);
+            if (s->length) a->respawns++;
+        }
+    }
+    while (a->food < a->food_target) {
+        int64_t cell = arena_free_cell(a, 0);
+        if (cell < 0) break;
+        a->owner[cell] = ARENA_FOOD;
+        a->food++;
+    }
+}
+
+static inline void arena_tick() { // Advance every snake by one cell
+    Arena *a = &arena;
+    if (a->threads > 1) {
+        pthread_barrier_wait(&a->barrier); // Tick start
+        arena_run_passes(a, 0);
+        pthread_barrier_wait(&a->barrier); // Tick end
+    } else {
+        arena_pass_move(a, 0, a->count);
+        arena_pass_collide(a, 0, a->count);
+        arena_pass_vacate(a, 0, a->count);
+        arena_clear_claims(a, 0, 1);
+        arena_pass_advance(a, 0, a->count);
+    }
+    arena_settle(a);
+    a->tick++;
+}
+
+static inline uint64_t arena_checksum() { // Hash of every snake's position, equal for equal runs
+    const Arena *a = &arena;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < a->count; i++) {
+        uint64_t v = a->snakes[i].length ? ((uint64_t)arena_head(a, i) << 8 | a->snakes[i].length) : 0;
+        hash = (hash ^ v) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static inline int arena_side(int count) { // Rows and columns of the board for count snakes
+    int side = ARENA_MIN_SIDE;
+    while (side < ARENA_MAX_SIDE && (long)side * side < (long)count * ARENA_CELLS_PER_SNAKE) side++;
+    return side;
+}
+
+static inline size_t arena_snapshot_size(int count) { // Bytes arena_save() writes for an arena of count snakes
+    size_t side = (size_t)arena_side(count);
+    return sizeof(ArenaCounters) + side * side * sizeof(uint32_t) + (size_t)count * ARENA_MAX_LENGTH * sizeof(uint32_t) +
+           (size_t)count * sizeof(ArenaSnake);
+}
+
+static inline void arena_save(void *snapshot) { // Copy the arena between two ticks
+    const Arena *a = &arena;
+    ArenaCounters *c = snapshot;
+    *c = (ArenaCounters){ a->rng, a->tick, a->deaths, a->eaten, a->respawns, a->food };
+    unsigned char *p = (unsigned char *)(c + 1);
+    size_t owner = (size_t)a->rows * a->cols * sizeof(uint32_t), body = (size_t)a->count * ARENA_MAX_LENGTH * sizeof(uint32_t);
+    memcpy(p, a->owner, owner);
+    memcpy(p + owner, a->body, body);
+    memcpy(p + owner + body, a->snakes, (size_t)a->count * sizeof(ArenaSnake));
+}
+
+static inline void arena_load(const void *snapshot) { // Put back an arena copied by arena_save()
+    Arena *a = &arena;
+    const ArenaCounters *c = snapshot;
+    a->rng = c->rng;
+    a->tick = c->tick;
+    a->deaths = c->deaths;
+    a->eaten = c->eaten;
+    a->respawns = c->respawns;
+    a->food = c->food;
+    const unsigned char *p = (const unsigned char *)(c + 1);
+    size_t owner = (size_t)a->rows * a->cols * sizeof(uint32_t), body = (size_t)a->count * ARENA_MAX_LENGTH * sizeof(uint32_t);
+    memcpy(a->owner, p, owner);
+    memcpy(a->body, p + owner, body);
+    memcpy(a->snakes, p + owner + body, (size_t)a->count * sizeof(ArenaSnake));
+}
+
+static inline int arena_longest() {
+    int longest = 0;
+    for (int i = 0; i < arena.count; i++) {
+        if ((int)arena.snakes[i].length > longest) longest = (int)arena.snakes[i].length;
+    }
+    return longest;
+}
+
+static inline int arena_start(int count, int threads, uint64_t seed) { // Set up count snakes on a board sized for them
+    Arena *a = &arena;
+    int side = arena_side(count);
+
+    a->rows = a->cols = side;
+    a->count = count;
+    a->food_target = count / 2 + 1;
+    a->rng = seed ? seed : 1;
+
+    uint32_t slots = 1;
+    while (slots < (uint32_t)count * 2) slots <<= 1;
+    a->claim_mask = slots - 1;
+
+    a->owner = calloc((size_t)side * side, sizeof(uint32_t));
+    a->body = calloc((size_t)count * ARENA_MAX_LENGTH, sizeof(uint32_t));
+    a->snakes = calloc((size_t)count, sizeof(ArenaSnake));
+    a->claims = calloc(slots, sizeof(ArenaClaim));
+    if (!a->owner || !a->body || !a->snakes || !a->claims) return -1;
+
+    for (int i = 0; i < count; i++) {
+        a->snakes[i].rng = (seed + (uint64_t)i + 1) * 0x9e3779b97f4a7c15ULL;
+        arena_spawn(a, i);
+    }
+    arena_settle(a);
+
+    if (threads > ARENA_MAX_THREADS) threads = ARENA_MAX_THREADS;
+    if (threads > count / ARENA_SNAKES_PER_THREAD) threads = count / ARENA_SNAKES_PER_THREAD;
+    a->threads = threads > 1 ? threads : 1;
+    if (a->threads == 1) return 0;
+
+    pthread_mutex_init(&a->starting, NULL);
+    pthread_mutex_lock(&a->starting);
+    atomic_store(&a->running, 1);
+    sigset_t all, old; // Signals are for the simulation thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int started = 1;
+    while (started < a->threads && pthread_create(&a->workers[started], NULL, arena_worker, (void *)(intptr_t)started) == 0) {
+        started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (started < a->threads) { // The result does not depend on the thread count, so go on with fewer
+        fprintf(stderr, "arena: started %d of %d threads\n", started, a->threads);
+        a->threads = started;
+    }
+    if (a->threads > 1) pthread_barrier_init(&a->barrier, NULL, (unsigned int)a->threads);
+    pthread_mutex_unlock(&a->starting);
+    return 0;
+}
+
+static inline void arena_stop() { // Release the worker threads
+    Arena *a = &arena;
+    if (a->threads <= 1) return;
+    atomic_store(&a->running, 0);
+    pthread_barrier_wait(&a->barrier);
+    for (int t = 1; t < a->threads; t++) pthread_join(a->workers[t], NULL);
+    a->threads = 1;
+}
+
+#endif
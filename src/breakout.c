@@ -7,32 +7,144 @@
 #include <time.h>
 #include <ctype.h>
 #include <fcntl.h>
-
-#define WIDTH 50
+#include <stddef.h>
+#include "hiscore.h"
+#include "render.h"
+#include "compositor.h"
+#include "spectate.h"
+#include "input.h"
+#include "levelpack.h"
+#include "savestate.h"
+#include "framecheck.h"
+#include "capture.h"
+#include "realtime.h"
+#include "tournament.h"
+#include "session.h"
+#include "trace.h"
+#include "netplay.h"
+
+#define WIDTH 50 // Size of the built-in level
 #define HEIGHT 20
 #define PADDLE_WIDTH 7
+#define MIN_LEVEL_WIDTH (PADDLE_WIDTH + 2) // Narrowest level a pack may hold: the paddle plus a column each side
 #define BRICK_ROWS 4
 #define BRICK_COLS 3
 #define BRICK_WIDTH (WIDTH / BRICK_COLS)
 #define PADDLE_SPEED 2  // Number of spaces paddle moves per key press
+#define HIT_LOG_LEN (LEVEL_MAX_BRICKS * LEVEL_MAX_HP) // Enough for every hit a level can take
+#define MAX_BALLS 1024
+#define BALL_LANES 8 // Balls updated per vector operation
+#define MULTIBALL_EVERY 8 // Every this many broken bricks the ball that broke it splits in two
+#define SAVE_VERSION 2 // Bump when BreakoutSave changes
+#define FRAME_BYTE_BUDGET 256 // --check-frames: most bytes a delta frame may take
+#define FRAME_BYTES_PER_BALL 32 // ... plus this much for every ball served
+#define FRAME_WRITE_BUDGET 1 // Most write() calls a delta frame may take
+#define TICK_US 10000 // Input and drawing run every tick
+#define UPDATE_TICKS 15 // The ball moves every 15 ticks (150 ms)
+#define TOURNAMENT_MAX_TICKS 100000 // Default --max-ticks for a tournament game, in ball steps
+#define RIVAL_AWAY (-1000) // Where the second paddle sits outside a versus game, out of every ball's reach
+#define NOBODY 2 // Owner of a ball no paddle has returned yet
+
+// Balls are stored as parallel arrays and moved BALL_LANES at a time with
+// GCC vector extensions: reflections are computed as lane masks and applied
+// without branches. Only brick hits are resolved ball by ball, in index
+// order, so two balls reaching the same brick in one tick always play out
+// the same. Lanes past count are padding and never drawn.
+typedef int BallLane __attribute__((vector_size(BALL_LANES * sizeof(int))));
 
 typedef struct {
-    int x, y, dx, dy;
-} Ball;
+    int x[MAX_BALLS] __attribute__((aligned(sizeof(BallLane))));
+    int y[MAX_BALLS] __attribute__((aligned(sizeof(BallLane))));
+    int dx[MAX_BALLS] __attribute__((aligned(sizeof(BallLane))));
+    int dy[MAX_BALLS] __attribute__((aligned(sizeof(BallLane))));
+    int alive[MAX_BALLS] __attribute__((aligned(sizeof(BallLane)))); // 1 or 0, dead balls are compacted away at the end of a tick
+    int owner[MAX_BALLS] __attribute__((aligned(sizeof(BallLane)))); // Player whose paddle returned the ball last, or NOBODY
+    int count;
+} Balls;
 
 typedef struct {
     int x;
 } Paddle;
 
+// The wall is the level as stored in the pack plus the hits taken since it
+// started. Hits are counted per brick and tagged with the play they belong
+// to, so starting a level only bumps play instead of clearing the counts.
+// Every hit is also appended to a log; snapshots carry the log length, and
+// the render thread replays new entries into the compositor's background.
+// Versus rollbacks rewrite the log in place, so there snapshots carry a copy.
+// The arrays are sized for the pack's largest level and live in the session,
+// which is carved the same way for every play, so each level start finds
+// them where the last play left them.
 typedef struct {
-    int bricks[BRICK_ROWS][BRICK_COLS];
+    const Level *level; // Inside the mapped pack, never written
+    uint32_t index; // Level number within the pack
+    unsigned int play; // The session generation, bumped every time a level is (re)started
+    unsigned int *hit_play; // Per brick: play the hit count below belongs to
+    unsigned char *hits;
+    uint16_t *hit_log[2]; // Bricks hit, in order; alternates between plays
+    int hit_count;
 } BrickWall;
 
-Ball ball;
-Paddle paddle;
-BrickWall wall;
+typedef struct { // Snapshot of everything draw_game() needs
+    short ball_x[MAX_BALLS], ball_y[MAX_BALLS];
+    int ball_count;
+    Paddle paddle;
+    Paddle rival; // Versus: the second player's paddle
+    int local; // Versus: which of the two paddles is ours
+    int scores[2]; // Versus: bricks each player broke
+    unsigned int rewinds; // Versus: the wall has to be redrawn when this changes
+    const Level *level;
+    unsigned int play;
+    const uint16_t *hit_log;
+    int hit_count; // Entries of hit_log that are part of this snapshot
+    char message[64]; // Shown instead of the board when not empty
+    uint16_t hit_copy[]; // Versus: hit_log points here, since a rollback rewrites the session's log
+} BreakoutFrame;
+
+typedef struct { // Saved game; only the first hit_count log entries are written
+    uint64_t pack_size; // Together with level_count, tells packs apart
+    uint32_t level_count;
+    uint32_t level_index;
+    int start_balls;
+    int bricks_left;
+    int bricks_broken;
+    Paddle paddle;
+    Balls balls;
+    int hit_count;
+    uint16_t hit_log[HIT_LOG_LEN];
+} BreakoutSave;
+
+typedef struct { // Render thread: what the compositor's background currently shows
+    const Level *level;
+    unsigned int play;
+    int hit_count;
+    unsigned int rewinds;
+    unsigned char hits[LEVEL_MAX_BRICKS];
+} WallView;
+
+// Game state, one copy per thread so tournament workers each play their own
+_Thread_local Session session; // Holds balls and wall, carved again at every level start
+_Thread_local Balls *balls;
+_Thread_local int bricks_broken; // Counts towards the next multi-ball split
+_Thread_local Paddle paddle;
+_Thread_local Paddle rival = { RIVAL_AWAY }; // Second player's paddle, on the same row
+_Thread_local int scores[NOBODY + 1]; // Bricks broken by each player's balls
+_Thread_local BrickWall *wall;
+_Thread_local int in_play; // 0 while a game over or win message is up
+_Thread_local int bricks_left; // Count of remaining bricks
+int start_balls = 1; // Balls served at the start of a level
+uint32_t first_level = 0; // --level, also the level tournament games are played on
+uint32_t max_bricks; // Most bricks in any level of the pack
+WallView wall_view;
+LevelPack pack;
 int running = 1;
-int bricks_left; // Count of remaining bricks
+volatile sig_atomic_t quit_requested = 0; // Set by SIGINT/SIGTERM, acted on by the game loops
+int versus = 0; // --versus: two players over netplay.h
+long versus_tick; // Ticks simulated, part of the versus state
+long versus_over; // Tick the versus game ended on, 0 while it goes on
+unsigned int wall_rewinds; // Rollbacks that took back brick hits
+
+static const char *const breakout_policies[] = { "track", "still", NULL }; // First is the default
 
 // Terminal control functions
 struct termios orig_termios;
@@ -40,48 +152,6 @@ struct termios orig_termios;
 
 
 
-int kbhit() {// Check if a key has been pressed
-    struct termios oldt, newt;
-    int ch;
-    int oldf;
-
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
-
-    ch = getchar();
-    ch =tolower(ch);
-
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
-
-    if (ch != EOF) {
-        ungetc(ch, stdin);
-        return 1;
-    }
-
-    return 0;
-}
-
-char getch() {// Read a character from the input
-    struct termios oldt, newt;
-    char ch;
-    
-
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    ch = getchar();
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-
-    return tolower(ch);
-}
-
-
 void enable_raw_mode() {
     struct termios raw;
 
@@ -101,17 +171,46 @@ void disable_raw_mode() {
 
 
 
+// Save the game in progress for the next launch
+void save_game() {
+    static BreakoutSave save;
+    save.pack_size = pack.size;
+    save.level_count = pack.level_count;
+    save.level_index = wall->index;
+    save.start_balls = start_balls;
+    save.bricks_left = bricks_left;
+    save.bricks_broken = bricks_broken;
+    save.paddle = paddle;
+    save.balls = *balls;
+    save.hit_count = wall->hit_count;
+    memcpy(save.hit_log, wall->hit_log[wall->play & 1], wall->hit_count * sizeof(uint16_t));
+    savestate_write("breakout", SAVE_VERSION, &save, offsetof(BreakoutSave, hit_log) + wall->hit_count * sizeof(uint16_t));
+}
+
 void exit_game(int signal) {
     (void)signal; // Avoid unused parameter warning
+    if (in_play) save_game();
+    render_stop();
     //clear the terminal
     printf("\033[H\033[J");
     disable_raw_mode();
     exit(0);
 }
 
+// SIGINT/SIGTERM: saving and exiting are not async-signal-safe, so only ask for them
+void request_quit(int signal) {
+    (void)signal;
+    quit_requested = 1;
+}
+
+// Exit from the game thread once a signal asked for it
+void check_quit() {
+    if (quit_requested) exit_game(0);
+}
+
 void setup_signal_handlers() {
     struct sigaction sa;
-    sa.sa_handler = exit_game;
+    sa.sa_handler = request_quit;
     sa.sa_flags = 0;
     sigemptyset(&sa.sa_mask);
 
@@ -120,83 +219,339 @@ void setup_signal_handlers() {
     sigaction(SIGTERM, &sa, NULL);
 }
 
-// Initialize the game state
-void init_game() {
-    ball.x = WIDTH / 2;
-    ball.y = HEIGHT / 2;
-    ball.dx = 1;
-    ball.dy = -1;
+// Hits a brick has taken in the current play
+int brick_hits(int brick) {
+    return wall->hit_play[brick] == wall->play ? wall->hits[brick] : 0;
+}
 
-    paddle.x = WIDTH / 2 - PADDLE_WIDTH / 2;
+// Bytes of state a game needs with this pack
+size_t session_size() {
+    return session_need(sizeof(Balls)) + session_need(sizeof(BrickWall)) +
+           session_need(max_bricks * sizeof(unsigned int)) + session_need(max_bricks) +
+           2 * session_need(max_bricks * LEVEL_MAX_HP * sizeof(uint16_t));
+}
 
-    memset(wall.bricks, 1, sizeof(wall.bricks)); // Fill all bricks with "1" (exists)
-    bricks_left = BRICK_ROWS * BRICK_COLS;
+// Rewind the session and carve the game state out of it, always in the same order
+void start_session() {
+    if (!session.base && session_open(&session, session_size()) != 0) {
+        perror("Failed to allocate the game state");
+        exit(EXIT_FAILURE);
+    }
+    session_reset(&session);
+    balls = session_alloc(&session, sizeof(Balls));
+    wall = session_alloc(&session, sizeof(BrickWall));
+    wall->hit_play = session_alloc(&session, max_bricks * sizeof(unsigned int));
+    wall->hits = session_alloc(&session, max_bricks);
+    wall->hit_log[0] = session_alloc(&session, max_bricks * LEVEL_MAX_HP * sizeof(uint16_t));
+    wall->hit_log[1] = session_alloc(&session, max_bricks * LEVEL_MAX_HP * sizeof(uint16_t));
+    wall->play = session.generation;
 }
 
-// Draw the game state
-void draw_game() {
-    printf("\033[H\033[J");
+// Column to serve a ball on, spread by r over every column but the side walls
+int serve_column(uint64_t r, int width) {
+    return width > 2 ? 1 + (int)(r % (uint64_t)(width - 2)) : width / 2;
+}
 
-    // Draw bricks
-    for (int i = 0; i < BRICK_ROWS; i++) {
-        for (int j = 0; j < BRICK_COLS; j++) {
-            if (wall.bricks[i][j]) {
-                for (int k = 0; k < BRICK_WIDTH - 1; k++) {
-                    printf("\033[%d;%dH#", i + 1, j * BRICK_WIDTH + k + 1);
-                }
-            }
+// Initialize the game state for a level of the pack
+void init_game(uint32_t index) {
+    start_session();
+    wall->level = level_pack_get(&pack, index);
+    if (!wall->level) {
+        index = 0; // Damaged entry, fall back to the first level
+        wall->level = level_pack_get(&pack, 0);
+    }
+    wall->index = index;
+    wall->hit_count = 0;
+    bricks_left = (int)wall->level->breakable;
+    in_play = 1;
+
+    // Extra balls fan out across the starting row and the two above it
+    int width = wall->level->width, height = wall->level->height;
+    balls->count = start_balls;
+    for (int i = 0; i < balls->count; i++) {
+        balls->x[i] = serve_column((uint64_t)(width / 2 + i * 7), width);
+        balls->y[i] = height / 2 - i % 3;
+        balls->dx[i] = (i & 1) ? -1 : 1;
+        balls->dy[i] = -1;
+        balls->alive[i] = 1;
+        balls->owner[i] = NOBODY;
+    }
+    balls->x[0] = width / 2;
+    memset(scores, 0, sizeof(scores));
+    bricks_broken = 0;
+
+    paddle.x = wall->level->width / 2 - PADDLE_WIDTH / 2;
+}
+
+// Continue a saved game played on the same pack; returns 1 if resumed
+int resume_game() {
+    static BreakoutSave save;
+    long size = savestate_read("breakout", SAVE_VERSION, &save, sizeof(save));
+    if (size < (long)offsetof(BreakoutSave, hit_log) || save.pack_size != pack.size || save.level_count != pack.level_count ||
+        save.hit_count < 0 || save.hit_count > HIT_LOG_LEN ||
+        size != (long)(offsetof(BreakoutSave, hit_log) + save.hit_count * sizeof(uint16_t)) ||
+        save.balls.count < 1 || save.balls.count > MAX_BALLS || save.start_balls < 1 || save.start_balls > MAX_BALLS) {
+        return 0;
+    }
+    const Level *level = level_pack_get(&pack, save.level_index);
+    if (!level) return 0;
+    if (save.hit_count > (int)(level->brick_count * LEVEL_MAX_HP)) return 0; // More than the session holds
+    for (int i = 0; i < save.hit_count; i++) {
+        if (save.hit_log[i] >= level->brick_count) return 0;
+    }
+
+    start_balls = save.start_balls;
+    init_game(save.level_index);
+    bricks_left = save.bricks_left;
+    bricks_broken = save.bricks_broken;
+    paddle = save.paddle;
+    *balls = save.balls;
+
+    // Replaying the log rebuilds the per-brick hit counts of this play
+    uint16_t *log = wall->hit_log[wall->play & 1];
+    memcpy(log, save.hit_log, save.hit_count * sizeof(uint16_t));
+    for (wall->hit_count = 0; wall->hit_count < save.hit_count; wall->hit_count++) {
+        int brick = log[wall->hit_count];
+        wall->hits[brick] = (unsigned char)(brick_hits(brick) + 1);
+        wall->hit_play[brick] = wall->play;
+    }
+    return 1;
+}
+
+// Glyph of a brick that has taken hits
+Glyph brick_glyph(const LevelBrick *brick, int hits) {
+    if (brick->type == BRICK_SOLID) return 'X';
+    switch (brick->hp - hits) {
+        case 1: return '#';
+        case 2: return '&';
+        default: return '@';
+    }
+}
+
+// Apply a hit to a brick in the background layer
+void draw_brick(int brick, Glyph glyph) {
+    const LevelBrick *b = &level_bricks(wall_view.level)[brick];
+    for (int k = 0; k < b->width; k++) {
+        comp_static_change(b->row, b->col + k, glyph);
+    }
+}
+
+// Rebuild the background for a new level, or a restart of the same one
+void draw_level(const BreakoutFrame *frame) {
+    const Level *level = frame->level;
+    const LevelBrick *bricks = level_bricks(level);
+
+    comp_init(level->height + 1, level->width);
+    for (uint32_t i = 0; i < level->brick_count; i++) {
+        for (int k = 0; k < bricks[i].width; k++) {
+            comp_static_put(bricks[i].row, bricks[i].col + k, brick_glyph(&bricks[i], 0));
         }
     }
+    comp_seal();
+
+    wall_view.level = level;
+    wall_view.play = frame->play;
+    wall_view.hit_count = 0;
+    wall_view.rewinds = frame->rewinds;
+    memset(wall_view.hits, 0, level->brick_count);
+}
+
+// Draw a game state snapshot
+void draw_game(const void *data) {
+    TRACE_SCOPE("draw_game");
+    const BreakoutFrame *frame = data;
+
+    if (frame->message[0]) {
+        char text[sizeof(frame->message) + 1];
+        snprintf(text, sizeof(text), "%s\n", frame->message);
+        comp_present_text(text);
+        return;
+    }
+
+    if (frame->level != wall_view.level || frame->play != wall_view.play || frame->rewinds != wall_view.rewinds) {
+        draw_level(frame);
+    }
+    comp_begin();
+
+    // Bricks hit since the last drawn snapshot
+    for (; wall_view.hit_count < frame->hit_count; wall_view.hit_count++) {
+        int brick = frame->hit_log[wall_view.hit_count];
+        const LevelBrick *b = &level_bricks(wall_view.level)[brick];
+        int hits = ++wall_view.hits[brick];
+        draw_brick(brick, hits >= b->hp ? ' ' : brick_glyph(b, hits));
+    }
 
-    // Draw ball
-    printf("\033[%d;%dHO", ball.y + 1, ball.x + 1);
+    // Draw balls
+    for (int i = 0; i < frame->ball_count; i++) {
+        comp_put(frame->ball_y[i], frame->ball_x[i], 'O');
+    }
 
-    // Draw paddle
+    // Draw paddles, the other player's as dashes
+    const Paddle *mine = frame->local ? &frame->rival : &frame->paddle, *theirs = frame->local ? &frame->paddle : &frame->rival;
+    if (theirs->x != RIVAL_AWAY) {
+        for (int i = 0; i < PADDLE_WIDTH; i++) {
+            comp_put(frame->level->height - 1, theirs->x + i, '-');
+        }
+    }
     for (int i = 0; i < PADDLE_WIDTH; i++) {
-        printf("\033[%d;%dH=", HEIGHT, paddle.x + i + 1);
+        comp_put(frame->level->height - 1, mine->x + i, '=');
+    }
+    if (theirs->x != RIVAL_AWAY) {
+        comp_printf(frame->level->height, 0, "FPS: %d   Balls: %d   You: %d   Them: %d", render_fps(), frame->ball_count,
+                    frame->scores[frame->local], frame->scores[1 - frame->local]);
+    } else {
+        comp_printf(frame->level->height, 0, "FPS: %d   Balls: %d", render_fps(), frame->ball_count);
     }
-    printf("\n");
 
-    fflush(stdout);
+    comp_present();
 }
 
-// Update game state
-void update_game() {
-    // Move ball
-    ball.x += ball.dx;
-    ball.y += ball.dy;
+// Hand the current state (or a full-screen message) to the render thread
+void publish_frame(const char *message) {
+    TRACE_SCOPE("publish_frame");
+    BreakoutFrame *frame = render_frame();
+    for (int i = 0; i < balls->count; i++) {
+        frame->ball_x[i] = (short)balls->x[i];
+        frame->ball_y[i] = (short)balls->y[i];
+    }
+    frame->ball_count = balls->count;
+    frame->paddle = paddle;
+    frame->rival = rival;
+    frame->local = versus ? netplay.local : 0;
+    frame->scores[0] = scores[0];
+    frame->scores[1] = scores[1];
+    frame->rewinds = wall_rewinds;
+    frame->level = wall->level;
+    frame->play = wall->play;
+    frame->hit_log = wall->hit_log[wall->play & 1];
+    frame->hit_count = wall->hit_count;
+    if (versus) {
+        memcpy(frame->hit_copy, frame->hit_log, wall->hit_count * sizeof(uint16_t));
+        frame->hit_log = frame->hit_copy;
+    }
+    snprintf(frame->message, sizeof(frame->message), "%s", message);
+    render_publish();
+}
 
-    // Ball collision with walls
-    if (ball.x <= 0 || ball.x >= WIDTH - 1) ball.dx *= -1;
+// Split a ball in two, the new one heading the other way
+void split_ball(int i) {
+    if (balls->count >= MAX_BALLS) return;
+    int n = balls->count++;
+    balls->x[n] = balls->x[i];
+    balls->y[n] = balls->y[i];
+    balls->dx[n] = -balls->dx[i];
+    balls->dy[n] = balls->dy[i];
+    balls->alive[n] = 1;
+    balls->owner[n] = balls->owner[i];
+}
 
-    // Ball collision with top edge
-    if (ball.y <= 0) ball.dy *= -1;
+// Ball collision with bricks: one grid lookup, however large the wall
+void hit_brick(int i) {
+    int brick = level_brick_at(wall->level, balls->y[i], balls->x[i]);
+    if (brick < 0) return;
 
-    // Ball collision with paddle
-    if (ball.y == HEIGHT - 1 && ball.x >= paddle.x && ball.x < paddle.x + PADDLE_WIDTH) {
-        ball.dy *= -1;
+    const LevelBrick *b = &level_bricks(wall->level)[brick];
+    int hits = brick_hits(brick);
+    if (b->type == BRICK_SOLID) {
+        balls->dy[i] *= -1;
+        return;
+    }
+    if (hits >= b->hp) return; // Already broken
+
+    wall->hit_play[brick] = wall->play;
+    wall->hits[brick] = (unsigned char)(hits + 1);
+    wall->hit_log[wall->play & 1][wall->hit_count++] = (uint16_t)brick;
+    balls->dy[i] *= -1;
+    if (hits + 1 == b->hp) {
+        bricks_left--;
+        scores[balls->owner[i]]++;
+        if (++bricks_broken % MULTIBALL_EVERY == 0) split_ball(i);
     }
+}
 
-    // Ball collision with bricks
-    if (ball.y < BRICK_ROWS) {
-        int row = ball.y;
-        int col = ball.x / BRICK_WIDTH;
-        if (col >= 0 && col < BRICK_COLS && wall.bricks[row][col]) {
-            wall.bricks[row][col] = 0;
-            bricks_left--;
-            ball.dy *= -1;
-        }
+// Move every ball and bounce it off the walls, the top edge and the paddle
+void move_balls() {
+    TRACE_SCOPE("move_balls");
+    int lanes = (balls->count + BALL_LANES - 1) / BALL_LANES;
+    BallLane *x = (BallLane *)balls->x, *y = (BallLane *)balls->y;
+    BallLane *dx = (BallLane *)balls->dx, *dy = (BallLane *)balls->dy, *owner = (BallLane *)balls->owner;
+    BallLane zero = { 0 };
+    BallLane right = zero + (wall->level->width - 1), bottom = zero + (wall->level->height - 1);
+    BallLane paddle_left = zero + paddle.x, paddle_right = zero + (paddle.x + PADDLE_WIDTH);
+    BallLane rival_left = zero + rival.x, rival_right = zero + (rival.x + PADDLE_WIDTH);
+
+    for (int l = 0; l < lanes; l++) {
+        x[l] += dx[l];
+        y[l] += dy[l];
+
+        // Comparisons give -1 in the lanes where they hold; (v ^ -1) - -1 is -v
+        BallLane flip = (x[l] <= zero) | (x[l] >= right); // Ball collision with walls
+        dx[l] = (dx[l] ^ flip) - flip;
+
+        BallLane mine = (y[l] == bottom) & (x[l] >= paddle_left) & (x[l] < paddle_right);
+        BallLane theirs = (y[l] == bottom) & (x[l] >= rival_left) & (x[l] < rival_right) & ~mine;
+        flip = (y[l] <= zero) | mine | theirs; // Top edge and paddles
+        dy[l] = (dy[l] ^ flip) - flip;
+        owner[l] = (owner[l] & ~(mine | theirs)) | (theirs & 1); // Player 1 or 2 returned it
+    }
+}
+
+// Drop balls that fell past the paddle, keeping the others in order
+void drop_balls() {
+    TRACE_SCOPE("drop_balls");
+    int lanes = (balls->count + BALL_LANES - 1) / BALL_LANES;
+    BallLane *y = (BallLane *)balls->y, *alive = (BallLane *)balls->alive;
+    BallLane zero = { 0 };
+    BallLane bottom = zero + wall->level->height;
+    for (int l = 0; l < lanes; l++) {
+        alive[l] = -(y[l] < bottom);
+    }
+
+    int kept = 0;
+    for (int i = 0; i < balls->count; i++) {
+        balls->x[kept] = balls->x[i];
+        balls->y[kept] = balls->y[i];
+        balls->dx[kept] = balls->dx[i];
+        balls->dy[kept] = balls->dy[i];
+        balls->owner[kept] = balls->owner[i];
+        kept += balls->alive[i];
+    }
+    balls->count = kept;
+}
+
+// Move every ball one step and resolve what it hit
+void step_balls() {
+    TRACE_SCOPE("step_balls");
+    move_balls();
+
+    // Ball collision with bricks, in ball order; splits join at the end and move next tick
+    int n = balls->count;
+    for (int i = 0; i < n; i++) {
+        hit_brick(i);
     }
 
+    drop_balls();
+}
+
+// Update game state
+void update_game() {
+    TRACE_SCOPE("update_game");
+    savestate_hold(); // A signal in the middle of a tick would save a torn state
+    step_balls();
+    savestate_release();
+
     // Check for game over
-    if (ball.y >= HEIGHT) {
-        printf("\033[H\033[JGame Over! Q for exit, R for retry\n");
+    if (balls->count == 0) {
+        in_play = 0;
+        hiscore_submit((int)wall->level->breakable - bricks_left);
+        publish_frame("Game Over! Q for exit, R for retry");
         k: char choice;
-        choice = getch();
+        choice = input_wait_key();
+        check_quit();
         if(choice=='q' || choice == 'r'){
                         
             if (choice == 'r') {
-                init_game();
+                init_game(wall->index);
             } else if (choice == 'q') {
                 exit_game(0);
             }}
@@ -207,14 +562,19 @@ void update_game() {
 
     // Check for win
     if (bricks_left == 0) {
-       
-        printf("\033[H\033[JYou Win! Q for exit, R for playing again\n");
+        in_play = 0;
+        hiscore_submit((int)wall->level->breakable);
+        publish_frame(wall->index + 1 < pack.level_count ? "Level cleared! Q for exit, R for retry, N for next level"
+                                                        : "You Win! Q for exit, R for playing again");
         m: char choice;
-        choice = getch();
-        if(choice=='q' || choice == 'r'){
+        choice = input_wait_key();
+        check_quit();
+        if(choice=='q' || choice == 'r' || choice == 'n'){
                         
             if (choice == 'r') {
-                init_game();
+                init_game(wall->index);
+            } else if (choice == 'n') {
+                init_game((wall->index + 1) % pack.level_count);
             } else if (choice == 'q') {
                 exit_game(0);
             }}
@@ -225,52 +585,403 @@ void update_game() {
 }
 
 // Read user input and move paddle
+// All keys typed since the last loop are applied at once. Terminals report no
+// key releases, so a held key is simply its autorepeat stream; draining it
+// every loop keeps the paddle from lagging behind the keyboard.
 void process_input() {
-    if (kbhit()) {
-        int c = getch();
-        if (c == 'a' && paddle.x > 0) {
-            paddle.x -= PADDLE_SPEED;
-            if (paddle.x < 0) paddle.x = 0; // Prevent overflow
-        }
-        if (c == 'd' && paddle.x < WIDTH - PADDLE_WIDTH) {
-            paddle.x += PADDLE_SPEED;
-            if (paddle.x > WIDTH - PADDLE_WIDTH) paddle.x = WIDTH - PADDLE_WIDTH; // Prevent overflow
+    TRACE_SCOPE("process_input");
+    InputEvent ev;
+    int steps = 0;
+    long long first_at = 0;
+
+    while (input_poll(&ev)) {
+        if (ev.key == 'a') steps--;
+        if (ev.key == 'd') steps++;
+        if ((ev.key == 'a' || ev.key == 'd') && !first_at) first_at = ev.at_us;
+        if (ev.key == 'q') {
+            exit_game(0);
         }
-        if (c == 'q') {
-                exit_game(0);
-            }
+    }
+
+    if (steps != 0) {
+        paddle.x += steps * PADDLE_SPEED;
+        if (paddle.x < 0) paddle.x = 0; // Prevent overflow
+        if (paddle.x > wall->level->width - PADDLE_WIDTH) paddle.x = wall->level->width - PADDLE_WIDTH; // Prevent overflow
+        render_mark_input(first_at);
     }
 }
 
 // Main game loop
 void game_loop() {
-    struct timespec last_update, current_time;
-    long delta_time;
+    long tick = 0;
+
+    while (running) {
+        {
+            TRACE_SCOPE("tick");
+            session_tick(&session);
+            process_input();
+
+            // Update game state only on regular intervals
+            if (++tick % UPDATE_TICKS == 0) {
+                update_game();
+            }
+
+            publish_frame("");
+        }
+
+        realtime_wait();
+        check_quit();
+    }
+}
+
+// Versus
+// --versus pits two players against one wall (see netplay.h). Both paddles
+// guard the bottom edge, the first to start as player 1. A ball belongs to
+// whichever paddle returned it last, and every brick it breaks scores for
+// that player. The game ends like a normal one, and the higher score wins.
+// An input is a paddle position plus one, so a late packet is predicted by
+// the paddle staying where it was. The rollback snapshot is the session
+// arena, which holds the balls and the wall, plus the globals below.
+
+typedef struct {
+    int bricks_broken, bricks_left;
+    Paddle paddle, rival;
+    int scores[NOBODY + 1];
+    long tick, over;
+} VersusState;
+
+// Snapshot size: the state above plus the used part of the session
+size_t versus_size() {
+    return sizeof(VersusState) + session.used;
+}
+
+void versus_save(void *snapshot) {
+    VersusState *state = snapshot;
+    state->bricks_broken = bricks_broken;
+    state->bricks_left = bricks_left;
+    state->paddle = paddle;
+    state->rival = rival;
+    memcpy(state->scores, scores, sizeof(scores));
+    state->tick = versus_tick;
+    state->over = versus_over;
+    memcpy(state + 1, session.base, session.used);
+}
+
+void versus_load(const void *snapshot) {
+    const VersusState *state = snapshot;
+    int hit_count = wall->hit_count;
+    bricks_broken = state->bricks_broken;
+    bricks_left = state->bricks_left;
+    paddle = state->paddle;
+    rival = state->rival;
+    memcpy(scores, state->scores, sizeof(scores));
+    versus_tick = state->tick;
+    versus_over = state->over;
+    memcpy(session.base, state + 1, session.used);
+    if (wall->hit_count < hit_count) wall_rewinds++; // Hits already drawn were taken back
+}
+
+// One tick with both players' inputs; the balls move every UPDATE_TICKS
+void versus_step(const NetInput inputs[2]) {
+    Paddle *paddles[2] = { &paddle, &rival };
+    for (int p = 0; p < 2; p++) {
+        int x = inputs[p] - 1;
+        if (inputs[p] == 0 || x > wall->level->width - PADDLE_WIDTH) continue;
+        paddles[p]->x = x;
+    }
+    versus_tick++;
+    if (versus_over || versus_tick % UPDATE_TICKS) return;
+    step_balls();
+    if (balls->count == 0 || bricks_left == 0) versus_over = versus_tick;
+}
+
+// Apply this side's keys to where it wants its paddle
+void versus_input(int *x) {
+    TRACE_SCOPE("process_input");
+    InputEvent ev;
+    int steps = 0;
+    long long first_at = 0;
+
+    while (input_poll(&ev)) {
+        if (ev.key == 'a') steps--;
+        if (ev.key == 'd') steps++;
+        if ((ev.key == 'a' || ev.key == 'd') && !first_at) first_at = ev.at_us;
+        if (ev.key == 'q') exit_game(0);
+    }
+    if (steps != 0) {
+        *x += steps * PADDLE_SPEED;
+        if (*x < 0) *x = 0;
+        if (*x > wall->level->width - PADDLE_WIDTH) *x = wall->level->width - PADDLE_WIDTH;
+        render_mark_input(first_at);
+    }
+}
+
+// Connect to the other player and lay out the shared start; 0 on success
+int versus_start(uint64_t seed, long delay_ms) {
+    uint32_t settings[NETPLAY_SETTINGS] = { (uint32_t)pack.size, pack.level_count, first_level % pack.level_count,
+                                            (uint32_t)start_balls };
+    NetGame calls = { versus_save, versus_load, versus_step };
+    init_game(first_level % pack.level_count);
+    if (netplay_start("breakout", &seed, settings, &calls, versus_size(), delay_ms) != 0) return -1;
+
+    int width = wall->level->width;
+    in_play = 0; // Nothing to resume: the other player would not be there
+    paddle.x = width / 4 - PADDLE_WIDTH / 2;
+    rival.x = width * 3 / 4 - PADDLE_WIDTH / 2;
+    balls->x[0] = serve_column(seed, width); // Served the same on both sides
+    balls->dx[0] = (seed >> 32) & 1 ? 1 : -1;
+    return 0;
+}
 
-    clock_gettime(CLOCK_MONOTONIC, &last_update);
+// The versus game loop: ticks go through netplay, which may roll back
+void versus_loop() {
+    int x = netplay.local ? rival.x : paddle.x;
+    char message[64] = "";
 
     while (running) {
-        draw_game();
+        {
+            TRACE_SCOPE("tick");
+            session_tick(&session);
+            versus_input(&x);
+            if (!netplay.connected) {
+                snprintf(message, sizeof(message), "The other player left. Q for exit");
+            } else if (versus_over && netplay_confirmed((uint32_t)versus_over)) {
+                int mine = scores[netplay.local], theirs = scores[netplay.remote];
+                snprintf(message, sizeof(message), "%s %d to %d. Q for exit",
+                         mine > theirs ? "You win" : mine < theirs ? "You lose" : "Draw", mine, theirs);
+                netplay_idle(); // The other side may still need our last inputs
+            } else {
+                netplay_tick((NetInput)(x + 1));
+            }
+            publish_frame(message);
+        }
+
+        realtime_wait();
+        check_quit();
+    }
+}
 
-        process_input();
+// Tournament
+// --tournament N plays N games headless on --threads workers (see tournament.h).
+// The seed picks where the first ball is served and which way it goes. The
+// "track" policy moves the paddle towards the lowest falling ball, at most
+// param presses (default 2) per ball step; "still" never moves it.
+
+// Paddle presses towards the ball that will reach the bottom first
+int track_presses(int limit) {
+    int target = -1;
+    for (int i = 0; i < balls->count; i++) {
+        if (target < 0 || (balls->dy[i] > 0 && (balls->dy[target] < 0 || balls->y[i] > balls->y[target]))) target = i;
+    }
+    if (target < 0) return 0;
+
+    int presses = (balls->x[target] - (paddle.x + PADDLE_WIDTH / 2)) / PADDLE_SPEED;
+    if (presses > limit) presses = limit;
+    if (presses < -limit) presses = -limit;
+    return presses;
+}
 
-        // Update game state only on regular intervals
-        clock_gettime(CLOCK_MONOTONIC, &current_time);
-        delta_time = (current_time.tv_sec - last_update.tv_sec) * 1000000000L + (current_time.tv_nsec - last_update.tv_nsec);
+// One headless game
+void play_tournament_game(uint64_t seed, const TourPolicy *policy, long max_ticks, TourResult *result) {
+    int limit = strcmp(policy->name, "still") == 0 ? 0 : policy->param > 0 ? (int)policy->param : 2;
+    init_game(first_level % pack.level_count);
+    balls->x[0] = serve_column(seed, wall->level->width);
+    balls->dx[0] = (seed >> 32) & 1 ? 1 : -1;
+
+    long tick = 0;
+    result->outcome = TOUR_CAPPED;
+    while (tick < max_ticks) {
+        session_tick(&session);
+        paddle.x += track_presses(limit) * PADDLE_SPEED;
+        if (paddle.x < 0) paddle.x = 0;
+        if (paddle.x > wall->level->width - PADDLE_WIDTH) paddle.x = wall->level->width - PADDLE_WIDTH;
+
+        step_balls();
+        tick++;
+        if (balls->count == 0) {
+            result->outcome = TOUR_LOST;
+            break;
+        }
+        if (bricks_left == 0) {
+            result->outcome = TOUR_WON;
+            break;
+        }
+    }
+    result->score = (uint32_t)((int)wall->level->breakable - bricks_left);
+    result->ticks = (uint32_t)tick;
+}
 
-        if (delta_time >= 150000000L) { // Update every 50ms
-            update_game();
-            last_update = current_time;
+// Load the built-in wall as a one-level pack
+int load_default_level() {
+    LevelBrick bricks[BRICK_ROWS * BRICK_COLS];
+    int count = 0;
+    for (int i = 0; i < BRICK_ROWS; i++) {
+        for (int j = 0; j < BRICK_COLS; j++) {
+            bricks[count++] = (LevelBrick){ (uint16_t)i, (uint16_t)(j * BRICK_WIDTH), BRICK_WIDTH - 1, BRICK_NORMAL, 1, 0 };
         }
+    }
+    return level_pack_single(&pack, WIDTH, HEIGHT, bricks, count);
+}
 
-        usleep(10000); // Sleep to reduce CPU usage
+// Write a pack of generated levels, growing from the built-in size to the
+// largest board the terminal code supports
+int make_levels(const char *path, int count) {
+    static LevelBrick bricks[LEVEL_MAX_BRICKS];
+    LevelPackWriter writer;
+    if (count < 1 || level_pack_create(&writer, path, (uint32_t)count) != 0) return -1;
+
+    unsigned int seed = 1;
+    for (int n = 0; n < count; n++) {
+        int width = WIDTH + (LEVEL_MAX_WIDTH - WIDTH) * (n % 32) / 31;
+        int height = HEIGHT + (LEVEL_MAX_HEIGHT - HEIGHT) * (n % 32) / 31;
+        int rows = height / 2 - 2; // Keep the ball's starting row clear
+        int bricks_count = 0;
+
+        for (int row = 0; row < rows; row++) {
+            if (rand_r(&seed) % 5 == 0) continue; // Leave some rows open
+            int col = rand_r(&seed) % 3;
+            while (col < width) {
+                int brick_width = 2 + rand_r(&seed) % 4;
+                if (col + brick_width > width) break;
+                LevelBrick *b = &bricks[bricks_count++];
+                b->row = (uint16_t)row;
+                b->col = (uint16_t)col;
+                b->width = (uint8_t)brick_width;
+                b->type = rand_r(&seed) % 25 == 0 ? BRICK_SOLID : BRICK_NORMAL;
+                b->hp = (uint8_t)(1 + rand_r(&seed) % LEVEL_MAX_HP);
+                b->reserved = 0;
+                col += brick_width + 1;
+            }
+        }
+        if (level_pack_add(&writer, width, height, bricks, bricks_count) != 0) break;
     }
+    return level_pack_finish(&writer);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    int spectate = 0;
+    int check_frames = 0;
+    const char *script = NULL;
+    int capture_frames = 0;
+    int tracing = 0;
+    long net_delay = 0;
+    const char *levels = NULL;
+    const char *policy_spec = breakout_policies[0], *out = NULL;
+    long tournament_games = 0, max_ticks = TOURNAMENT_MAX_TICKS;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = (uint64_t)time(NULL);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--spectate") == 0) {
+            spectate = 1;
+        } else if (strcmp(argv[i], "--check-frames") == 0) {
+            check_frames = 1;
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script = argv[++i]; // Testing: take keys at the frames the file gives
+        } else if (strcmp(argv[i], "--capture") == 0) {
+            capture_frames = 1;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            tracing = 1;
+        } else if (strcmp(argv[i], "--levels") == 0 && i + 1 < argc) {
+            levels = argv[++i];
+        } else if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+            start_balls = atoi(argv[++i]); // Stress mode: serve many balls at once
+            if (start_balls < 1) start_balls = 1;
+            if (start_balls > MAX_BALLS) start_balls = MAX_BALLS;
+        } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) {
+            first_level = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--make-levels") == 0 && i + 1 < argc) {
+            int count = i + 2 < argc ? atoi(argv[i + 2]) : 1000;
+            if (make_levels(argv[i + 1], count) != 0) {
+                perror("Failed to write level pack");
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--tournament") == 0 && i + 1 < argc) {
+            tournament_games = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            policy_spec = argv[++i];
+        } else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc) {
+            max_ticks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--versus") == 0) {
+            versus = 1;
+        } else if (strcmp(argv[i], "--net-delay") == 0 && i + 1 < argc) {
+            net_delay = atol(argv[++i]); // Testing: hold every packet back this many milliseconds
+        }
+    }
+    if (check_frames) {
+        framecheck_start("breakout", FRAME_BYTE_BUDGET + FRAME_BYTES_PER_BALL * start_balls, FRAME_WRITE_BUDGET);
+    }
+    if (script && input_script(script) != 0) {
+        return 1;
+    }
+
+    if (levels ? level_pack_open(&pack, levels) != 0 : load_default_level() != 0) {
+        fprintf(stderr, "Failed to load levels%s%s\n", levels ? " from " : "", levels ? levels : "");
+        return 1;
+    }
+
+    const char *levels_name = levels ? levels : "the built-in level";
+    if (pack.min_width < MIN_LEVEL_WIDTH) { // The header holds the narrowest width and most bricks of any level
+        fprintf(stderr, "A level of %s is %d columns wide, Breakout needs at least %d\n", levels_name, pack.min_width,
+                MIN_LEVEL_WIDTH);
+        return 1;
+    }
+    max_bricks = pack.max_bricks;
+    if (!level_pack_get(&pack, 0)) { // Damaged levels fall back to the first one
+        fprintf(stderr, "The first level of %s is damaged\n", levels_name);
+        return 1;
+    }
+
+    if (tournament_games > 0) { // Headless, nothing touches the terminal
+        TourPolicy policy;
+        if (tour_policy_parse(&policy, policy_spec, breakout_policies) != 0) {
+            fprintf(stderr, "Unknown policy %s, breakout has track[:presses] and still\n", policy_spec);
+            return 1;
+        }
+        if (tour_run("breakout", &policy, play_tournament_game, tournament_games, threads, seed, max_ticks, out) != 0) {
+            perror("Failed to run the tournament");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (tracing && trace_start("breakout") != 0) {
+        perror("Failed to start tracing");
+    }
     enable_raw_mode();
     setup_signal_handlers();
-    init_game();
-    game_loop();
+    hiscore_open("breakout");
+    if (versus) {
+        if (versus_start(seed, net_delay) != 0) {
+            check_quit(); // Interrupted while waiting for the other player
+            perror("Failed to start a versus game");
+            disable_raw_mode();
+            return 1;
+        }
+    } else if (!resume_game()) {
+        init_game(first_level % pack.level_count);
+    }
+    if (spectate && spectate_start("breakout") != 0) {
+        perror("Failed to start spectator mode");
+    }
+    if (capture_frames && capture_start("breakout") != 0) {
+        perror("Failed to start capture");
+    }
+    render_start(sizeof(BreakoutFrame) + (versus ? max_bricks * LEVEL_MAX_HP * sizeof(uint16_t) : 0), draw_game);
+    input_start("breakout");
+    if (!script) { // Scripted runs tick back to back
+        realtime_start("breakout", TICK_US);
+    }
+    if (versus) {
+        versus_loop();
+    } else {
+        game_loop();
+    }
     return 0;
-}
\ No newline at end of file
+}
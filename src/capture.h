@@ -0,0 +1,472 @@
+#ifndef VGC_CAPTURE_H
+#define VGC_CAPTURE_H
+
+// Gameplay capture: record a session as compressed delta frames.
+//
+// Enabled with --capture. The compositor hands over each frame as cells: the
+// whole screen on a keyframe, otherwise only the cells it just redrew. The
+// render thread copies them into a single-producer ring with a timestamp and
+// goes on; a background thread drains the ring, keeps its own copy of the
+// screen and encodes the frames into blocks. Every block starts with a
+// keyframe of the full screen, holds up to CAPTURE_BLOCK_FRAMES frames and is
+// compressed on its own with a small LZ77 coder, so a player can start
+// decoding at any block. A table of block offsets and times closes the file;
+// without it (a crash) the blocks can still be walked from the start. If the
+// encoder falls a whole ring behind, frames are dropped and the next one is
+// captured as a keyframe, so the recording stays consistent.
+//
+// File layout: CaptureHeader, then CaptureBlock headers each followed by
+// their packed bytes, then CaptureIndex entries and a CaptureTrailer. Inside
+// a block every frame is a CaptureFrame followed by its payload:
+//   CAPTURE_KEY    rows, cols, then rows * cols glyph ids
+//   CAPTURE_DELTA  count cells of row, col, glyph id
+//   CAPTURE_TEXT   count bytes of a full-screen message
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include "compositor.h"
+
+#define CAPTURE_MAGIC 0x50414356u // "VCAP"
+#define CAPTURE_BLOCK_MAGIC 0x4b424356u // "VCBK"
+#define CAPTURE_INDEX_MAGIC 0x58494356u // "VCIX"
+#define CAPTURE_VERSION 1
+#define CAPTURE_RING_SIZE (4u << 20) // Bytes between the render thread and the encoder
+#define CAPTURE_BLOCK_FRAMES 240 // Frames per block, i.e. per keyframe
+#define CAPTURE_BLOCK_RAW (512 * 1024) // Uncompressed bytes per block, at most
+#define CAPTURE_POLL_US 20000 // Encoder wakeup interval
+#define CAPTURE_MAX_BLOCKS 65536
+#define CAPTURE_LOG_FILE "capture.log"
+#define CAPTURE_HASH_BITS 13 // Compressor match table size
+
+enum { CAPTURE_KEY = 1, CAPTURE_DELTA = 2, CAPTURE_TEXT = 3 };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char game[16];
+    int64_t started; // Unix time
+} CaptureHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t raw_size;
+    uint32_t packed_size;
+    uint32_t frames;
+    uint32_t start_ms; // Time of the block's keyframe
+    uint32_t end_ms; // Time of its last frame
+} CaptureBlock;
+
+typedef struct {
+    uint64_t offset; // Of the CaptureBlock header
+    uint32_t start_ms, end_ms;
+} CaptureIndex;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t index_offset;
+} CaptureTrailer;
+
+typedef struct {
+    uint32_t time_ms; // Since the capture started
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t count; // Cells for a delta, bytes for text
+} CaptureFrame;
+
+typedef struct { // Ring record header; the payload is laid out as in a block
+    uint32_t len; // Payload bytes following the record
+    CaptureFrame frame;
+} CaptureRecord;
+
+typedef struct {
+    char game[16];
+    FILE *file;
+    unsigned char *ring; // CAPTURE_RING_SIZE bytes
+    _Atomic uint64_t head, tail; // Bytes produced and consumed
+    long long start_ns;
+    int need_keyframe; // Render side: a frame was dropped
+    pthread_t encoder;
+    atomic_int running;
+
+    // Render side accounting
+    long frames, dropped;
+    long long hook_ns;
+
+    // Encoder side
+    uint8_t screen[COMP_MAX_ROWS][COMP_MAX_COLS];
+    int rows, cols, have_screen;
+    char text[COMP_OUT_SIZE]; // Message on screen, if text_len
+    size_t text_len;
+    unsigned char *raw; // The block being built
+    size_t raw_len;
+    uint32_t block_frames, block_start_ms, block_end_ms;
+    unsigned char *packed;
+    CaptureIndex *index;
+    uint32_t blocks;
+    uint64_t offset, raw_total, packed_total;
+} Capture;
+
+static Capture capture;
+
+static inline size_t capture_pack_bound(size_t n) { // Worst case size of capture_pack() output
+    return n + n / 255 + 16;
+}
+
+static inline uint32_t capture_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline size_t capture_put_length(unsigned char *out, size_t len) { // Extra length bytes after a 15 in a token nibble
+    size_t n = 0;
+    while (len >= 255) {
+        out[n++] = 255;
+        len -= 255;
+    }
+    out[n++] = (unsigned char)len;
+    return n;
+}
+
+static inline size_t capture_pack(const unsigned char *src, size_t n, unsigned char *dst) { // LZ77 with 4-byte minimum matches; returns bytes written
+    static uint32_t table[1 << CAPTURE_HASH_BITS]; // Position + 1 of the last occurrence of a hash; encoder thread only
+    memset(table, 0, sizeof(table));
+    size_t ip = 0, anchor = 0, op = 0;
+
+    while (ip + 4 <= n) {
+        uint32_t seq = capture_read32(src + ip);
+        uint32_t h = (seq * 2654435761u) >> (32 - CAPTURE_HASH_BITS);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)ip + 1;
+        if (!candidate || ip - (candidate - 1) > 65535 || capture_read32(src + candidate - 1) != seq) {
+            ip++;
+            continue;
+        }
+
+        size_t ref = candidate - 1, len = 4;
+        while (ip + len < n && src[ref + len] == src[ip + len]) len++;
+
+        size_t literals = ip - anchor;
+        unsigned char *token = &dst[op++];
+        *token = (unsigned char)((literals < 15 ? literals : 15) << 4 | (len - 4 < 15 ? len - 4 : 15));
+        if (literals >= 15) op += capture_put_length(dst + op, literals - 15);
+        memcpy(dst + op, src + anchor, literals);
+        op += literals;
+        dst[op++] = (unsigned char)((ip - ref) & 0xff);
+        dst[op++] = (unsigned char)((ip - ref) >> 8);
+        if (len - 4 >= 15) op += capture_put_length(dst + op, len - 4 - 15);
+
+        ip += len;
+        anchor = ip;
+    }
+
+    size_t literals = n - anchor; // Last sequence: literals only
+    dst[op++] = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) op += capture_put_length(dst + op, literals - 15);
+    memcpy(dst + op, src + anchor, literals);
+    return op + literals;
+}
+
+static inline long capture_unpack(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) { // Inverse of capture_pack(); bytes produced, -1 if src is damaged
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        unsigned char token = src[ip++];
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned char b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > n - ip || literals > cap - op) return -1;
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == n) break; // The last sequence has no match
+
+        if (n - ip < 2) return -1;
+        size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        size_t len = (token & 15) + 4;
+        if ((token & 15) == 15) {
+            unsigned char b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        if (offset == 0 || offset > op || len > cap - op) return -1;
+        for (size_t k = 0; k < len; k++, op++) dst[op] = dst[op - offset]; // Byte by byte: matches may overlap
+    }
+    return (long)op;
+}
+
+static inline long long capture_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void capture_ring_copy(uint64_t pos, const void *src, size_t len) { // Copy into the ring, wrapping at the end
+    size_t at = pos % CAPTURE_RING_SIZE;
+    size_t first = len < CAPTURE_RING_SIZE - at ? len : CAPTURE_RING_SIZE - at;
+    memcpy(capture.ring + at, src, first);
+    memcpy(capture.ring, (const char *)src + first, len - first);
+}
+
+static inline void capture_ring_read(uint64_t pos, void *dst, size_t len) { // Copy out of the ring, wrapping at the end
+    size_t at = pos % CAPTURE_RING_SIZE;
+    size_t first = len < CAPTURE_RING_SIZE - at ? len : CAPTURE_RING_SIZE - at;
+    memcpy(dst, capture.ring + at, first);
+    memcpy((char *)dst + first, capture.ring, len - first);
+}
+
+static inline void capture_frame(int keyframe, const char *text) { // Compositor capture hook, on the render thread
+    Capture *cap = &capture;
+    const Compositor *c = &compositor;
+    long long start = capture_now_ns();
+
+    CaptureRecord record;
+    memset(&record, 0, sizeof(record));
+    record.frame.time_ms = (uint32_t)((start - cap->start_ns) / 1000000);
+    if (text) {
+        size_t len = strlen(text);
+        record.frame.type = CAPTURE_TEXT;
+        record.frame.count = (uint16_t)(len < 65535 ? len : 65535);
+        record.len = record.frame.count;
+    } else if (keyframe || cap->need_keyframe) {
+        record.frame.type = CAPTURE_KEY;
+        record.len = 2 + (uint32_t)(c->rows * c->cols);
+    } else {
+        record.frame.type = CAPTURE_DELTA;
+        record.frame.count = (uint16_t)c->changed_count;
+        record.len = 3u * (uint32_t)c->changed_count;
+    }
+
+    uint64_t head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&cap->tail, memory_order_acquire);
+    size_t need = sizeof(record) + record.len;
+    cap->frames++;
+    if (need > CAPTURE_RING_SIZE - (head - tail)) { // Encoder is behind: drop, and restart from a keyframe
+        cap->dropped++;
+        cap->need_keyframe = 1;
+        return;
+    }
+
+    capture_ring_copy(head, &record, sizeof(record));
+    uint64_t pos = head + sizeof(record);
+    if (record.frame.type == CAPTURE_TEXT) {
+        capture_ring_copy(pos, text, record.len);
+    } else if (record.frame.type == CAPTURE_KEY) {
+        uint8_t size[2] = { (uint8_t)c->rows, (uint8_t)c->cols };
+        capture_ring_copy(pos, size, 2);
+        pos += 2;
+        for (int r = 0; r < c->rows; r++) {
+            uint8_t row[COMP_MAX_COLS];
+            for (int col = 0; col < c->cols; col++) row[col] = (uint8_t)c->shown[r][col];
+            capture_ring_copy(pos, row, (size_t)c->cols);
+            pos += (size_t)c->cols;
+        }
+        cap->need_keyframe = 0;
+    } else {
+        uint8_t cells[3 * 64];
+        int n = 0;
+        for (int i = 0; i < c->changed_count; i++) {
+            Cell cell = c->changed[i];
+            cells[n++] = (uint8_t)cell.row;
+            cells[n++] = (uint8_t)cell.col;
+            cells[n++] = (uint8_t)c->shown[cell.row][cell.col];
+            if (n == (int)sizeof(cells) || i == c->changed_count - 1) {
+                capture_ring_copy(pos, cells, (size_t)n);
+                pos += (size_t)n;
+                n = 0;
+            }
+        }
+    }
+    atomic_store_explicit(&cap->head, head + need, memory_order_release);
+    cap->hook_ns += capture_now_ns() - start;
+}
+
+static inline void capture_block_append(const void *bytes, size_t len) {
+    memcpy(capture.raw + capture.raw_len, bytes, len);
+    capture.raw_len += len;
+}
+
+static inline void capture_block_key(uint32_t time_ms) { // Open a block with the encoder's copy of the screen
+    Capture *cap = &capture;
+    CaptureFrame frame = { time_ms, CAPTURE_KEY, 0, 0 };
+    uint8_t size[2] = { (uint8_t)cap->rows, (uint8_t)cap->cols };
+    capture_block_append(&frame, sizeof(frame));
+    capture_block_append(size, 2);
+    for (int r = 0; r < cap->rows; r++) capture_block_append(cap->screen[r], (size_t)cap->cols);
+    if (cap->text_len) { // A message was showing over the board
+        CaptureFrame message = { time_ms, CAPTURE_TEXT, 0, (uint16_t)cap->text_len };
+        capture_block_append(&message, sizeof(message));
+        capture_block_append(cap->text, cap->text_len);
+    }
+    cap->block_frames = 1;
+    cap->block_start_ms = cap->block_end_ms = time_ms;
+}
+
+static inline void capture_block_flush() { // Compress the block being built and write it out
+    Capture *cap = &capture;
+    if (!cap->raw_len) return;
+
+    CaptureBlock block = { CAPTURE_BLOCK_MAGIC, (uint32_t)cap->raw_len, 0, cap->block_frames,
+                           cap->block_start_ms, cap->block_end_ms };
+    block.packed_size = (uint32_t)capture_pack(cap->raw, cap->raw_len, cap->packed);
+    if (cap->blocks < CAPTURE_MAX_BLOCKS) {
+        cap->index[cap->blocks++] = (CaptureIndex){ cap->offset, block.start_ms, block.end_ms };
+    }
+    fwrite(&block, sizeof(block), 1, cap->file);
+    fwrite(cap->packed, 1, block.packed_size, cap->file);
+    cap->offset += sizeof(block) + block.packed_size;
+    cap->raw_total += block.raw_size;
+    cap->packed_total += block.packed_size;
+    cap->raw_len = 0;
+}
+
+static inline void capture_encode(const CaptureRecord *record, const unsigned char *payload) { // Apply one frame to the screen copy and add it to the block
+    Capture *cap = &capture;
+    const CaptureFrame *frame = &record->frame;
+
+    if (frame->type == CAPTURE_KEY) {
+        cap->rows = payload[0];
+        cap->cols = payload[1];
+        for (int r = 0; r < cap->rows; r++) memcpy(cap->screen[r], payload + 2 + r * cap->cols, (size_t)cap->cols);
+        cap->have_screen = 1;
+        cap->text_len = 0;
+    } else if (frame->type == CAPTURE_DELTA) {
+        for (uint32_t i = 0; i < frame->count; i++) {
+            const unsigned char *cell = payload + 3 * i;
+            if (cell[0] < COMP_MAX_ROWS && cell[1] < COMP_MAX_COLS) cap->screen[cell[0]][cell[1]] = cell[2];
+        }
+        cap->text_len = 0;
+    } else {
+        memcpy(cap->text, payload, record->len < sizeof(cap->text) ? record->len : sizeof(cap->text));
+        cap->text_len = record->len < sizeof(cap->text) ? record->len : sizeof(cap->text);
+    }
+    if (!cap->have_screen) return; // Nothing to base deltas on yet
+
+    if (cap->raw_len && (frame->type == CAPTURE_KEY || cap->block_frames >= CAPTURE_BLOCK_FRAMES ||
+                         cap->raw_len + sizeof(CaptureFrame) + record->len > CAPTURE_BLOCK_RAW)) {
+        capture_block_flush(); // Keyframes from the game start a block of their own
+    }
+    if (!cap->raw_len) {
+        capture_block_key(frame->time_ms); // Already shows this frame
+        return;
+    }
+    capture_block_append(frame, sizeof(*frame));
+    capture_block_append(payload, record->len);
+    cap->block_frames++;
+    cap->block_end_ms = frame->time_ms;
+}
+
+static inline void capture_drain() { // Encode everything the render thread has queued
+    Capture *cap = &capture;
+    static unsigned char payload[CAPTURE_RING_SIZE / 2];
+    uint64_t tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&cap->head, memory_order_acquire);
+
+    while (tail < head) {
+        CaptureRecord record;
+        capture_ring_read(tail, &record, sizeof(record));
+        if (record.len <= sizeof(payload)) {
+            capture_ring_read(tail + sizeof(record), payload, record.len);
+            capture_encode(&record, payload);
+        }
+        tail += sizeof(record) + record.len;
+    }
+    atomic_store_explicit(&cap->tail, tail, memory_order_release);
+}
+
+static inline void *capture_encoder(void *arg) { // Drain the ring until capture_stop()
+    (void)arg;
+    while (atomic_load(&capture.running)) {
+        capture_drain();
+        usleep(CAPTURE_POLL_US);
+    }
+    capture_drain();
+    return NULL;
+}
+
+static inline void capture_stop() { // Encode what is left, write the index and log the session
+    Capture *cap = &capture;
+    if (!atomic_exchange(&cap->running, 0)) return;
+    compositor.capture = NULL;
+    pthread_join(cap->encoder, NULL);
+    capture_block_flush();
+
+    CaptureTrailer trailer = { CAPTURE_INDEX_MAGIC, cap->blocks, cap->offset };
+    fwrite(cap->index, sizeof(CaptureIndex), cap->blocks, cap->file);
+    fwrite(&trailer, sizeof(trailer), 1, cap->file);
+    fclose(cap->file);
+
+    FILE *log = fopen(CAPTURE_LOG_FILE, "a");
+    if (log) {
+        char when[32];
+        time_t now = time(NULL);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(log, "%s %s frames=%ld dropped=%ld blocks=%u raw=%lluB packed=%lluB ratio=%.1f hook_avg=%lldns\n",
+                when, cap->game, cap->frames, cap->dropped, cap->blocks,
+                (unsigned long long)cap->raw_total, (unsigned long long)cap->packed_total,
+                cap->packed_total ? (double)cap->raw_total / cap->packed_total : 0.0,
+                cap->frames ? cap->hook_ns / cap->frames : 0);
+        fclose(log);
+    }
+}
+
+static inline int capture_start(const char *game) { // Record every frame to capture-<game>-<time>.vcap
+    Capture *cap = &capture;
+    snprintf(cap->game, sizeof(cap->game), "%s", game);
+
+    char path[96], stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(path, sizeof(path), "capture-%s-%s.vcap", game, stamp);
+
+    cap->ring = malloc(CAPTURE_RING_SIZE);
+    cap->raw = malloc(CAPTURE_BLOCK_RAW);
+    cap->packed = malloc(capture_pack_bound(CAPTURE_BLOCK_RAW));
+    cap->index = malloc(CAPTURE_MAX_BLOCKS * sizeof(CaptureIndex));
+    cap->file = fopen(path, "wb");
+    if (!cap->ring || !cap->raw || !cap->packed || !cap->index || !cap->file) return -1;
+
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    snprintf(header.game, sizeof(header.game), "%s", game);
+    header.started = (int64_t)now;
+    fwrite(&header, sizeof(header), 1, cap->file);
+    cap->offset = sizeof(header);
+    cap->start_ns = capture_now_ns();
+    atomic_store(&cap->running, 1);
+
+    sigset_t all, old; // Signals must reach the game thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&cap->encoder, NULL, capture_encoder, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        atomic_store(&cap->running, 0);
+        return -1;
+    }
+
+    atexit(capture_stop);
+    compositor.capture = capture_frame;
+    return 0;
+}
+
+#endif
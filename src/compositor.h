@@ -0,0 +1,368 @@
+#ifndef VGC_COMPOSITOR_H
+#define VGC_COMPOSITOR_H
+
+// Layered terminal compositor used by the games' draw functions.
+//
+// A screen is a grid of glyph ids in two layers. The background layer holds
+// everything that never changes (board dots, borders, scenery); it is built
+// once, sealed, and its terminal encoding is cached so a full repaint is a
+// single memcpy. The sprite layer is rebuilt every frame from the snapshot.
+// comp_present() only visits cells that held a sprite in this or the previous
+// frame and emits the ones whose visible glyph changed, so static content
+// costs nothing per frame. Background cells that do change now and then (a
+// broken brick) go through comp_static_change(), which redraws just that cell
+// and re-encodes the cached repaint lazily. Glyph ids below GLYPH_EXTRA are plain ASCII; the
+// multi-byte UTF-8 glyphs the games use are pre-encoded in comp_extra_glyphs.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define COMP_MAX_ROWS 64
+#define COMP_MAX_COLS 160
+#define COMP_MAX_CELLS 4096 // Sprite cells per frame
+#define COMP_OUT_SIZE 65536
+#define GLYPH_NONE 0 // Transparent sprite cell
+#define GLYPH_EXTRA 128 // First id of the multi-byte glyphs
+
+typedef unsigned short Glyph;
+
+// Receives every chunk of bytes sent to the terminal; keyframe chunks repaint
+// the whole screen on their own
+typedef void (*CompTap)(const char *bytes, size_t len, int keyframe);
+
+// Sees every frame right after it was written, before the tap; text is set
+// for comp_present_text() frames, which do not show the layers
+typedef void (*CompCheck)(const char *bytes, size_t len, int keyframe, int text);
+
+// Sees every frame as cells rather than bytes: on a keyframe the whole of
+// shown, otherwise the changed list; text is set for comp_present_text()
+typedef void (*CompCapture)(int keyframe, const char *text);
+
+typedef struct {
+    unsigned char len;
+    char bytes[4];
+} GlyphCode;
+
+typedef struct {
+    short row, col;
+} Cell;
+
+static const char *const comp_extra_glyphs[] = {
+    "▓", "╔", "╗", "╚", "╝", "⋀",
+};
+
+#define COMP_GLYPH_COUNT (GLYPH_EXTRA + (int)(sizeof(comp_extra_glyphs) / sizeof(comp_extra_glyphs[0])))
+
+typedef struct {
+    int rows, cols;
+    GlyphCode glyphs[COMP_GLYPH_COUNT];
+
+    Glyph background[COMP_MAX_ROWS][COMP_MAX_COLS];
+    Glyph sprites[COMP_MAX_ROWS][COMP_MAX_COLS];
+    Glyph shown[COMP_MAX_ROWS][COMP_MAX_COLS]; // What the terminal currently displays
+
+    char static_bytes[COMP_OUT_SIZE]; // Cached encoding of a full background repaint
+    size_t static_len;
+    int valid; // 0 until the background has been sent since the last invalidate
+    int stale; // Background changed since static_bytes was encoded
+
+    Cell cells[2][COMP_MAX_CELLS]; // Sprite cells of the previous and the current frame
+    int cell_count[2];
+    int current;
+
+    char out[COMP_OUT_SIZE];
+    size_t out_len;
+    int cursor_row, cursor_col; // Where the terminal cursor is after out, -1 if unknown
+
+    int frame_writes; // write() calls the last frame took
+
+    Cell changed[2 * COMP_MAX_CELLS]; // Cells the last frame redrew, kept only with a capture hook
+    int changed_count;
+
+    CompTap tap;
+    CompCheck check;
+    CompCapture capture;
+} Compositor;
+
+static Compositor compositor;
+
+static inline Glyph comp_glyph(const char *utf8, int *consumed) { // Glyph id of the character at utf8
+    unsigned char c = (unsigned char)utf8[0];
+    if (c < 0x80) {
+        *consumed = 1;
+        return c;
+    }
+
+    for (int id = GLYPH_EXTRA; id < COMP_GLYPH_COUNT; id++) {
+        const GlyphCode *code = &compositor.glyphs[id];
+        if (memcmp(utf8, code->bytes, code->len) == 0) {
+            *consumed = code->len;
+            return (Glyph)id;
+        }
+    }
+
+    *consumed = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1;
+    return '?';
+}
+
+static inline void comp_init(int rows, int cols) { // Set the screen size and build the glyph table
+    Compositor *c = &compositor;
+    c->rows = rows < COMP_MAX_ROWS ? rows : COMP_MAX_ROWS;
+    c->cols = cols < COMP_MAX_COLS ? cols : COMP_MAX_COLS;
+
+    memset(c->glyphs, 0, sizeof(c->glyphs));
+    for (int id = 1; id < GLYPH_EXTRA; id++) {
+        c->glyphs[id].len = 1;
+        c->glyphs[id].bytes[0] = (char)id;
+    }
+    for (int id = GLYPH_EXTRA; id < COMP_GLYPH_COUNT; id++) {
+        const char *utf8 = comp_extra_glyphs[id - GLYPH_EXTRA];
+        c->glyphs[id].len = (unsigned char)strlen(utf8);
+        memcpy(c->glyphs[id].bytes, utf8, c->glyphs[id].len);
+    }
+
+    for (int r = 0; r < COMP_MAX_ROWS; r++) {
+        for (int col = 0; col < COMP_MAX_COLS; col++) {
+            c->background[r][col] = ' ';
+        }
+    }
+    memset(c->sprites, 0, sizeof(c->sprites));
+    c->cell_count[0] = c->cell_count[1] = 0;
+    c->current = 0;
+    c->valid = 0;
+}
+
+static inline void comp_static_put(int row, int col, Glyph glyph) { // Set one background cell
+    if (row < 0 || row >= compositor.rows || col < 0 || col >= compositor.cols) return;
+    compositor.background[row][col] = glyph;
+}
+
+static inline void comp_static_text(int row, int col, const char *utf8) { // Write UTF-8 text into the background
+    int consumed;
+    while (*utf8) {
+        comp_static_put(row, col++, comp_glyph(utf8, &consumed));
+        utf8 += consumed;
+    }
+}
+
+static inline void comp_append(const char *bytes, size_t len) { // Append raw bytes to the output buffer
+    Compositor *c = &compositor;
+    if (c->out_len + len > sizeof(c->out)) return;
+    memcpy(c->out + c->out_len, bytes, len);
+    c->out_len += len;
+}
+
+static inline void comp_append_int(int value) { // Append a non-negative decimal number
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0) {
+        comp_append(&digits[--n], 1);
+    }
+}
+
+static inline void comp_encode_static() { // Encode a full background repaint into static_bytes
+    Compositor *c = &compositor;
+
+    c->out_len = 0;
+    comp_append("\033[H\033[J", 6);
+    for (int r = 0; r < c->rows; r++) {
+        int end = c->cols;
+        while (end > 0 && c->background[r][end - 1] == ' ') {
+            end--; // The screen was just cleared, trailing blanks come for free
+        }
+        for (int col = 0; col < end; col++) {
+            const GlyphCode *code = &c->glyphs[c->background[r][col]];
+            comp_append(code->bytes, code->len);
+        }
+        if (r < c->rows - 1) comp_append("\n", 1);
+    }
+
+    memcpy(c->static_bytes, c->out, c->out_len);
+    c->static_len = c->out_len;
+    c->out_len = 0;
+    c->stale = 0;
+}
+
+static inline void comp_seal() { // Encode the finished background once and cache it
+    comp_encode_static();
+    compositor.valid = 0;
+}
+
+static inline void comp_invalidate() { // Someone else drew on the screen; repaint the background next time
+    compositor.valid = 0;
+}
+
+static inline void comp_begin() { // Start a new frame with an empty sprite layer
+    Compositor *c = &compositor;
+
+    for (int i = 0; i < c->cell_count[c->current]; i++) { // The previous frame's cells stay listed for comp_present()
+        Cell cell = c->cells[c->current][i];
+        c->sprites[cell.row][cell.col] = GLYPH_NONE;
+    }
+    c->current ^= 1;
+    c->cell_count[c->current] = 0;
+}
+
+static inline void comp_put(int row, int col, Glyph glyph) { // Place a sprite glyph for this frame
+    Compositor *c = &compositor;
+    if (row < 0 || row >= c->rows || col < 0 || col >= c->cols || glyph == GLYPH_NONE) return;
+
+    if (c->sprites[row][col] == GLYPH_NONE) {
+        if (c->cell_count[c->current] >= COMP_MAX_CELLS) return;
+        c->cells[c->current][c->cell_count[c->current]++] = (Cell){ (short)row, (short)col };
+    }
+    c->sprites[row][col] = glyph;
+}
+
+static inline void comp_static_change(int row, int col, Glyph glyph) { // Change a background cell during a frame
+    Compositor *c = &compositor;
+    if (row < 0 || row >= c->rows || col < 0 || col >= c->cols || c->background[row][col] == glyph) return;
+
+    c->background[row][col] = glyph;
+    c->stale = 1;
+    if (c->sprites[row][col] == GLYPH_NONE && c->cell_count[c->current] < COMP_MAX_CELLS) {
+        c->cells[c->current][c->cell_count[c->current]++] = (Cell){ (short)row, (short)col }; // Visited by comp_present()
+    }
+}
+
+static inline void comp_text(int row, int col, const char *utf8) { // Place sprite text; '\n' continues below
+    int consumed, start = col;
+    while (*utf8) {
+        if (*utf8 == '\n') {
+            row++;
+            col = start;
+            utf8++;
+            continue;
+        }
+        comp_put(row, col++, comp_glyph(utf8, &consumed));
+        utf8 += consumed;
+    }
+}
+
+static inline void comp_printf(int row, int col, const char *fmt, ...) { // Formatted sprite text
+    char text[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+    comp_text(row, col, text);
+}
+
+static inline void comp_emit_cell(int row, int col, Glyph glyph) { // Append the bytes that draw one cell
+    Compositor *c = &compositor;
+
+    if (row != c->cursor_row || col != c->cursor_col) {
+        comp_append("\033[", 2);
+        comp_append_int(row + 1);
+        comp_append(";", 1);
+        comp_append_int(col + 1);
+        comp_append("H", 1);
+    }
+    const GlyphCode *code = &c->glyphs[glyph];
+    comp_append(code->bytes, code->len);
+
+    c->cursor_row = row;
+    c->cursor_col = col + 1;
+}
+
+static inline void comp_update_cell(int row, int col) { // Emit a cell if its visible glyph changed
+    Compositor *c = &compositor;
+    Glyph want = c->sprites[row][col] != GLYPH_NONE ? c->sprites[row][col] : c->background[row][col];
+    if (c->shown[row][col] == want) return;
+
+    comp_emit_cell(row, col, want);
+    c->shown[row][col] = want;
+    if (c->capture) c->changed[c->changed_count++] = (Cell){ (short)row, (short)col };
+}
+
+static inline void comp_park_cursor() { // Move the cursor below the screen
+    comp_append("\033[", 2);
+    comp_append_int(compositor.rows + 1);
+    comp_append(";1H", 3);
+}
+
+static inline void comp_write() { // Send the output buffer to the terminal, counting write() calls
+    TRACE_SCOPE("flush");
+    Compositor *c = &compositor;
+    size_t done = 0;
+
+    fflush(stdout); // Anything printed through stdio goes first
+    c->frame_writes = 0;
+    while (done < c->out_len) {
+        ssize_t n = write(STDOUT_FILENO, c->out + done, c->out_len - done);
+        c->frame_writes++;
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+}
+
+static inline void comp_present() { // Send this frame's changes to the terminal in one write
+    Compositor *c = &compositor;
+    int keyframe = !c->valid;
+    if (keyframe && c->stale) comp_encode_static();
+    c->out_len = 0;
+
+    if (keyframe) {
+        comp_append(c->static_bytes, c->static_len);
+        memcpy(c->shown, c->background, sizeof(c->shown));
+        c->valid = 1;
+    }
+    c->cursor_row = -1;
+    c->changed_count = 0;
+
+    for (int list = 0; list < 2; list++) {
+        for (int i = 0; i < c->cell_count[list]; i++) {
+            comp_update_cell(c->cells[list][i].row, c->cells[list][i].col);
+        }
+    }
+
+    comp_park_cursor();
+
+    comp_write();
+    if (c->check) c->check(c->out, c->out_len, keyframe, 0);
+    if (c->tap) c->tap(c->out, c->out_len, keyframe);
+    if (c->capture) c->capture(keyframe, NULL);
+}
+
+static inline void comp_present_text(const char *text) { // Replace the whole screen with a text message
+    Compositor *c = &compositor;
+
+    c->out_len = 0;
+    comp_append("\033[H\033[J", 6);
+    comp_append(text, strlen(text));
+    comp_write();
+    if (c->check) c->check(c->out, c->out_len, 1, 1);
+    if (c->tap) c->tap(c->out, c->out_len, 1);
+    if (c->capture) c->capture(1, text);
+    c->valid = 0; // The board has to be repainted after the message
+}
+
+static inline const char *comp_keyframe(size_t *len) { // Encode the screen as shown into a self-contained repaint
+    Compositor *c = &compositor;
+
+    if (c->stale) comp_encode_static();
+    c->out_len = 0;
+    comp_append(c->static_bytes, c->static_len);
+    c->cursor_row = -1;
+    for (int i = 0; i < c->cell_count[c->current]; i++) {
+        Cell cell = c->cells[c->current][i];
+        if (c->shown[cell.row][cell.col] != c->background[cell.row][cell.col]) {
+            comp_emit_cell(cell.row, cell.col, c->shown[cell.row][cell.col]);
+        }
+    }
+    comp_park_cursor();
+
+    *len = c->out_len;
+    return c->out;
+}
+
+#endif
@@ -1,19 +1,46 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
-#include <sys/time.h>
 #include <signal.h>
 #include <ctype.h>
+#include <stdint.h>
+#include "hiscore.h"
+#include "savestate.h"
+#include "framecheck.h"
+#include "capture.h"
+#include "render.h"
+#include "compositor.h"
+#include "spectate.h"
+#include "input.h"
+#include "realtime.h"
+#include "tournament.h"
+#include "session.h"
+#include "trace.h"
 
 #define GAME_WIDTH 60
 #define GAME_HEIGHT 8
-#define MAX_OBSTACLES 100
+#define CHUNK_WIDTH 64 // World columns per generated course chunk
+#define CHUNK_RING 4 // Chunks kept alive: the one behind the camera, the screen and lookahead
+#define CHUNK_MAX_OBSTACLES 4
+#define MIN_OBSTACLE_GAP 50 // Columns between obstacles, one second at the start speed
+#define SPEED_ONE 256 // Camera speed is fixed point, SPEED_ONE is one column per frame
+#define SPEED_RAMP 6 // Speed gained per obstacle passed, in 1/256 columns per frame
+#define MAX_SPEED (4 * SPEED_ONE)
+#define SAVE_VERSION 1 // Bump when GameState changes
+#define FRAME_BYTE_BUDGET 512 // --check-frames: most bytes a delta frame may take
+#define FRAME_WRITE_BUDGET 1 // Most write() calls a delta frame may take
 #define MAX_JUMP_HEIGHT 4 // Increased jump height
+#define SKY_ROWS 6 // Decorative lines above the game area
+#define FRAME_TIME_US 20000 // 20 ms per frame (50 FPS)
+#define TOURNAMENT_MAX_TICKS 100000 // Default --max-ticks for a tournament game, in frames
+#define JUMP_LEAD 13 // Frames ahead the "jump" policy aims to jump by default
+#define JUMP_JITTER 2 // The "jump" policy's lead varies by the sum of four draws of up to this many frames either way
 void disable_raw_mode();
-int temporary = 1;
+_Thread_local int temporary = 1;
 
 struct termios orig_termios;
 int selected_button = 0; // 0: Play, 1: Exit
@@ -24,38 +51,108 @@ typedef enum {
     DESCENDING
 } JumpState;
 
+// A fixed-size stretch of course; obstacle positions are world columns
+typedef struct {
+    long long index; // Chunk covers world columns [index * CHUNK_WIDTH, (index + 1) * CHUNK_WIDTH)
+    int obstacle_count;
+    long long obstacles[CHUNK_MAX_OBSTACLES];
+} Chunk;
+
 // Struct to manage game state
+// Obstacles never move: the camera scrolls over a course that is generated
+// ahead of it chunk by chunk from a seeded generator. Chunks behind the camera
+// are recycled, so a run of any length uses the same memory and work per frame.
 typedef struct {
     int dino_pos;
     JumpState jump_state;
-    int obstacles[MAX_OBSTACLES][3]; // [x_pos, width, height]
-    int obstacle_count;
     int score;
-    time_t last_obstacle_time;
     int jump_frame_counter;
+
+    long long camera; // World column at the left edge of the screen, times SPEED_ONE
+    int speed; // Columns per frame, times SPEED_ONE
+    int step; // Whole columns scrolled by the last frame
+    uint64_t seed; // Seed the course was generated from
+    uint64_t rng; // Course generator state
+    long long next_obstacle; // World column of the next obstacle to place
+    long long next_chunk; // Index of the next chunk to generate
+    Chunk chunks[CHUNK_RING]; // Chunk i lives in slot i % CHUNK_RING
 } GameState;
 
-// Function to get current time in milliseconds
-long long get_milliseconds() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
+typedef struct { // Snapshot of everything render() needs
+    GameState game;
+    char message[128]; // Printed below the score when not empty
+} DinoFrame;
+
+// Function to draw the next number from the course generator (xorshift64*)
+uint64_t course_random(GameState *game) {
+    game->rng ^= game->rng >> 12;
+    game->rng ^= game->rng << 25;
+    game->rng ^= game->rng >> 27;
+    return game->rng * 0x2545F4914F6CDD1DULL;
+}
+
+// Function to pick the distance to the next obstacle
+// Same spacing as the old per-frame spawning: a one second cooldown, then a
+// 25% chance per frame, placed up to 18 columns beyond the spawn point.
+// Stretched with the speed so there is always time to land between jumps.
+int obstacle_gap(GameState *game) {
+    int gap = MIN_OBSTACLE_GAP;
+    while (course_random(game) % 4 != 0) {
+        gap++;
+    }
+    gap += 2 * (int)(course_random(game) % 10);
+    return gap * game->speed / SPEED_ONE;
+}
+
+// Function to generate the next chunk of course into its ring slot
+void generate_chunk(GameState *game) {
+    Chunk *chunk = &game->chunks[game->next_chunk % CHUNK_RING];
+    long long end = (game->next_chunk + 1) * CHUNK_WIDTH;
+
+    chunk->index = game->next_chunk;
+    chunk->obstacle_count = 0;
+    while (game->next_obstacle < end && chunk->obstacle_count < CHUNK_MAX_OBSTACLES) {
+        chunk->obstacles[chunk->obstacle_count++] = game->next_obstacle;
+        game->next_obstacle += obstacle_gap(game);
+    }
+    game->next_chunk++;
+}
+
+_Thread_local Session session; // Holds the GameState, carved again for every run
+
+// Function to rewind the session and carve a fresh GameState from it
+GameState *start_session() {
+    if (!session.base && session_open(&session, sizeof(GameState)) != 0) {
+        perror("Failed to allocate the game state");
+        exit(EXIT_FAILURE);
+    }
+    session_reset(&session);
+    return session_alloc(&session, sizeof(GameState));
 }
 
 // Function to initialize game state
-void init_game(GameState *game) {
+void init_game(GameState *game, uint64_t seed) {
     game->dino_pos = 0;
     game->jump_state = GROUNDED;
-    game->obstacle_count = 0;
     game->score = 0;
-    game->last_obstacle_time = 0;
     game->jump_frame_counter = 0;
-}
-
 
+    game->camera = 0;
+    game->speed = SPEED_ONE;
+    game->step = 0;
+    game->seed = seed;
+    game->rng = seed ? seed : 1; // xorshift must not start at zero
+    game->next_chunk = 0;
+    for (int i = 0; i < CHUNK_RING; i++) {
+        game->chunks[i].index = -1;
+        game->chunks[i].obstacle_count = 0;
+    }
+    game->next_obstacle = GAME_WIDTH + obstacle_gap(game) - MIN_OBSTACLE_GAP;
+}
 
 // Function to manage dinosaur jump
 void manage_jump(GameState *game) {
+    TRACE_SCOPE("manage_jump");
     switch (game->jump_state) {
         case GROUNDED:
             // Do nothing
@@ -110,58 +207,68 @@ void start_jump(GameState *game) {
     }
 }
 
-// Function to generate obstacles with controlled frequency
+// Function to generate obstacles: keep the course generated a chunk ahead of the screen
 void generate_obstacle(GameState *game) {
-    time_t current_time = time(NULL);
-
-    // Ensure at least 2 seconds between obstacle generations
-    if (difftime(current_time, game->last_obstacle_time) < 1) {
-        return;
-    }
-
-    // Random chance of generating an obstacle
-    if (rand() % 4 == 0 && game->obstacle_count < MAX_OBSTACLES ) { // 25% chance
-        game->obstacles[game->obstacle_count][0] = GAME_WIDTH + 2*(rand() % 10); // Random start position slightly beyond screen
-        game->obstacle_count++;
-        game->last_obstacle_time = current_time;
+    TRACE_SCOPE("generate_obstacle");
+    long long horizon = game->camera / SPEED_ONE + GAME_WIDTH + CHUNK_WIDTH;
+    while (game->next_chunk * CHUNK_WIDTH < horizon) {
+        generate_chunk(game);
     }
 }
 
-// Function to move obstacles
+// Function to move obstacles: scroll the camera and score what it passed
 void move_obstacles(GameState *game) {
-    for (int i = 0; i < game->obstacle_count; i++) {
-        game->obstacles[i][0]--;
-
-        // Remove obstacles that have moved off screen
-        if (game->obstacles[i][0] < 0) {
-            for (int j = i; j < game->obstacle_count - 1; j++) {
-                game->obstacles[j][0] = game->obstacles[j+1][0];
-                game->obstacles[j][1] = game->obstacles[j+1][1];
-                game->obstacles[j][2] = game->obstacles[j+1][2];
+    TRACE_SCOPE("move_obstacles");
+    long long before = game->camera / SPEED_ONE;
+    game->camera += game->speed;
+    long long after = game->camera / SPEED_ONE;
+    game->step = (int)(after - before);
+
+    // Obstacles that left the screen this frame
+    for (int c = 0; c < CHUNK_RING; c++) {
+        const Chunk *chunk = &game->chunks[c];
+        for (int i = 0; i < chunk->obstacle_count; i++) {
+            if (chunk->obstacles[i] >= before && chunk->obstacles[i] < after) {
+                game->score++;
             }
-            game->obstacle_count--;
-            i--;
-            game->score++;
         }
     }
+
+    game->speed = SPEED_ONE + game->score * SPEED_RAMP;
+    if (game->speed > MAX_SPEED) game->speed = MAX_SPEED;
 }
 
 // Function to check collision
 int check_collision(GameState *game) {
-    for (int i = 0; i < game->obstacle_count; i++) {
-        // More precise collision detection for 2x2 dinosaur and 2-height obstacles
-        if (game->obstacles[i][0] < 5 && game->obstacles[i][0] > 0 && 
-            game->dino_pos < 2) {
-            return 1;  // Collision detected
+    TRACE_SCOPE("check_collision");
+    if (game->dino_pos >= 2) return 0;
+
+    long long left = game->camera / SPEED_ONE;
+    for (int c = 0; c < CHUNK_RING; c++) {
+        const Chunk *chunk = &game->chunks[c];
+        for (int i = 0; i < chunk->obstacle_count; i++) {
+            // More precise collision detection for 2x2 dinosaur and 2-height obstacles;
+            // at high speed also catch obstacles that swept past the dinosaur in one frame
+            long long x = chunk->obstacles[i] - left;
+            if (x < 5 && x + game->step - 1 > 0) {
+                return 1;  // Collision detected
+            }
         }
     }
     return 0;
 }
 
-// Function to render game state
-void render(GameState *game) {
-    // Clear the screen
-    printf("\033[H\033[J");
+// Function to hand the current state to the render thread
+void publish_frame(const GameState *game, const char *message) {
+    TRACE_SCOPE("publish_frame");
+    DinoFrame *frame = render_frame();
+    frame->game = *game;
+    snprintf(frame->message, sizeof(frame->message), "%s", message);
+    render_publish();
+}
+
+// Function to build the static layers: sky decoration, empty game area and ground
+void setup_screen() {
     // Add decorative stars at the top
     const char *decorative_lines[] = {
         "                                                ",
@@ -171,74 +278,158 @@ void render(GameState *game) {
         "     ~ ~ ~ ~ ~ ~ ~ ~   ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~  ",
         "          ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~ ~    ",
     };
+    int consumed;
 
-    for (int i = 0; i < 6; i++) { // Print the first 6 decorative lines
-        printf("%s\n", decorative_lines[i]);
+    comp_init(SKY_ROWS + GAME_HEIGHT + 5, GAME_WIDTH);
+    for (int i = 0; i < SKY_ROWS; i++) {
+        comp_static_text(i, 0, decorative_lines[i]);
     }
 
-    // Render game area
-    for (int y = 0; y < GAME_HEIGHT; y++) {
-        for (int x = 0; x < GAME_WIDTH; x++) {
-            int render_dino = 0;
-            int render_obstacle_top = 0;
-            int render_obstacle_bottom = 0;
-
-            // Check for dinosaur rendering
-            if (x == 3 || x == 4) {
-                if (y == GAME_HEIGHT - 3 - game->dino_pos) { // Head
-                    printf(" O");
-                    render_dino = 1;
-                } else if (y == GAME_HEIGHT - 2 - game->dino_pos) { // Arms
-                    printf(" |");
-                    render_dino = 1;
-                } else if (y == GAME_HEIGHT - 1 - game->dino_pos) { // Legs
-                    printf(" ⋀");
-                    render_dino = 1;
-                }
+    // Render the ground
+    Glyph ground = comp_glyph("▓", &consumed);
+    for (int x = 0; x < GAME_WIDTH; x++) {
+        comp_static_put(SKY_ROWS + GAME_HEIGHT, x, ground);
+    }
+    comp_seal();
+}
+
+// Function to render a game state snapshot
+void render(const void *data) {
+    TRACE_SCOPE("render");
+    const DinoFrame *frame = data;
+    const GameState *game = &frame->game;
+
+    comp_begin();
+
+    // Dinosaur: head, arms and legs
+    comp_text(SKY_ROWS + GAME_HEIGHT - 3 - game->dino_pos, 4, "O");
+    comp_text(SKY_ROWS + GAME_HEIGHT - 2 - game->dino_pos, 4, "|");
+    comp_text(SKY_ROWS + GAME_HEIGHT - 1 - game->dino_pos, 4, "⋀");
+
+    // Obstacles, from world to screen columns
+    long long left = game->camera / SPEED_ONE;
+    for (int c = 0; c < CHUNK_RING; c++) {
+        const Chunk *chunk = &game->chunks[c];
+        for (int i = 0; i < chunk->obstacle_count; i++) {
+            long long obstacle_x = chunk->obstacles[i] - left;
+            if (obstacle_x >= 0 && obstacle_x < GAME_WIDTH) {
+                comp_text(SKY_ROWS + GAME_HEIGHT - 2, (int)obstacle_x, "╔╗");
+                comp_text(SKY_ROWS + GAME_HEIGHT - 1, (int)obstacle_x, "╚╝");
             }
+        }
+    }
 
-            if (temporary==0){
+    // Display score and jump state
+    comp_printf(SKY_ROWS + GAME_HEIGHT + 1, 0, "Score: %d   FPS: %d", game->score, render_fps());
+    comp_text(SKY_ROWS + GAME_HEIGHT + 2, 0, frame->message);
 
-            }
+    comp_present();
+}
+GameState *playing; // Game in progress, saved if the console stops us
+volatile sig_atomic_t quit_requested = 0; // Set by SIGINT/SIGTERM, acted on by the game loop
+
+// Tournament
+// --tournament N plays N seeded courses headless on --threads workers (see
+// tournament.h). The "jump" policy jumps when the next obstacle is param
+// frames away at the current speed (default JUMP_LEAD), give or take a
+// reaction jitter drawn afresh for every jump, so now and then it jumps too
+// early or too late and the game ends; "random" jumps with a chance of one in
+// param (default 20) every frame.
+static const char *const dinosaur_policies[] = { "jump", "random", NULL }; // First is the default
+
+// Function to find how far ahead of the dinosaur the nearest obstacle is, in columns
+long long obstacle_distance(GameState *game) {
+    long long left = game->camera / SPEED_ONE, nearest = -1;
+    for (int c = 0; c < CHUNK_RING; c++) {
+        const Chunk *chunk = &game->chunks[c];
+        for (int i = 0; i < chunk->obstacle_count; i++) {
+            long long x = chunk->obstacles[i] - left - 4; // The dinosaur's front column is 4
+            if (x >= 0 && (nearest < 0 || x < nearest)) nearest = x;
+        }
+    }
+    return nearest;
+}
 
-            // Check for obstacle rendering
-            for (int i = 0; i < game->obstacle_count; i++) {
-                int obstacle_x = game->obstacles[i][0];
-
-                if (x == obstacle_x) {
-                    if (y == GAME_HEIGHT - 2) { // Top of obstacle
-                        printf("╔╗");
-                        render_obstacle_top = 1;
-                    } else if (y == GAME_HEIGHT - 1) { // Bottom of obstacle
-                        printf("╚╝");
-                        render_obstacle_bottom = 1;
-                    }
-                }
-            }
+// Function to draw from a tournament policy's own generator
+uint64_t policy_rand(uint64_t *rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545F4914F6CDD1DULL;
+}
 
-            // Print space if nothing is rendered
-            if (!render_dino && !render_obstacle_top && !render_obstacle_bottom) {
-                printf(" ");
-            }
+// Function to draw the "jump" policy's lead for its next jump, around param frames
+long jump_lead(uint64_t *rng, long param) {
+    long lead = param;
+    for (int i = 0; i < 4; i++) lead += (long)(policy_rand(rng) % (2 * JUMP_JITTER + 1)) - JUMP_JITTER;
+    return lead;
+}
 
-            // Move to the next position
-            if (render_dino || render_obstacle_top || render_obstacle_bottom) {
-                x++; // Skip the next column as we render two characters per entity
+// Function to play one headless game
+void play_tournament_game(uint64_t seed, const TourPolicy *policy, long max_ticks, TourResult *result) {
+    GameState *game = start_session();
+    int random = strcmp(policy->name, "random") == 0;
+    long param = policy->param > 0 ? policy->param : random ? 20 : JUMP_LEAD;
+    uint64_t rng = tour_mix(seed) | 1; // Separate from the course, so the course only depends on the seed
+    long lead = jump_lead(&rng, param);
+    init_game(game, seed);
+
+    long tick = 0;
+    result->outcome = TOUR_CAPPED;
+    while (tick < max_ticks) {
+        session_tick(&session);
+        if (game->jump_state == GROUNDED) {
+            long long distance = obstacle_distance(game);
+            if (random) {
+                if (policy_rand(&rng) % (uint64_t)param == 0) start_jump(game);
+            } else if (distance >= 0 && distance <= lead * game->speed / SPEED_ONE) {
+                start_jump(game);
+                lead = jump_lead(&rng, param);
             }
         }
-        printf("\n");
+        manage_jump(game);
+        generate_obstacle(game);
+        move_obstacles(game);
+        tick++;
+        if (check_collision(game)) {
+            result->outcome = TOUR_LOST;
+            break;
+        }
     }
-    // Render the ground
-    for (int x = 0; x < GAME_WIDTH; x++) {
-        printf("▓");
+    result->score = (uint32_t)game->score;
+    result->ticks = (uint32_t)tick;
+}
+
+// Function to save the game in progress for the next launch
+void save_game(const GameState *game) {
+    savestate_write("dinosaur", SAVE_VERSION, game, sizeof(*game));
+}
+
+// Function to continue a saved game; returns 1 if resumed
+int resume_game(GameState *game) {
+    GameState save;
+    if (savestate_read("dinosaur", SAVE_VERSION, &save, sizeof(save)) != (long)sizeof(save)) return 0;
+    if (save.dino_pos < 0 || save.dino_pos > MAX_JUMP_HEIGHT || save.jump_state < GROUNDED || save.jump_state > DESCENDING ||
+        save.speed < SPEED_ONE || save.speed > MAX_SPEED || save.camera < 0 || save.next_chunk < 0) return 0;
+    for (int i = 0; i < CHUNK_RING; i++) {
+        if (save.chunks[i].obstacle_count < 0 || save.chunks[i].obstacle_count > CHUNK_MAX_OBSTACLES) return 0;
     }
-    printf("\n");
 
-    // Display score and jump state
-    printf("Score: %d\n", 
-           game->score);
+    *game = save;
+    return 1;
 }
+
+// SIGINT/SIGTERM: saving and exiting are not async-signal-safe, so only ask for them
 void handle_signal(int sig) {
+    (void)sig;
+    quit_requested = 1;
+}
+
+// Function to save and exit from the game thread once a signal asked for it
+void check_quit() {
+    if (!quit_requested) return;
+    if (playing) save_game(playing);
+    render_stop();
     disable_raw_mode();
     printf("\033[H\033[J");
     exit(0);
@@ -261,132 +452,173 @@ void disable_raw_mode() {
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
 }
 
-int kbhit() { // Check if a key has been pressed
-    struct termios oldt, newt;
-    int ch;
-    int oldf;
-
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
-
-    ch = getchar();
-    ch=tolower(ch);
-
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
-
-    if (ch != EOF) {
-        ungetc(ch, stdin);
+int main(int argc, char *argv[]) {
+    int spectate = 0;
+    int check_frames = 0;
+    const char *script = NULL;
+    int capture_frames = 0;
+    int tracing = 0;
+    uint64_t seed = (uint64_t)time(NULL);
+    const char *policy_spec = dinosaur_policies[0], *out = NULL;
+    long tournament_games = 0, max_ticks = TOURNAMENT_MAX_TICKS;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--spectate") == 0) {
+            spectate = 1;
+        } else if (strcmp(argv[i], "--check-frames") == 0) {
+            check_frames = 1;
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script = argv[++i]; // Testing: take keys at the frames the file gives
+        } else if (strcmp(argv[i], "--capture") == 0) {
+            capture_frames = 1;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            tracing = 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10); // Replay a course shown on the game over screen
+        } else if (strcmp(argv[i], "--tournament") == 0 && i + 1 < argc) {
+            tournament_games = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            policy_spec = argv[++i];
+        } else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc) {
+            max_ticks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+    }
+    if (tournament_games > 0) { // Headless, nothing touches the terminal
+        TourPolicy policy;
+        if (tour_policy_parse(&policy, policy_spec, dinosaur_policies) != 0) {
+            fprintf(stderr, "Unknown policy %s, dinosaur has jump[:lead] and random[:odds]\n", policy_spec);
+            return 1;
+        }
+        if (tour_run("dinosaur", &policy, play_tournament_game, tournament_games, threads, seed, max_ticks, out) != 0) {
+            perror("Failed to run the tournament");
+            return 1;
+        }
+        return 0;
+    }
+    if (check_frames) {
+        framecheck_start("dinosaur", FRAME_BYTE_BUDGET, FRAME_WRITE_BUDGET);
+    }
+    if (script && input_script(script) != 0) {
         return 1;
     }
 
-    return 0;
-}
-
-char getch() { // Read a character from the input
-    struct termios oldt, newt;
-    char ch;
-
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    ch = getchar();
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-
-    return tolower(ch);
-}
-
+    if (tracing && trace_start("dinosaur") != 0) {
+        perror("Failed to start tracing");
+    }
 
-int main() {
-      // Set up signal handling
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+    // Set up signal handling; no SA_RESTART, so a blocked key wait returns to check the flag
+    struct sigaction sa;
+    sa.sa_handler = handle_signal;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
     // Enable raw mode for terminal input
     enable_raw_mode();
-    // Seed random number generator
-
-    srand(time(NULL));
+    hiscore_open("dinosaur");
+    setup_screen();
+    if (spectate && spectate_start("dinosaur") != 0) {
+        perror("Failed to start spectator mode");
+    }
+    if (capture_frames && capture_start("dinosaur") != 0) {
+        perror("Failed to start capture");
+    }
+    render_start(sizeof(DinoFrame), render);
+    input_start("dinosaur");
+    if (!script) { // Scripted runs tick back to back
+        realtime_start("dinosaur", FRAME_TIME_US);
+    }
 
-    GameState game;
+    GameState *game = start_session();
     int restart_game = 0;
+    int resumed = resume_game(game);
 
     do {
-        init_game(&game);
-
-        // Timing variables for frame rate control
-        long long last_frame_time = get_milliseconds();
-        const long long FRAME_TIME = 20;  // 20 ms per frame (about 50 FPS)
+        if (!resumed) {
+            game = start_session(); // O(1), no matter how long the last run was
+            init_game(game, seed++);
+        }
+        resumed = 0;
+        playing = game;
 
         while (1) {
-            // Frame rate control
-            long long current_time = get_milliseconds();
-            long long elapsed_time = current_time - last_frame_time;
-
-            // Handle input
-            if (kbhit()) {
-                char ch = getchar();
-                if (ch == ' ') {
-                    start_jump(&game);
+            // Frame rate control: wake up on the next 20 ms boundary
+            realtime_wait();
+            check_quit();
+            TRACE_SCOPE("tick");
+            session_tick(&session);
+
+            // Handle input: drain every pending key, extra jumps while airborne are ignored
+            InputEvent ev;
+            int quit = 0;
+            while (input_poll(&ev)) {
+                if (ev.key == ' ' && game->jump_state == GROUNDED) {
+                    start_jump(game);
+                    render_mark_input(ev.at_us);
                 }
-                if (ch == 'q') {
-                    restart_game=0;
-                    break;
+                if (ev.key == 'q') {
+                    quit = 1;
                 }
             }
+            if (quit) {
+                save_game(game);
+                playing = NULL;
+                restart_game=0;
+                break;
+            }
+
+            savestate_hold(); // Signals wait until the frame's state is complete
+
+            // Manage jump mechanics
+            manage_jump(game);
 
-            // Only update if enough time has passed
-            if (elapsed_time >= FRAME_TIME) {
-                // Manage jump mechanics
-                manage_jump(&game);
+            // Generate obstacles
+            generate_obstacle(game);
 
-                // Generate obstacles
-                generate_obstacle(&game);
+            // Move obstacles
+            move_obstacles(game);
 
-                // Move obstacles
-                move_obstacles(&game);
+            savestate_release();
 
-                // Check for collision
-                if (check_collision(&game)) {
-                    printf("Game Over! Final Score: %d\n", game.score);
-                    printf("Jump for retry or press Q for exit\n");
+            // Check for collision
+            if (check_collision(game)) {
+                playing = NULL; // Nothing left to resume
+                hiscore_submit(game->score);
+                char message[128];
+                snprintf(message, sizeof(message), "Game Over! Final Score: %d\nBest Score: %d   Seed: %llu\nJump for retry or press Q for exit\n",
+                         game->score, hiscore_best(&hiscore_store.index, "dinosaur"), (unsigned long long)game->seed);
+                publish_frame(game, message);
+                
+                k: char choice;
+                choice = input_wait_key();
+                check_quit();
+                if(choice=='q' || choice == ' '){
                     
-                    k: char choice;
-                    choice = getch();
-                    if(choice=='q' || choice == ' '){
-                        
-                        if (choice == ' ') {
-                            restart_game = 1;
-                            break;
-                        } else if (choice == 'q') {
-                            restart_game = 0;
-                            break;
-                        }}
-                    else{
-                        goto k;
+                    if (choice == ' ') {
+                        restart_game = 1;
                         break;
-                    }
-                    
+                    } else if (choice == 'q') {
+                        restart_game = 0;
+                        break;
+                    }}
+                else{
+                    goto k;
+                    break;
                 }
-
-                // Render game state
-                render(&game);
-
-                // Update last frame time
-                last_frame_time = current_time;
-            }
-            else {
-                // Small sleep to prevent CPU overuse
-                usleep(10000);  // 10ms sleep
+                
             }
+
+            // Render game state
+            publish_frame(game, "");
         }
     } while (restart_game);
     // Restore terminal settings before exiting
+    render_stop();
     printf("\033[H\033[J");
     disable_raw_mode();
 
@@ -0,0 +1,223 @@
+#ifndef VGC_FRAMECHECK_H
+#define VGC_FRAMECHECK_H
+
+// Frame checking: verify what the compositor sends and what it costs.
+//
+// Enabled with --check-frames. Every byte written to the terminal is fed
+// through a small decoder for the escape sequences the compositor emits,
+// which keeps its own copy of the screen. After each frame that screen must
+// match the compositor's layers cell for cell, so a diffing bug that leaves
+// stale or missing glyphs is caught on the frame it happens. Delta frames
+// must also stay within the game's budget of bytes and write() calls;
+// keyframes and full-screen messages are only measured. The renderer runs in
+// lockstep meanwhile (see render.h), so the budgets apply to one frame per
+// tick rather than to whatever the render thread happened to coalesce. At
+// exit one line per session is appended to framecheck.log and any failure is
+// printed and turns the exit status into 1.
+//
+// The budgets count only what the compositor writes. When the descriptor
+// named by VGC_FRAME_FD is open, the budgets and then the number and kind of
+// each frame are written to it as the frame goes out. tests/ptyrun.c uses
+// these to split everything the game writes to the terminal into ticks. It
+// checks the same budgets there, counting every write() at the terminal.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "compositor.h"
+#include "histogram.h"
+#include "render.h"
+
+#define FRAMECHECK_LOG_FILE "framecheck.log"
+
+typedef struct {
+    char game[16];
+    size_t byte_budget; // Per delta frame
+    int write_budget;
+
+    Glyph screen[COMP_MAX_ROWS][COMP_MAX_COLS]; // The terminal as decoded from the byte stream
+    int row, col;
+
+    long frames, keyframes;
+    long over_bytes, over_writes; // Delta frames that broke a budget
+    long mismatches; // Frames whose decoded screen differs from the layers
+    long first_mismatch; // Frame number, -1 if none
+    int mismatch_row, mismatch_col;
+    Glyph mismatch_want, mismatch_got;
+    Histogram bytes; // Per delta frame
+    Histogram writes;
+    size_t keyframe_max;
+    int frame_fd; // VGC_FRAME_FD, where frames are announced; -1 if there is none
+} FrameCheck;
+
+static FrameCheck framecheck;
+
+static inline void framecheck_clear(int from_row, int from_col) { // ESC[J: erase from the cursor to the end of the screen
+    for (int r = from_row; r < COMP_MAX_ROWS; r++) {
+        for (int c = (r == from_row ? from_col : 0); c < COMP_MAX_COLS; c++) {
+            framecheck.screen[r][c] = ' ';
+        }
+    }
+}
+
+static inline void framecheck_feed(const char *bytes, size_t len) { // Apply terminal output to the decoded screen
+    FrameCheck *f = &framecheck;
+    size_t i = 0;
+
+    while (i < len) {
+        unsigned char ch = (unsigned char)bytes[i];
+        if (ch == '\033' && i + 1 < len && bytes[i + 1] == '[') {
+            int params[2] = { 0, 0 }, count = 0;
+            i += 2;
+            while (i < len && ((bytes[i] >= '0' && bytes[i] <= '9') || bytes[i] == ';')) {
+                if (bytes[i] == ';') {
+                    if (count < 1) count++;
+                } else {
+                    params[count] = params[count] * 10 + (bytes[i] - '0');
+                }
+                i++;
+            }
+            if (i >= len) break;
+            if (bytes[i] == 'H') {
+                f->row = params[0] ? params[0] - 1 : 0;
+                f->col = params[1] ? params[1] - 1 : 0;
+            } else if (bytes[i] == 'J') {
+                framecheck_clear(f->row, f->col);
+            }
+            i++;
+        } else if (ch == '\n') { // The tty's output processing turns it into CR LF
+            f->row++;
+            f->col = 0;
+            i++;
+        } else if (ch == '\r') {
+            f->col = 0;
+            i++;
+        } else {
+            int consumed;
+            Glyph glyph = comp_glyph(bytes + i, &consumed);
+            if (f->row >= 0 && f->row < COMP_MAX_ROWS && f->col >= 0 && f->col < COMP_MAX_COLS) {
+                f->screen[f->row][f->col] = glyph;
+            }
+            f->col++;
+            i += (size_t)consumed;
+        }
+    }
+}
+
+static inline void framecheck_compare() { // Check the decoded screen against the compositor's layers
+    FrameCheck *f = &framecheck;
+    const Compositor *c = &compositor;
+
+    for (int r = 0; r < c->rows; r++) {
+        for (int col = 0; col < c->cols; col++) {
+            Glyph want = c->sprites[r][col] != GLYPH_NONE ? c->sprites[r][col] : c->background[r][col];
+            if (f->screen[r][col] == want) continue;
+
+            if (f->mismatches++ == 0) {
+                f->first_mismatch = f->frames;
+                f->mismatch_row = r;
+                f->mismatch_col = col;
+                f->mismatch_want = want;
+                f->mismatch_got = f->screen[r][col];
+            }
+            return;
+        }
+    }
+}
+
+static inline void framecheck_frame(const char *bytes, size_t len, int keyframe, int text) { // Compositor check hook
+    FrameCheck *f = &framecheck;
+
+    if (f->frame_fd >= 0) {
+        char line[64];
+        int n = snprintf(line, sizeof(line), "frame %ld %s\n", f->frames, text ? "text" : keyframe ? "key" : "delta");
+        ssize_t sent = write(f->frame_fd, line, (size_t)n);
+        (void)sent; // Nobody may be listening
+    }
+    framecheck_feed(bytes, len);
+    f->frames++;
+    if (!text) framecheck_compare();
+
+    if (keyframe) {
+        f->keyframes++;
+        if (len > f->keyframe_max) f->keyframe_max = len;
+        return;
+    }
+    hist_record(&f->bytes, (int64_t)len);
+    hist_record(&f->writes, compositor.frame_writes);
+    if (len > f->byte_budget) f->over_bytes++;
+    if (compositor.frame_writes > f->write_budget) f->over_writes++;
+}
+
+static inline void framecheck_glyph_text(Glyph glyph, char *out) { // Printable form of a glyph for the report
+    const GlyphCode *code = &compositor.glyphs[glyph < COMP_GLYPH_COUNT ? glyph : '?'];
+    if (glyph < ' ' || glyph >= COMP_GLYPH_COUNT) {
+        snprintf(out, 8, "#%d", glyph);
+        return;
+    }
+    memcpy(out, code->bytes, code->len);
+    out[code->len] = '\0';
+}
+
+static inline void framecheck_report() { // Log the session and fail the process if a check failed
+    FrameCheck *f = &framecheck;
+    int failed = f->over_bytes || f->over_writes || f->mismatches;
+
+    FILE *log = fopen(FRAMECHECK_LOG_FILE, "a");
+    if (log) {
+        char when[32];
+        time_t now = time(NULL);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(log, "%s %s %s frames=%ld keyframes=%ld keyframe_max=%zuB bytes p50=%lluB p99=%lluB max=%lluB budget=%zuB "
+                "writes max=%llu budget=%d over_bytes=%ld over_writes=%ld mismatches=%ld\n",
+                when, f->game, failed ? "FAIL" : "ok", f->frames, f->keyframes, f->keyframe_max,
+                (unsigned long long)hist_percentile(&f->bytes, 50),
+                (unsigned long long)hist_percentile(&f->bytes, 99),
+                (unsigned long long)f->bytes.max, f->byte_budget,
+                (unsigned long long)f->writes.max, f->write_budget,
+                f->over_bytes, f->over_writes, f->mismatches);
+        fclose(log);
+    }
+    if (!failed) return;
+
+    fprintf(stderr, "framecheck: %s: %ld of %ld delta frames over %zu bytes, %ld over %d writes\n",
+            f->game, f->over_bytes, (long)f->bytes.total, f->byte_budget, f->over_writes, f->write_budget);
+    if (f->mismatches) {
+        char want[8], got[8];
+        framecheck_glyph_text(f->mismatch_want, want);
+        framecheck_glyph_text(f->mismatch_got, got);
+        fprintf(stderr, "framecheck: %s: %ld frames differ from the layers, first at frame %ld row %d col %d: want '%s' got '%s'\n",
+                f->game, f->mismatches, f->first_mismatch, f->mismatch_row, f->mismatch_col, want, got);
+    }
+    fflush(stderr);
+    _exit(1); // Handlers registered after framecheck_start() have already run
+}
+
+static inline void framecheck_start(const char *game, size_t byte_budget, int write_budget) { // Check every frame; call first in main() so the report runs last
+    FrameCheck *f = &framecheck;
+
+    snprintf(f->game, sizeof(f->game), "%s", game);
+    f->byte_budget = byte_budget;
+    f->write_budget = write_budget;
+    f->first_mismatch = -1;
+    framecheck_clear(0, 0);
+
+    const char *frame_fd = getenv("VGC_FRAME_FD");
+    f->frame_fd = frame_fd ? atoi(frame_fd) : -1;
+    if (f->frame_fd >= 0) {
+        char line[64];
+        fcntl(f->frame_fd, F_SETFD, FD_CLOEXEC);
+        unsetenv("VGC_FRAME_FD");
+        int n = snprintf(line, sizeof(line), "budget %zu %d\n", byte_budget, write_budget);
+        ssize_t sent = write(f->frame_fd, line, (size_t)n);
+        (void)sent;
+    }
+    compositor.check = framecheck_frame;
+    render_lockstep();
+    atexit(framecheck_report);
+}
+
+#endif
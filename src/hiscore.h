@@ -0,0 +1,343 @@
+#ifndef VGC_HISCORE_H
+#define VGC_HISCORE_H
+
+// Persistent high-score store shared by the games and the main screen.
+//
+// Every finished game is appended as a fixed-size record to scores.log in the
+// console storage directory. scores.idx holds the top HISCORE_TOP_K scores of
+// every game together with the log offset it was built from, so readers never
+// have to scan the log; a stale index is caught up by replaying only the log
+// tail. Games submit through a background writer thread that batches records
+// and issues a single fsync per batch, so a game over never waits on the disk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define HISCORE_LOG_FILE "scores.log"
+#define HISCORE_INDEX_FILE "scores.idx"
+#define HISCORE_MAGIC 0x52435356u // "VSCR"
+#define HISCORE_INDEX_MAGIC 0x58445356u // "VSDX"
+#define HISCORE_VERSION 1
+#define HISCORE_NAME_LEN 16
+#define HISCORE_TOP_K 10
+#define HISCORE_MAX_GAMES 100
+#define HISCORE_QUEUE_LEN 64
+#define HISCORE_BATCH_MS 50 // How long the writer waits for more scores before committing
+
+typedef struct {
+    uint32_t magic; // HISCORE_MAGIC, marks a complete record
+    int32_t score;
+    int64_t timestamp;
+    char game[HISCORE_NAME_LEN];
+} HiscoreRecord;
+
+typedef struct {
+    int32_t score;
+    int32_t reserved;
+    int64_t timestamp;
+} HiscoreEntry;
+
+typedef struct {
+    char game[HISCORE_NAME_LEN];
+    int32_t count;
+    int32_t reserved;
+    HiscoreEntry top[HISCORE_TOP_K]; // Sorted, best first
+} HiscoreTable;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t game_count;
+    uint32_t reserved;
+    uint64_t log_size; // Log bytes already folded into the tables
+} HiscoreIndexHeader;
+
+typedef struct {
+    HiscoreIndexHeader header;
+    HiscoreTable tables[HISCORE_MAX_GAMES];
+} HiscoreIndex;
+
+typedef struct {
+    HiscoreIndex index; // In-memory copy served to readers
+    char game[HISCORE_NAME_LEN];
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    HiscoreRecord queue[HISCORE_QUEUE_LEN];
+    int queue_head, queue_len;
+    int running;
+    int dropped; // Scores lost because the queue was full
+} HiscoreStore;
+
+static HiscoreStore hiscore_store;
+
+static inline HiscoreTable *hiscore_find(HiscoreIndex *index, const char *game, int create) { // Find (or add) the table of a game
+    for (uint32_t i = 0; i < index->header.game_count; i++) {
+        if (strncmp(index->tables[i].game, game, HISCORE_NAME_LEN) == 0) {
+            return &index->tables[i];
+        }
+    }
+    if (!create || index->header.game_count >= HISCORE_MAX_GAMES) {
+        return NULL;
+    }
+
+    HiscoreTable *table = &index->tables[index->header.game_count++];
+    memset(table, 0, sizeof(*table));
+    snprintf(table->game, HISCORE_NAME_LEN, "%s", game);
+    return table;
+}
+
+static inline void hiscore_insert(HiscoreIndex *index, const HiscoreRecord *record) { // Fold one record into the top-K tables
+    char game[HISCORE_NAME_LEN];
+    memcpy(game, record->game, HISCORE_NAME_LEN);
+    game[HISCORE_NAME_LEN - 1] = '\0';
+
+    HiscoreTable *table = hiscore_find(index, game, 1);
+    if (!table) return;
+
+    int pos = table->count;
+    while (pos > 0 && table->top[pos - 1].score < record->score) {
+        pos--;
+    }
+    if (pos >= HISCORE_TOP_K) return;
+
+    int last = table->count < HISCORE_TOP_K ? table->count : HISCORE_TOP_K - 1;
+    memmove(&table->top[pos + 1], &table->top[pos], (last - pos) * sizeof(HiscoreEntry));
+    table->top[pos].score = record->score;
+    table->top[pos].reserved = 0;
+    table->top[pos].timestamp = record->timestamp;
+    if (table->count < HISCORE_TOP_K) table->count++;
+}
+
+static inline void hiscore_replay(HiscoreIndex *index, int log_fd) { // Catch the index up with the log tail it has not seen yet
+    struct stat st;
+    if (fstat(log_fd, &st) != 0) return;
+
+    uint64_t end = (uint64_t)st.st_size - (uint64_t)st.st_size % sizeof(HiscoreRecord);
+    if (index->header.log_size > end || index->header.log_size % sizeof(HiscoreRecord) != 0) {
+        memset(&index->header, 0, sizeof(index->header)); // Log was replaced, rebuild from scratch
+    }
+
+    HiscoreRecord batch[256];
+    uint64_t offset = index->header.log_size;
+    while (offset < end) {
+        size_t want = end - offset < sizeof(batch) ? (size_t)(end - offset) : sizeof(batch);
+        ssize_t got = pread(log_fd, batch, want, (off_t)offset);
+        if (got <= 0) break;
+
+        size_t n = (size_t)got / sizeof(HiscoreRecord);
+        for (size_t i = 0; i < n; i++) {
+            if (batch[i].magic == HISCORE_MAGIC) {
+                hiscore_insert(index, &batch[i]);
+            }
+        }
+        offset += n * sizeof(HiscoreRecord);
+        if (n == 0) break;
+    }
+    index->header.log_size = offset;
+}
+
+static inline int hiscore_read_index(HiscoreIndex *index) { // Load scores.idx; returns 0 when a valid index was read
+    memset(&index->header, 0, sizeof(index->header));
+
+    int fd = open(HISCORE_INDEX_FILE, O_RDONLY);
+    if (fd < 0) return -1;
+
+    HiscoreIndexHeader header;
+    int ok = read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+             header.magic == HISCORE_INDEX_MAGIC && header.version == HISCORE_VERSION &&
+             header.game_count <= HISCORE_MAX_GAMES;
+    if (ok) {
+        ssize_t size = (ssize_t)(header.game_count * sizeof(HiscoreTable));
+        ok = read(fd, index->tables, size) == size;
+    }
+    close(fd);
+
+    if (!ok) return -1;
+    index->header = header;
+    return 0;
+}
+
+static inline void hiscore_write_index(const HiscoreIndex *index) { // Atomically replace scores.idx
+    const char *tmp = HISCORE_INDEX_FILE ".tmp";
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+
+    HiscoreIndexHeader header = index->header;
+    header.magic = HISCORE_INDEX_MAGIC;
+    header.version = HISCORE_VERSION;
+
+    ssize_t size = (ssize_t)(header.game_count * sizeof(HiscoreTable));
+    int ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+             write(fd, index->tables, size) == size;
+    close(fd);
+
+    if (ok) {
+        rename(tmp, HISCORE_INDEX_FILE);
+    } else {
+        unlink(tmp);
+    }
+}
+
+static inline void hiscore_commit(const HiscoreRecord *records, int count) { // Append a batch to the log with one fsync, then refresh the index
+    int fd = open(HISCORE_LOG_FILE, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return;
+    flock(fd, LOCK_EX); // Other games may be committing at the same time
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size % sizeof(HiscoreRecord) != 0) {
+        ftruncate(fd, st.st_size - st.st_size % sizeof(HiscoreRecord)); // Drop a torn record left by a crash
+    }
+
+    ssize_t size = (ssize_t)(count * sizeof(HiscoreRecord));
+    if (write(fd, records, size) == size) {
+        fsync(fd);
+
+        HiscoreIndex *index = malloc(sizeof(HiscoreIndex));
+        if (index) {
+            hiscore_read_index(index);
+            hiscore_replay(index, fd);
+            hiscore_write_index(index);
+            free(index);
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+static inline void *hiscore_writer(void *arg) { // Background thread: batch queued scores and group-commit them
+    HiscoreStore *store = arg;
+    HiscoreRecord batch[HISCORE_QUEUE_LEN];
+
+    pthread_mutex_lock(&store->lock);
+    while (store->running || store->queue_len > 0) {
+        if (store->queue_len == 0) {
+            pthread_cond_wait(&store->wake, &store->lock);
+            continue;
+        }
+
+        if (store->running) { // Give closely spaced scores a chance to share the fsync
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += HISCORE_BATCH_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&store->wake, &store->lock, &deadline);
+        }
+
+        int count = store->queue_len;
+        for (int i = 0; i < count; i++) {
+            batch[i] = store->queue[(store->queue_head + i) % HISCORE_QUEUE_LEN];
+        }
+        store->queue_head = (store->queue_head + count) % HISCORE_QUEUE_LEN;
+        store->queue_len = 0;
+
+        pthread_mutex_unlock(&store->lock);
+        hiscore_commit(batch, count);
+        pthread_mutex_lock(&store->lock);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return NULL;
+}
+
+static inline int hiscore_load(HiscoreIndex *index) { // Read the index and fold in any log records it is missing
+    if (hiscore_read_index(index) != 0) {
+        memset(&index->header, 0, sizeof(index->header));
+    }
+
+    int fd = open(HISCORE_LOG_FILE, O_RDONLY);
+    if (fd < 0) return 0;
+    hiscore_replay(index, fd);
+    close(fd);
+    return 0;
+}
+
+static inline void hiscore_close() { // Flush pending scores and stop the writer thread
+    HiscoreStore *store = &hiscore_store;
+
+    pthread_mutex_lock(&store->lock);
+    if (!store->running) {
+        pthread_mutex_unlock(&store->lock);
+        return;
+    }
+    store->running = 0;
+    pthread_cond_signal(&store->wake);
+    pthread_mutex_unlock(&store->lock);
+
+    pthread_join(store->writer, NULL);
+}
+
+static inline int hiscore_open(const char *game) { // Load the leaderboard of a game and start the writer thread
+    HiscoreStore *store = &hiscore_store;
+
+    memset(store->game, 0, sizeof(store->game));
+    snprintf(store->game, HISCORE_NAME_LEN, "%s", game);
+    hiscore_load(&store->index);
+
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->wake, NULL);
+    store->queue_head = 0;
+    store->queue_len = 0;
+    store->running = 1;
+
+    sigset_t all, old; // Signals must reach the game thread, not the writer
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&store->writer, NULL, hiscore_writer, store);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (err != 0) {
+        store->running = 0;
+        return -1;
+    }
+
+    atexit(hiscore_close);
+    return 0;
+}
+
+static inline void hiscore_submit(int score) { // Record a finished game; never blocks on I/O
+    HiscoreStore *store = &hiscore_store;
+    HiscoreRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.magic = HISCORE_MAGIC;
+    record.score = score;
+    record.timestamp = (int64_t)time(NULL);
+    memcpy(record.game, store->game, HISCORE_NAME_LEN);
+
+    pthread_mutex_lock(&store->lock);
+    if (store->running && store->queue_len < HISCORE_QUEUE_LEN) {
+        store->queue[(store->queue_head + store->queue_len) % HISCORE_QUEUE_LEN] = record;
+        store->queue_len++;
+        hiscore_insert(&store->index, &record);
+        pthread_cond_signal(&store->wake);
+    } else {
+        store->dropped++;
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+static inline int hiscore_best(const HiscoreIndex *index, const char *game) { // Best score of a game, or -1 if none
+    for (uint32_t i = 0; i < index->header.game_count; i++) {
+        const HiscoreTable *table = &index->tables[i];
+        if (strncmp(table->game, game, HISCORE_NAME_LEN) == 0 && table->count > 0) {
+            return table->top[0].score;
+        }
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef VGC_HISTOGRAM_H
+#define VGC_HISTOGRAM_H
+
+// Fixed-size log-linear histogram for latencies in microseconds.
+//
+// Each power of two is split into HIST_SUB linear buckets, so any recorded
+// value is reported within 12.5% using 4 KB of counters and no allocation.
+
+#include <stdint.h>
+#include <string.h>
+
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+} Histogram;
+
+static inline int hist_index(uint64_t value) { // Bucket holding value
+    if (value < HIST_SUB) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (int)((value >> shift) & (HIST_SUB - 1));
+}
+
+static inline uint64_t hist_bucket_value(int index) { // Smallest value that lands in a bucket
+    if (index < HIST_SUB) return (uint64_t)index;
+    int shift = (index >> HIST_SUB_BITS) - 1;
+    return (uint64_t)(HIST_SUB + (index & (HIST_SUB - 1))) << shift;
+}
+
+static inline void hist_reset(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static inline void hist_record(Histogram *h, int64_t value) {
+    if (value < 0) value = 0;
+    h->counts[hist_index((uint64_t)value)]++;
+    h->total++;
+    h->sum += (uint64_t)value;
+    if ((uint64_t)value > h->max) h->max = (uint64_t)value;
+}
+
+static inline uint64_t hist_percentile(const Histogram *h, double percent) { // Value below which percent of the samples fall
+    if (h->total == 0) return 0;
+    if (percent >= 100.0) return h->max;
+
+    uint64_t rank = (uint64_t)(percent / 100.0 * (double)h->total);
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen > rank) {
+            uint64_t value = hist_bucket_value(i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+static inline uint64_t hist_mean(const Histogram *h) {
+    return h->total ? h->sum / h->total : 0;
+}
+
+#endif
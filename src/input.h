@@ -0,0 +1,190 @@
+#ifndef VGC_INPUT_H
+#define VGC_INPUT_H
+
+// Keyboard input pipeline shared by the games.
+//
+// A reader thread blocks on the terminal and timestamps every key the moment
+// it arrives, pushing it into a lock-free queue. Each tick the game drains
+// the whole queue and coalesces the keys by its own rules (latest direction,
+// net paddle movement, one jump), so a burst of keys is handled in the next
+// tick instead of trickling in one per tick. Keys that changed the game are
+// passed to render_mark_input(); the render thread then records how long each
+// took to reach the screen, and the histogram is summarised per session in
+// input-latency.log in the storage directory.
+//
+// For golden-frame tests (tests/run.sh) a game can be given a --script: the
+// keys still come through the terminal, but each is handed to the game only
+// once the frame the script gives it has been published, so a run depends on
+// the script alone and not on when the keys happened to arrive. A script
+// line is a frame number, from 1 up, and a key (a character, or "space");
+// # starts a comment. A key the game blocks on is taken at once, whatever
+// its frame.
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include "render.h"
+
+#define INPUT_QUEUE_LEN 256
+#define INPUT_LOG_FILE "input-latency.log"
+#define INPUT_EOF_KEY 'q' // Queued once stdin closes, so nothing waits for a key forever
+#define INPUT_SCRIPT_LEN 4096 // Most keys a --script may hold
+
+typedef struct {
+    char key; // Lower-cased
+    long long at_us; // Arrival time, render_now_us() clock
+} InputEvent;
+
+typedef struct {
+    InputEvent events[INPUT_QUEUE_LEN];
+    atomic_uint head, tail; // SPSC: reader thread pushes, game thread pops
+    sem_t available; // One count per queued event
+    pthread_t thread;
+    char game[16];
+
+    int scripted; // Keys wait for the frames below instead of being taken as they arrive
+    uint64_t cues[INPUT_SCRIPT_LEN]; // Frame each scripted key is due at, in order
+    int cue_count, next_cue;
+} InputQueue;
+
+static InputQueue input_queue;
+
+static inline int input_push(InputQueue *q, char key, long long at_us) { // Queue a key; 0 when the queue is full
+    unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&q->tail, memory_order_acquire) >= INPUT_QUEUE_LEN) return 0;
+    q->events[head % INPUT_QUEUE_LEN].key = key;
+    q->events[head % INPUT_QUEUE_LEN].at_us = at_us;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    sem_post(&q->available);
+    return 1;
+}
+
+static inline void *input_reader(void *arg) { // Timestamp keys as they arrive
+    InputQueue *q = arg;
+    unsigned char buf[64];
+
+    while (1) {
+        ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        long long now = render_now_us();
+        for (ssize_t i = 0; i < n; i++) {
+            int queued;
+            while (!(queued = input_push(q, (char)tolower(buf[i]), now)) && q->scripted) {
+                usleep(1000); // Scripted keys are never dropped, they wait for their frame
+            }
+            if (!queued) break; // Full, drop
+        }
+    }
+
+    // The terminal is gone: quit, once the game has made room for it
+    while (!input_push(q, INPUT_EOF_KEY, render_now_us())) usleep(1000);
+    return NULL;
+}
+
+static inline void input_pop(InputEvent *ev) { // Take the oldest event; the caller owns a semaphore count
+    InputQueue *q = &input_queue;
+    unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    *ev = q->events[tail % INPUT_QUEUE_LEN];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+static inline int input_poll(InputEvent *ev) { // Next pending key without waiting; 0 when there is none
+    InputQueue *q = &input_queue;
+    if (q->scripted) { // Due keys are waited for, since they may still be on their way through the terminal
+        if (q->next_cue >= q->cue_count || renderer.buffer.published < q->cues[q->next_cue]) return 0;
+        while (sem_wait(&q->available) != 0) {
+        }
+        q->next_cue++;
+        input_pop(ev);
+        return 1;
+    }
+    if (sem_trywait(&q->available) != 0) return 0;
+    input_pop(ev);
+    return 1;
+}
+
+static inline char input_wait_key() { // Block until a key arrives; 0 if a signal came first, so the caller can act on it
+    InputEvent ev;
+    if (sem_wait(&input_queue.available) != 0) return 0;
+    input_pop(&ev);
+    input_queue.next_cue++; // A scripted key that is waited for is taken whatever its frame
+    return ev.key;
+}
+
+static inline int input_script(const char *path) { // Take keys at the frames a script gives; call before input_start()
+    InputQueue *q = &input_queue;
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    char line[128];
+    int number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        unsigned long long frame;
+        char key[16];
+        int fields = sscanf(line, "%llu %15s", &frame, key);
+        if (fields <= 0) continue; // Blank or comment
+        if (fields != 2 || (strlen(key) != 1 && strcmp(key, "space") != 0) || q->cue_count == INPUT_SCRIPT_LEN ||
+            frame < 1 || (q->cue_count && frame < q->cues[q->cue_count - 1])) {
+            fprintf(stderr, "%s:%d: expected a frame from 1 up, no earlier than the last one, and a key\n", path, number);
+            fclose(file);
+            return -1;
+        }
+        q->cues[q->cue_count++] = frame;
+    }
+    fclose(file);
+    q->scripted = 1;
+    return 0;
+}
+
+static inline void input_report() { // Append this session's keypress-to-screen latency to the log
+    const Histogram *h = &renderer.input_latency;
+    if (h->total == 0) return;
+
+    FILE *log = fopen(INPUT_LOG_FILE, "a");
+    if (!log) return;
+
+    char when[32];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(log, "%s %s keys=%llu mean=%lluus p50=%lluus p90=%lluus p99=%lluus max=%lluus\n",
+            when, input_queue.game, (unsigned long long)h->total,
+            (unsigned long long)hist_mean(h),
+            (unsigned long long)hist_percentile(h, 50),
+            (unsigned long long)hist_percentile(h, 90),
+            (unsigned long long)hist_percentile(h, 99),
+            (unsigned long long)h->max);
+    fclose(log);
+}
+
+static inline int input_start(const char *game) { // Start the reader thread; call once raw mode is on
+    InputQueue *q = &input_queue;
+
+    snprintf(q->game, sizeof(q->game), "%s", game);
+    sem_init(&q->available, 0, 0);
+
+    sigset_t all, old; // Signals must reach the game thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&q->thread, NULL, input_reader, q);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) return -1;
+
+    pthread_detach(q->thread);
+    atexit(input_report);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef VGC_LEVELPACK_H
+#define VGC_LEVELPACK_H
+
+// Breakout level packs: many levels in one file, used straight from mmap.
+//
+// A pack is a header, a table with the offset of every level, and the levels
+// themselves. Each level is stored ready to play: its size, its bricks (type,
+// hit points, position and width) and a uniform grid with one entry per board
+// cell naming the brick that covers it. The header also holds the most bricks
+// and the narrowest width of any level, so a game can size itself from the
+// header alone. Opening a pack maps it read-only and checks the header.
+// Selecting a level checks its table entry and its size against the header.
+// The first time a level is selected, its bricks are also checked against the
+// grid and the result is kept, so a damaged level cannot be started, nor one
+// that could never be cleared. None of this depends on the number of levels,
+// and finding the brick under the ball is one grid lookup whatever the size
+// of the wall.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LEVELPACK_MAGIC 0x4c564c42u // "BLVL"
+#define LEVELPACK_VERSION 2
+#define LEVEL_MAX_WIDTH 160
+#define LEVEL_MAX_HEIGHT 63 // One terminal row is kept for the status line
+#define LEVEL_MAX_BRICKS (LEVEL_MAX_WIDTH * LEVEL_MAX_HEIGHT)
+#define LEVEL_MAX_HP 3
+
+enum { // What is known of a level's bricks, see LevelPack.checked
+    LEVEL_UNCHECKED = 0,
+    LEVEL_GOOD = 1,
+    LEVEL_DAMAGED = 2,
+};
+
+enum {
+    BRICK_NORMAL = 0, // Breaks after hp hits
+    BRICK_SOLID = 1, // Never breaks and does not count towards clearing the level
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t level_count;
+    uint32_t max_bricks; // Most bricks in any level
+    uint16_t min_width; // Narrowest level
+    uint16_t reserved16;
+    uint32_t reserved;
+} LevelPackHeader;
+
+typedef struct {
+    uint64_t offset; // From the start of the file, 8-byte aligned
+    uint64_t size;
+} LevelEntry;
+
+typedef struct {
+    uint16_t width, height;
+    uint32_t brick_count;
+    uint32_t breakable; // Bricks that have to be broken to clear the level
+    uint32_t reserved;
+} Level; // Followed by LevelBrick[brick_count] and uint16_t grid[height][width]
+
+typedef struct {
+    uint16_t row, col;
+    uint8_t width;
+    uint8_t type;
+    uint8_t hp;
+    uint8_t reserved;
+} LevelBrick;
+
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    uint32_t level_count;
+    uint32_t max_bricks; // From the header; no level that has more can be selected
+    int min_width; // From the header; no level that is narrower can be selected
+    const LevelEntry *entries;
+    atomic_uchar *checked; // LEVEL_UNCHECKED, _GOOD or _DAMAGED for every level, set when it is first selected
+    int mapped; // 1 if base is an mmap of a pack file
+} LevelPack;
+
+typedef struct {
+    FILE *file;
+    char path[256];
+    char tmp_path[272];
+    uint32_t level_count;
+    uint32_t written;
+    uint32_t max_bricks;
+    int min_width;
+    LevelEntry *entries;
+    uint64_t offset;
+} LevelPackWriter;
+
+static inline size_t level_size(int width, int height, int brick_count) { // Bytes a level takes in a pack, padded to 8
+    size_t size = sizeof(Level) + (size_t)brick_count * sizeof(LevelBrick) + (size_t)width * height * sizeof(uint16_t);
+    return (size + 7) & ~(size_t)7;
+}
+
+static inline const LevelBrick *level_bricks(const Level *level) {
+    return (const LevelBrick *)(level + 1);
+}
+
+static inline const uint16_t *level_grid(const Level *level) { // Brick index + 1 for every cell, 0 where there is none
+    return (const uint16_t *)(level_bricks(level) + level->brick_count);
+}
+
+static inline int level_brick_at(const Level *level, int row, int col) { // Index of the brick covering a cell, or -1
+    if (row < 0 || row >= level->height || col < 0 || col >= level->width) return -1;
+    unsigned int id = level_grid(level)[row * level->width + col];
+    return (id == 0 || id > level->brick_count) ? -1 : (int)id - 1;
+}
+
+static inline int level_build(void *out, int width, int height, const LevelBrick *bricks, int count) { // Lay a level out in out (level_size() bytes); -1 if bricks overlap or do not fit
+    if (width < 1 || width > LEVEL_MAX_WIDTH || height < 1 || height > LEVEL_MAX_HEIGHT || count < 0 || count > LEVEL_MAX_BRICKS) return -1;
+
+    memset(out, 0, level_size(width, height, count));
+    Level *level = out;
+    level->width = (uint16_t)width;
+    level->height = (uint16_t)height;
+    level->brick_count = (uint32_t)count;
+
+    LevelBrick *stored = (LevelBrick *)(level + 1);
+    uint16_t *grid = (uint16_t *)(stored + count);
+    for (int i = 0; i < count; i++) {
+        const LevelBrick *b = &bricks[i];
+        if (b->row >= height || b->width == 0 || b->col + b->width > width || b->type > BRICK_SOLID) return -1;
+        if (b->type == BRICK_NORMAL && (b->hp < 1 || b->hp > LEVEL_MAX_HP)) return -1;
+
+        for (int k = 0; k < b->width; k++) {
+            uint16_t *cell = &grid[b->row * width + b->col + k];
+            if (*cell) return -1;
+            *cell = (uint16_t)(i + 1);
+        }
+        stored[i] = *b;
+        if (b->type == BRICK_NORMAL) level->breakable++;
+    }
+    return 0;
+}
+
+static inline int level_pack_open(LevelPack *pack, const char *path) { // Map a pack file read-only; 0 on success
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LevelPackHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (map == MAP_FAILED) return -1;
+
+    const LevelPackHeader *header = map;
+    size_t table_end = sizeof(LevelPackHeader) + (size_t)header->level_count * sizeof(LevelEntry);
+    if (header->magic != LEVELPACK_MAGIC || header->version != LEVELPACK_VERSION ||
+        header->level_count == 0 || table_end > (size_t)st.st_size || header->max_bricks > LEVEL_MAX_BRICKS ||
+        header->min_width < 1 || header->min_width > LEVEL_MAX_WIDTH) {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+    pack->checked = calloc(header->level_count, sizeof(atomic_uchar));
+    if (!pack->checked) {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    pack->base = map;
+    pack->size = (size_t)st.st_size;
+    pack->level_count = header->level_count;
+    pack->max_bricks = header->max_bricks;
+    pack->min_width = header->min_width;
+    pack->entries = (const LevelEntry *)(header + 1);
+    pack->mapped = 1;
+    return 0;
+}
+
+static inline int level_pack_single(LevelPack *pack, int width, int height, const LevelBrick *bricks, int count) { // Build a one-level pack in memory
+    size_t table_end = sizeof(LevelPackHeader) + sizeof(LevelEntry);
+    size_t size = table_end + level_size(width, height, count);
+    unsigned char *base = calloc(1, size);
+    atomic_uchar *checked = calloc(1, sizeof(atomic_uchar));
+    if (!base || !checked || level_build(base + table_end, width, height, bricks, count) != 0) {
+        free(base);
+        free(checked);
+        return -1;
+    }
+
+    LevelPackHeader *header = (LevelPackHeader *)base;
+    header->magic = LEVELPACK_MAGIC;
+    header->version = LEVELPACK_VERSION;
+    header->level_count = 1;
+    header->max_bricks = (uint32_t)count;
+    header->min_width = (uint16_t)width;
+    LevelEntry *entry = (LevelEntry *)(header + 1);
+    entry->offset = table_end;
+    entry->size = size - table_end;
+
+    pack->base = base;
+    pack->size = size;
+    pack->level_count = 1;
+    pack->max_bricks = header->max_bricks;
+    pack->min_width = header->min_width;
+    pack->entries = entry;
+    pack->checked = checked;
+    pack->mapped = 0;
+    return 0;
+}
+
+static inline void level_pack_close(LevelPack *pack) {
+    if (!pack->base) return;
+    if (pack->mapped) {
+        munmap((void *)pack->base, pack->size);
+    } else {
+        free((void *)pack->base);
+    }
+    free(pack->checked);
+    pack->base = NULL;
+    pack->checked = NULL;
+}
+
+static inline int level_check_bricks(const Level *level) { // Same rules as level_build(): 0 if every brick is valid and in the grid
+    const LevelBrick *bricks = level_bricks(level);
+    const uint16_t *grid = level_grid(level);
+    uint32_t breakable = 0;
+    for (uint32_t i = 0; i < level->brick_count; i++) {
+        const LevelBrick *b = &bricks[i];
+        if (b->row >= level->height || b->width == 0 || b->col + b->width > level->width || b->type > BRICK_SOLID) return -1;
+        if (b->type == BRICK_NORMAL && (b->hp < 1 || b->hp > LEVEL_MAX_HP)) return -1;
+        for (int k = 0; k < b->width; k++) {
+            if (grid[b->row * level->width + b->col + k] != i + 1) return -1; // A brick the ball could never reach
+        }
+        if (b->type == BRICK_NORMAL) breakable++;
+    }
+    return breakable == level->breakable ? 0 : -1;
+}
+
+static inline const Level *level_pack_get(const LevelPack *pack, uint32_t index) { // Level index of a pack, or NULL if it is damaged
+    if (index >= pack->level_count) return NULL;
+    unsigned char state = atomic_load_explicit(&pack->checked[index], memory_order_acquire);
+    if (state == LEVEL_DAMAGED) return NULL;
+
+    const LevelEntry *entry = &pack->entries[index];
+    if (entry->offset % 8 != 0 || entry->offset > pack->size || entry->size > pack->size - entry->offset ||
+        entry->size < sizeof(Level)) return NULL;
+
+    const Level *level = (const Level *)(pack->base + entry->offset);
+    if (level->width < 1 || level->width > LEVEL_MAX_WIDTH || level->height < 1 || level->height > LEVEL_MAX_HEIGHT ||
+        level->brick_count > pack->max_bricks || level->width < pack->min_width || level->breakable > level->brick_count ||
+        level_size(level->width, level->height, (int)level->brick_count) > entry->size) return NULL;
+    if (state == LEVEL_GOOD) return level;
+
+    state = level_check_bricks(level) == 0 ? LEVEL_GOOD : LEVEL_DAMAGED; // Checking twice from two threads is harmless
+    atomic_store_explicit(&pack->checked[index], state, memory_order_release);
+    return state == LEVEL_GOOD ? level : NULL;
+}
+
+static inline int level_pack_create(LevelPackWriter *w, const char *path, uint32_t level_count) { // Start writing a pack of level_count levels
+    memset(w, 0, sizeof(*w));
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    snprintf(w->tmp_path, sizeof(w->tmp_path), "%s.tmp", path);
+
+    w->entries = calloc(level_count ? level_count : 1, sizeof(LevelEntry));
+    w->file = fopen(w->tmp_path, "wb");
+    if (!w->entries || !w->file) {
+        if (w->file) fclose(w->file);
+        free(w->entries);
+        return -1;
+    }
+    w->level_count = level_count;
+    w->min_width = LEVEL_MAX_WIDTH;
+    w->offset = sizeof(LevelPackHeader) + (uint64_t)level_count * sizeof(LevelEntry);
+    w->offset = (w->offset + 7) & ~(uint64_t)7;
+    return fseek(w->file, (long)w->offset, SEEK_SET);
+}
+
+static inline int level_pack_add(LevelPackWriter *w, int width, int height, const LevelBrick *bricks, int count) { // Append the next level
+    if (w->written >= w->level_count) return -1;
+
+    size_t size = level_size(width, height, count);
+    void *level = malloc(size);
+    if (!level) return -1;
+    int err = level_build(level, width, height, bricks, count);
+    if (err == 0 && fwrite(level, 1, size, w->file) != size) err = -1;
+    free(level);
+    if (err != 0) return -1;
+
+    w->entries[w->written].offset = w->offset;
+    w->entries[w->written].size = size;
+    w->written++;
+    if ((uint32_t)count > w->max_bricks) w->max_bricks = (uint32_t)count;
+    if (width < w->min_width) w->min_width = width;
+    w->offset += size;
+    return 0;
+}
+
+static inline int level_pack_finish(LevelPackWriter *w) { // Write the header and table and move the pack into place
+    LevelPackHeader header = { LEVELPACK_MAGIC, LEVELPACK_VERSION, w->written, w->max_bricks, (uint16_t)w->min_width, 0, 0 };
+    int err = w->written == w->level_count ? 0 : -1;
+
+    if (err == 0 && (fseek(w->file, 0, SEEK_SET) != 0 ||
+                     fwrite(&header, sizeof(header), 1, w->file) != 1 ||
+                     fwrite(w->entries, sizeof(LevelEntry), w->level_count, w->file) != w->level_count ||
+                     fflush(w->file) != 0 || fsync(fileno(w->file)) != 0)) {
+        err = -1;
+    }
+    fclose(w->file);
+    free(w->entries);
+
+    if (err == 0 && rename(w->tmp_path, w->path) == 0) return 0;
+    unlink(w->tmp_path);
+    return -1;
+}
+
+#endif
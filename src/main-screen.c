@@ -7,47 +7,148 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
-
-#define MAX_GAMES 100
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "hiscore.h"
+#include "prefetch.h"
+#include "search.h"
+#include "histogram.h"
+#include "realtime.h"
+
+#define MAX_GAMES 1000000 // The catalog grows as needed up to this
 #define MAX_NAME_LEN 256
-
-
+#define MAX_TASKS 16 // Games that can be suspended at the same time
+#define LAUNCH_LOG_FILE "launch-latency.log"
+#define LAUNCH_FD_ENV "VGC_LAUNCH_FD" // Games write a byte here once their first frame is out
+#define LAUNCH_TIMEOUT_MS 5000
+#define REALTIME_PRIORITY 10 // Above ordinary real-time helpers, well below kernel threads
+#define REALTIME_NICE -10 // Fallback when real-time policies are not allowed
+#define REALTIME_CPU_TIME_US 1000000 // A game that runs this long without sleeping is stuck; SIGXCPU stops it
+#define SEARCH_SHOWN 10 // Results listed while searching
+
+// A game started from the menu. Each game runs in its own process group that
+// owns the terminal while it plays; Ctrl+Z stops the group and hands the
+// terminal back to the menu. The game's terminal settings are kept with the
+// task and put back before it is continued.
+typedef struct {
+    pid_t pid; // Also the process group id
+    int game; // Index into games
+    struct termios termios; // Terminal settings the game was using when it stopped
+} Task;
 
 struct termios orig_termios;
-char games[MAX_GAMES][MAX_NAME_LEN];
+struct termios menu_termios; // Raw mode used by the menu itself
+Task tasks[MAX_TASKS];
+int task_count = 0;
+char **games; // File names, game_*
 int game_count = 0;
 int selected_game = 0;
 int selected_button = 0; // 0: Play, 1: Exit
+HiscoreIndex scores; // Leaderboards, refreshed whenever a game returns
+int prefetch_enabled = 1; // --no-prefetch turns the warm-up off to compare launch times
+double last_launch_ms = -1; // Fork to first frame of the last game started
+int last_launch_cached = -1; // How much of its binary was in the page cache, in percent
+int realtime_policy = -1; // --realtime: SCHED_FIFO or SCHED_RR for games, -1 for the normal scheduler
+int game_cpu = -1; // --cpu: CPU reserved for games under --realtime, -1 for none
+int searching = 0; // '/' was pressed and keys go to the search text
+char search_text[SEARCH_MAX_QUERY + 1];
+uint32_t search_results[SEARCH_SHOWN]; // Indices into games, best first
+int search_count = 0;
+int search_selected = 0;
+double search_ms = 0; // Time the last keystroke took to rank
 
 void enable_raw_mode();
 void disable_raw_mode();
 void handle_signal(int sig);
 void scan_games();
+void index_games();
+void search_key(char input);
+void draw_search();
+void bench_search(int count);
+void wait_for_key(int milliseconds);
 void draw_menu();
 void execute_game(char[MAX_NAME_LEN]);
+Task *find_task(int game);
+void take_terminal();
+void wait_for_game(Task *task);
+void close_tasks();
+void evict_games();
+double wait_for_first_frame(int fd, long long start_us);
+void log_launch(const char *game, double latency_ms, int cached);
+void reserve_cpu();
+void setup_realtime();
+long long now_us();
 int kbhit();
 char getch();
 void delay(int milliseconds);
 char* remove_game_prefix(char* input);
 
-int main() {
+int main(int argc, char *argv[]) {
+    int evict = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-prefetch") == 0) {
+            prefetch_enabled = 0;
+        } else if (strcmp(argv[i], "--evict") == 0) {
+            evict = 1; // Start from cold binaries, for measuring launches
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            realtime_policy = SCHED_FIFO;
+            if (i + 1 < argc && strcmp(argv[i + 1], "rr") == 0) realtime_policy = SCHED_RR;
+            if (i + 1 < argc && (strcmp(argv[i + 1], "rr") == 0 || strcmp(argv[i + 1], "fifo") == 0)) i++;
+        } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            game_cpu = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--search-bench") == 0) {
+            bench_search(i + 1 < argc ? atoi(argv[i + 1]) : 100000);
+            return 0;
+        }
+    }
+    if (game_cpu >= 0 && realtime_policy < 0) {
+        fprintf(stderr, "--cpu only applies together with --realtime\n");
+        return 1;
+    }
+    if (realtime_policy >= 0 && game_cpu < 0 && sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+        game_cpu = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1; // The last CPU, which interrupts favour least
+    }
+
     // Set up signal handling
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGTTOU, SIG_IGN); // Needed to take the terminal back from a game
 
     // Enable raw mode for terminal input
     enable_raw_mode();
 
     // Scan for games in the directory
     scan_games();
+    index_games();
+    hiscore_load(&scores);
+    if (evict) evict_games();
+    if (realtime_policy >= 0) reserve_cpu(); // Before the prefetch thread, so it stays off the game's CPU too
+    if (prefetch_enabled) prefetch_start();
 
+    int redraw = 1;
     while (1) {
-        draw_menu();
+        if (game_count > 0) {
+            prefetch_request(games[selected_game]); // Ignored until the selection changes
+        }
+        if (redraw) draw_menu();
+        redraw = 0;
 
         if (kbhit()) {
             char input = getch();
-
-            if (input == 'w' && selected_game > 0) {
+            redraw = 1;
+
+            if (searching) {
+                search_key(input);
+            } else if (input == '/') {
+                searching = 1;
+                search_text[0] = '\0';
+                search_count = 0;
+            } else if (input == 'w' && selected_game > 0) {
                 selected_game--;
             } else if (input == 'w' && selected_game == 0) {
                 selected_game=game_count-1;
@@ -71,10 +172,12 @@ int main() {
             }
         }
 
-        delay(100);
+        if (!kbhit()) wait_for_key(100);
     }
 
     // Restore terminal settings before exiting
+    prefetch_stop();
+    close_tasks();
     disable_raw_mode();
     system("clear");
     return 0;
@@ -87,8 +190,13 @@ void scan_games() { // Scan for games in the current directory
     if (d) {
         while ((dir = readdir(d)) != NULL) {
             if (strncmp(dir->d_name, "game_", 5) == 0) {
-                strncpy(games[game_count], dir->d_name, MAX_NAME_LEN - 1);
-                games[game_count][MAX_NAME_LEN - 1] = '\0';
+                if ((game_count & (game_count - 1)) == 0) { // Double at every power of two
+                    char **grown = realloc(games, (game_count ? 2 * game_count : 16) * sizeof(char *));
+                    if (!grown) break;
+                    games = grown;
+                }
+                games[game_count] = strndup(dir->d_name, MAX_NAME_LEN - 1);
+                if (!games[game_count]) break;
                 game_count++;
                 if (game_count >= MAX_GAMES) break;
             }
@@ -97,19 +205,110 @@ void scan_games() { // Scan for games in the current directory
     }
 }
 
+void index_games() { // Build the search index over the names shown in the menu
+    const char **names = malloc((game_count + 1) * sizeof(char *));
+    if (!names) return;
+    for (int i = 0; i < game_count; i++) names[i] = remove_game_prefix(games[i]);
+    if (search_build(names, game_count) != 0) search_free();
+    free(names);
+}
+
+void search_key(char input) { // Edit the search text or move through the results
+    if (input == 27 && kbhit()) { // Arrow keys arrive as ESC [ A/B
+        if (getch() == '[') input = getch() == 'a' ? 16 : 14;
+        else return;
+    }
+    if (input == 27) { // Esc on its own leaves the search
+        searching = 0;
+        return;
+    }
+    if (input == '\n') {
+        if (search_count > 0) {
+            selected_game = (int)search_results[search_selected];
+            searching = 0;
+            selected_button = 0;
+            execute_game(games[selected_game]);
+        }
+        return;
+    }
+    if (input == '\t' || input == 14) { // Tab or Ctrl+N
+        if (search_count > 0) search_selected = (search_selected + 1) % search_count;
+        return;
+    }
+    if (input == 16) { // Ctrl+P
+        if (search_count > 0) search_selected = (search_selected + search_count - 1) % search_count;
+        return;
+    }
+
+    size_t len = strlen(search_text);
+    if (input == 127 || input == 8) { // Backspace
+        if (len == 0) return;
+        search_text[len - 1] = '\0';
+    } else if (isprint((unsigned char)input) && len < SEARCH_MAX_QUERY) {
+        search_text[len] = input;
+        search_text[len + 1] = '\0';
+    } else {
+        return;
+    }
+
+    long long start = now_us();
+    search_count = search_run(search_text, search_results, SEARCH_SHOWN);
+    search_ms = (now_us() - start) / 1000.0;
+    search_selected = 0;
+}
+
+void draw_search() { // The search line and its best matches
+    printf("  Search: %s_\n\n", search_text);
+    for (int i = 0; i < search_count; i++) {
+        int game = (int)search_results[i];
+        printf("               %s %s%s\n", i == search_selected ? "->" : "  ", remove_game_prefix(games[game]),
+               find_task(game) ? " (suspended)" : "");
+    }
+    if (search_text[0]) {
+        unsigned matches = search.match_count > (uint32_t)search_count ? search.match_count : (unsigned)search_count; // Typo matches are not counted
+        printf("\n  %u match%s in %.3f ms\n", matches, matches == 1 ? "" : "es", search_ms);
+    }
+    printf("\nType to search, Tab/Ctrl+N and Ctrl+P to move, Enter to play, Esc to go back\n");
+}
+
 void draw_menu() { // Draw the main menu
-    system("clear");
+    printf("\033[H\033[J"); // Clear the screen without starting a process for it
     printf("============ Virtual Console Main Menu ============\n");
     printf("\n");
 
+    if (searching) {
+        draw_search();
+        fflush(stdout);
+        return;
+    }
+
     for (int i = 0; i < game_count; i++) {
         if (i == selected_game) {
-            printf("                 -> %s\n", remove_game_prefix(games[i])); // Highlight selected game
+            printf("                 -> %s%s\n", remove_game_prefix(games[i]), find_task(i) ? " (suspended)" : ""); // Highlight selected game
+            int best = hiscore_best(&scores, remove_game_prefix(games[i]));
+            if (best >= 0) {
+                printf("                    Best score: %d\n", best);
+            }
         } 
     }
 
-    printf("\n               [Play] %s  [Exit]\n", selected_button == 0 ? "<-" : "->");
-    printf("\nControls: W/S to navigate games, A/D to switch buttons, Enter to select, Q to quit\n");
+    if (last_launch_ms >= 0) {
+        printf("\n                 Last launch: %.0f ms (%d%% cached%s)\n", last_launch_ms, last_launch_cached,
+               prefetch_enabled ? "" : ", prefetch off");
+    }
+
+    if (task_count > 0) {
+        printf("\n                 Suspended:");
+        for (int i = 0; i < task_count; i++) {
+            printf(" %s", remove_game_prefix(games[tasks[i].game]));
+        }
+        printf("\n");
+    }
+
+    printf("\n               [%s] %s  [Exit]\n", find_task(selected_game) ? "Resume" : "Play", selected_button == 0 ? "<-" : "->");
+    printf("\nControls: W/S to navigate games, A/D to switch buttons, Enter to select, / to search, Q to quit\n");
+    printf("In a game, Ctrl+Z returns here and keeps it suspended\n");
+    fflush(stdout);
 }
 
 char* remove_game_prefix(char input[MAX_NAME_LEN]) {
@@ -121,17 +320,276 @@ char* remove_game_prefix(char input[MAX_NAME_LEN]) {
 }
 
 
+Task *find_task(int game) { // Suspended task of a game, or NULL
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].game == game) return &tasks[i];
+    }
+    return NULL;
+}
+
+void take_terminal() { // Make the menu the foreground job again
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &menu_termios);
+}
+
+void wait_for_game(Task *task) { // Wait until the game stops or exits
+    int status;
+    while (waitpid(task->pid, &status, WUNTRACED) < 0) {
+        if (errno != EINTR) {
+            status = 0; // Lost track of it, treat it as gone
+            break;
+        }
+    }
+
+    if (WIFSTOPPED(status)) {
+        tcgetattr(STDIN_FILENO, &task->termios); // Still the game's settings
+        take_terminal();
+        return;
+    }
+
+    take_terminal();
+    *task = tasks[--task_count];
+    hiscore_load(&scores); // The game may have added new scores
+}
+
 void execute_game(char game_name[MAX_NAME_LEN]) {
+    Task *task = find_task(selected_game);
     system("clear");
+
+    if (task) { // Continue where the player left it
+        printf("Resuming %s...\n", game_name);
+        fflush(stdout);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &task->termios);
+        tcsetpgrp(STDIN_FILENO, task->pid);
+        kill(-task->pid, SIGCONT);
+        wait_for_game(task);
+        return;
+    }
+
+    if (task_count >= MAX_TASKS) {
+        printf("Too many suspended games, resume or quit one first\n");
+        delay(1500);
+        return;
+    }
+
     printf("Launching %s...\n", game_name);
+    fflush(stdout);
     char command[MAX_NAME_LEN + 10];
     snprintf(command, sizeof(command), "./%s", games[selected_game]);
-    disable_raw_mode();
-    system(command); // Execute the selected game
-    enable_raw_mode();
+    disable_raw_mode(); // Games capture the cooked settings to restore on exit
+
+    int cached = prefetch_resident(command);
+    int ready[2] = { -1, -1 };
+    if (pipe(ready) == 0) fcntl(ready[0], F_SETFD, FD_CLOEXEC);
+    long long start_us = now_us();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(ready[0]);
+        close(ready[1]);
+        take_terminal();
+        return;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        tcsetpgrp(STDIN_FILENO, getpid());
+        signal(SIGTTOU, SIG_DFL);
+        if (ready[1] >= 0) {
+            char fd[16];
+            snprintf(fd, sizeof(fd), "%d", ready[1]);
+            setenv(LAUNCH_FD_ENV, fd, 1);
+        }
+        if (realtime_policy >= 0) setup_realtime();
+        execl(command, command, (char *)NULL);
+        _exit(127);
+    }
+    setpgid(pid, pid); // Whichever of parent and child gets here first
+    tcsetpgrp(STDIN_FILENO, pid);
+
+    if (ready[0] >= 0) {
+        close(ready[1]);
+        double latency_ms = wait_for_first_frame(ready[0], start_us);
+        close(ready[0]);
+        if (latency_ms >= 0) {
+            last_launch_ms = latency_ms;
+            last_launch_cached = cached;
+            log_launch(remove_game_prefix(game_name), latency_ms, cached);
+        }
+    }
+
+    task = &tasks[task_count++];
+    task->pid = pid;
+    task->game = selected_game;
+    wait_for_game(task);
+}
+
+void close_tasks() { // Let every suspended game finish; each saves itself on SIGTERM
+    while (task_count > 0) {
+        Task *task = &tasks[task_count - 1];
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &task->termios);
+        tcsetpgrp(STDIN_FILENO, task->pid);
+        kill(-task->pid, SIGTERM);
+        kill(-task->pid, SIGCONT);
+        wait_for_game(task);
+    }
+}
+
+void reserve_cpu() { // Keep the launcher itself off the games' CPU
+    unsigned long mask[16] = { 0 };
+    long got = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+    if (got <= 0 || game_cpu < 0 || game_cpu >= got * 8) return;
+
+    unsigned long bit = 1UL << (game_cpu % (8 * sizeof(unsigned long)));
+    mask[game_cpu / (8 * sizeof(unsigned long))] &= ~bit;
+    for (long i = 0; i < got / (long)sizeof(unsigned long); i++) {
+        if (mask[i]) { // Only when some other CPU is left to run on
+            syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+            return;
+        }
+    }
+}
+
+void setup_realtime() { // In the child before exec: pin to the game CPU and raise its scheduling class
+    if (game_cpu >= 0 && game_cpu < (int)(16 * 8 * sizeof(unsigned long))) {
+        unsigned long mask[16] = { 0 };
+        mask[game_cpu / (8 * sizeof(unsigned long))] = 1UL << (game_cpu % (8 * sizeof(unsigned long)));
+        syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+    }
+
+    // Without root, RLIMIT_RTPRIO says how high we may go; 0 means not at all
+    struct rlimit limit;
+    int priority = REALTIME_PRIORITY;
+    if (geteuid() != 0 && getrlimit(RLIMIT_RTPRIO, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+        limit.rlim_cur < (rlim_t)priority) {
+        priority = (int)limit.rlim_cur;
+    }
+    struct sched_param param = { .sched_priority = priority };
+    if (priority <= 0 || sched_setscheduler(0, realtime_policy, &param) != 0) {
+        setpriority(PRIO_PROCESS, 0, REALTIME_NICE); // Fails quietly without CAP_SYS_NICE, leaving the default
+    } else {
+        struct rlimit cpu_time = { REALTIME_CPU_TIME_US, 2 * REALTIME_CPU_TIME_US };
+        setrlimit(RLIMIT_RTTIME, &cpu_time);
+    }
+    setenv(REALTIME_MLOCK_ENV, "1", 1);
+}
+
+long long now_us() { // Monotonic clock in microseconds
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+double wait_for_first_frame(int fd, long long start_us) { // Milliseconds until the game reports its first frame, -1 if it never does
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int remaining = LAUNCH_TIMEOUT_MS;
+    while (remaining > 0) {
+        int n = poll(&pfd, 1, remaining);
+        if (n < 0 && errno == EINTR) {
+            remaining = LAUNCH_TIMEOUT_MS - (int)((now_us() - start_us) / 1000);
+            continue;
+        }
+        char byte;
+        if (n <= 0 || read(fd, &byte, 1) != 1) return -1; // Timed out, or the game exited first
+        return (now_us() - start_us) / 1000.0;
+    }
+    return -1;
+}
+
+void log_launch(const char *game, double latency_ms, int cached) { // Append one launch to the latency log
+    FILE *log = fopen(LAUNCH_LOG_FILE, "a");
+    if (!log) return;
+    char when[32];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(log, "%s %s latency=%.1fms cached=%d%% prefetch=%s\n", when, game, latency_ms, cached,
+            prefetch_enabled ? "on" : "off");
+    fclose(log);
+}
+
+void evict_games() { // Drop every game binary from the page cache so the next launches are cold
+    for (int i = 0; i < game_count; i++) {
+        int fd = open(games[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+void bench_search(int count) { // Time every keystroke of typing names, and typos of them, over a generated catalog
+    static const char *words[] = { "snake", "breakout", "dinosaur", "tetris", "pong", "space", "invaders", "racer",
+                                   "quest", "dungeon", "puzzle", "kart", "galaxy", "ninja", "pixel", "castle",
+                                   "dragon", "rally", "golf", "chess", "mine", "sweeper", "frog", "jump",
+                                   "star", "fighter", "tower", "defense", "block", "runner", "zombie", "farm" };
+    int word_count = sizeof(words) / sizeof(words[0]);
+    if (count < 1) count = 1;
+    char **names = malloc(count * sizeof(char *));
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < count && names; i++) {
+        char name[MAX_NAME_LEN];
+        int len = 0, parts = 2 + (int)(rng % 2);
+        for (int k = 0; k < parts; k++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            len += snprintf(name + len, sizeof(name) - len, "%s%s", k ? "_" : "", words[rng % word_count]);
+        }
+        snprintf(name + len, sizeof(name) - len, "_%d", i); // Keep names distinct
+        names[i] = strdup(name);
+    }
+
+    long long start = now_us();
+    if (!names || search_build((const char *const *)names, count) != 0) {
+        fprintf(stderr, "Out of memory indexing %d names\n", count);
+        exit(1);
+    }
+    double build_ms = (now_us() - start) / 1000.0;
+
+    Histogram typed, typo; // Nanoseconds per keystroke
+    hist_reset(&typed);
+    hist_reset(&typo);
+    uint32_t results[SEARCH_SHOWN];
+    unsigned long long hits = 0, checksum = 0;
+    for (int q = 0; q < 1000; q++) {
+        uint32_t id = (uint32_t)((size_t)q * 7919 % count);
+        const char *name = names[id];
+        char text[SEARCH_MAX_QUERY + 1];
+        int len = strlen(name);
+        if (len > 16) len = 16;
+        for (int pass = 0; pass < 2; pass++) {
+            memcpy(text, name, len);
+            if (pass == 1 && len > 4) { // Swap two letters in the middle
+                char c = text[len / 2];
+                text[len / 2] = text[len / 2 + 1];
+                text[len / 2 + 1] = c;
+            }
+            search_run("", results, SEARCH_SHOWN);
+            for (int k = 1; k <= len; k++) {
+                char typed_text[SEARCH_MAX_QUERY + 1];
+                memcpy(typed_text, text, k);
+                typed_text[k] = '\0';
+                struct timespec t0, t1;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                int found = search_run(typed_text, results, SEARCH_SHOWN);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                hist_record(pass ? &typo : &typed, (t1.tv_sec - t0.tv_sec) * 1000000000LL + t1.tv_nsec - t0.tv_nsec);
+                for (int r = 0; r < found; r++) checksum = checksum * 31 + results[r];
+                for (int r = 0; r < found && k == len; r++) hits += results[r] == id;
+            }
+        }
+    }
+
+    printf("%d names indexed in %.1f ms\n", count, build_ms);
+    printf("typing:  p50=%.3f ms p99=%.3f ms max=%.3f ms\n", hist_percentile(&typed, 50) / 1e6,
+           hist_percentile(&typed, 99) / 1e6, typed.max / 1e6);
+    printf("typos:   p50=%.3f ms p99=%.3f ms max=%.3f ms\n", hist_percentile(&typo, 50) / 1e6,
+           hist_percentile(&typo, 99) / 1e6, typo.max / 1e6);
+    printf("found: %llu of 2000 names in the top %d checksum=%016llx\n", hits, SEARCH_SHOWN, checksum);
 }
 
 void handle_signal(int sig) {
+    close_tasks();
     disable_raw_mode();
     system("clear");
     exit(0);
@@ -147,6 +605,7 @@ void enable_raw_mode() {
     // Disable canonical mode and echo
     raw.c_lflag &= ~(ICANON | ECHO);
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    menu_termios = raw;
 }
 
 void disable_raw_mode() {
@@ -194,6 +653,11 @@ char getch() { // Read a character from the input
     return tolower(ch);
 }
 
+void wait_for_key(int milliseconds) { // Sleep until a key arrives, at most milliseconds
+    struct pollfd in = { STDIN_FILENO, POLLIN, 0 };
+    poll(&in, 1, milliseconds);
+}
+
 void delay(int milliseconds) { // Delay the program
     usleep(milliseconds * 1000);
 }
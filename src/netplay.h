@@ -0,0 +1,343 @@
+#ifndef VGC_NETPLAY_H
+#define VGC_NETPLAY_H
+
+// Two-player games between two processes on one host, with rollback.
+//
+// The first game started with --versus listens on netplay-<game>.sock and
+// plays as player 1; the second connects and plays as player 2. The host
+// sends its seed and settings and the guest checks them against its own.
+// From then on each side sends one packet per tick with its input for that
+// tick, over a SOCK_SEQPACKET socket that keeps packets whole and in order.
+//
+// Local input is applied on the tick it is read. The peer's input for a
+// tick usually arrives later, so it is predicted to be the last one that
+// did arrive; games encode inputs as held state (a paddle position, a
+// heading) so that this guess is right most of the time. Before every tick
+// the game copies its state into a ring of fixed-size snapshots. When a
+// packet shows that a prediction was wrong, the state of that tick is
+// restored and every tick since is simulated again with the real input,
+// before the current tick runs. The peer's delay only decides how far back
+// a correction reaches; it never holds back the local player's own input.
+//
+// A side runs at most NETPLAY_WINDOW ticks past the last input it has from
+// the peer, which bounds both the snapshot ring and the work of a rollback.
+// Each packet also says how far ahead its sender is; a side that is ahead
+// of its peer skips a tick now and then, so the two stay level and neither
+// does all the rolling back. Every session appends its rollback statistics
+// to netplay.log.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "histogram.h"
+
+#define NETPLAY_MAGIC 0x54454e56u // "VNET"
+#define NETPLAY_VERSION 1
+#define NETPLAY_WINDOW 16 // Ticks a side may run past the peer's last input
+#define NETPLAY_RING 32 // Inputs and snapshots kept, a power of two of at least twice the window
+#define NETPLAY_SETTINGS 4 // Words of game settings both sides must agree on
+#define NETPLAY_SYNC_TICKS 16 // At most one tick in this many is skipped to let the peer catch up
+#define NETPLAY_QUEUE 1024 // Packets waiting to be sent, held back by --net-delay or a full socket
+#define NETPLAY_NO_ROLLBACK UINT32_MAX
+#define NETPLAY_LOG_FILE "netplay.log"
+
+typedef uint16_t NetInput; // 0 means no input yet
+
+typedef struct { // Sent by the host, then echoed back by the guest
+    uint32_t magic, version;
+    char game[16];
+    uint64_t seed;
+    uint32_t settings[NETPLAY_SETTINGS];
+} NetHello;
+
+typedef struct {
+    uint32_t tick;
+    int32_t ahead; // Ticks the sender had simulated past the last input it had from us
+    NetInput input;
+} NetPacket;
+
+typedef struct { // What the game provides; step must depend on nothing but the state and the inputs
+    void (*save)(void *snapshot);
+    void (*load)(const void *snapshot);
+    void (*step)(const NetInput inputs[2]); // Inputs indexed by player
+} NetGame;
+
+typedef struct {
+    NetPacket packet;
+    long long due_us;
+} NetQueued;
+
+typedef struct {
+    int fd;
+    int local, remote; // Player numbers, 0 for the host
+    int connected; // Cleared when the peer goes away
+    char game[16];
+    char path[108]; // Socket the host listens on, unlinked once the guest is in
+    NetGame calls;
+    size_t snapshot_size;
+    unsigned char *snapshots; // Slot t % NETPLAY_RING holds the state before tick t
+    NetInput inputs[NETPLAY_RING][2]; // Inputs tick t was simulated with; the peer's may be a prediction
+
+    uint32_t tick; // Next tick to simulate
+    uint32_t remote_ticks; // Ticks the peer's input has arrived for
+    NetInput remote_last; // The peer's latest input, the prediction for every later tick
+    uint32_t rollback_from; // Earliest tick simulated with a wrong prediction
+    int remote_ahead; // Last lead the peer reported
+    uint32_t last_skip;
+
+    long delay_us; // --net-delay: extra one-way delay for testing
+    NetQueued queue[NETPLAY_QUEUE];
+    unsigned int queue_head, queue_tail;
+
+    long rollbacks, resimulated, stalls, skips;
+    uint32_t deepest; // Most ticks a single rollback simulated again
+    Histogram rollback_us; // Time each rollback took
+} Netplay;
+
+static Netplay netplay;
+
+static inline long long netplay_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static inline unsigned char *netplay_snapshot(uint32_t tick) {
+    return netplay.snapshots + (size_t)(tick & (NETPLAY_RING - 1)) * netplay.snapshot_size;
+}
+
+static inline void netplay_flush() { // Send every queued packet that is due, in order
+    Netplay *n = &netplay;
+    long long now = netplay_now_us();
+    while (n->queue_head != n->queue_tail && n->connected) {
+        NetQueued *q = &n->queue[n->queue_head % NETPLAY_QUEUE];
+        if (q->due_us > now) break;
+        ssize_t sent = send(n->fd, &q->packet, sizeof(q->packet), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && (errno == EAGAIN || errno == EINTR)) break; // Try again next tick
+        if (sent < 0) {
+            n->connected = 0;
+            break;
+        }
+        n->queue_head++;
+    }
+}
+
+static inline void netplay_send(uint32_t tick, NetInput input) {
+    Netplay *n = &netplay;
+    if (n->queue_tail - n->queue_head == NETPLAY_QUEUE) { // The peer stopped reading
+        n->connected = 0;
+        return;
+    }
+    NetQueued *q = &n->queue[n->queue_tail++ % NETPLAY_QUEUE];
+    q->packet.tick = tick;
+    q->packet.ahead = (int32_t)(n->tick - n->remote_ticks);
+    q->packet.input = input;
+    q->due_us = netplay_now_us() + n->delay_us;
+    netplay_flush();
+}
+
+static inline void netplay_receive() { // Take in the peer's packets and note the first wrong prediction
+    Netplay *n = &netplay;
+    NetPacket p;
+    while (n->connected) {
+        ssize_t got = recv(n->fd, &p, sizeof(p), MSG_DONTWAIT);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && errno == EAGAIN) break;
+        if (got != (ssize_t)sizeof(p) || p.tick != n->remote_ticks) { // Gone, or not speaking our protocol
+            n->connected = 0;
+            break;
+        }
+        NetInput *slot = &n->inputs[p.tick & (NETPLAY_RING - 1)][n->remote];
+        if (p.tick < n->tick && *slot != p.input && p.tick < n->rollback_from) n->rollback_from = p.tick;
+        *slot = p.input;
+        n->remote_ticks = p.tick + 1;
+        n->remote_last = p.input;
+        n->remote_ahead = p.ahead;
+    }
+}
+
+static inline void netplay_rollback() { // Go back to the first mispredicted tick and simulate up to now again
+    Netplay *n = &netplay;
+    if (n->rollback_from == NETPLAY_NO_ROLLBACK) return;
+    long long start = netplay_now_us();
+    uint32_t from = n->rollback_from;
+    n->calls.load(netplay_snapshot(from));
+    for (uint32_t t = from; t < n->tick; t++) {
+        NetInput *inputs = n->inputs[t & (NETPLAY_RING - 1)];
+        if (t >= n->remote_ticks) inputs[n->remote] = n->remote_last; // A better guess than before
+        if (t > from) n->calls.save(netplay_snapshot(t));
+        n->calls.step(inputs);
+    }
+    n->rollbacks++;
+    n->resimulated += n->tick - from;
+    if (n->tick - from > n->deepest) n->deepest = n->tick - from;
+    hist_record(&n->rollback_us, netplay_now_us() - start);
+    n->rollback_from = NETPLAY_NO_ROLLBACK;
+}
+
+static inline int netplay_tick(NetInput local) { // Simulate the next tick with this side's input; 0 if it had to wait for the peer
+    Netplay *n = &netplay;
+    netplay_flush();
+    netplay_receive();
+    netplay_rollback();
+    if (!n->connected) return 0;
+
+    int ahead = (int)(n->tick - n->remote_ticks);
+    if (ahead >= NETPLAY_WINDOW) { // Out of snapshots; nothing to do until the peer's input comes in
+        n->stalls++;
+        return 0;
+    }
+    if (ahead - n->remote_ahead >= 2 && n->tick - n->last_skip >= NETPLAY_SYNC_TICKS) {
+        n->skips++;
+        n->last_skip = n->tick;
+        return 0;
+    }
+
+    NetInput *inputs = n->inputs[n->tick & (NETPLAY_RING - 1)];
+    inputs[n->local] = local;
+    if (n->tick >= n->remote_ticks) inputs[n->remote] = n->remote_last;
+    n->calls.save(netplay_snapshot(n->tick));
+    n->calls.step(inputs);
+    netplay_send(n->tick, local);
+    n->tick++;
+    return 1;
+}
+
+static inline void netplay_idle() { // Keep the connection going while no ticks are simulated
+    netplay_flush();
+    netplay_receive();
+    netplay_rollback();
+}
+
+static inline int netplay_confirmed(uint32_t ticks) { // Whether the peer's real input is in for the first ticks ticks
+    return netplay.remote_ticks >= ticks;
+}
+
+static inline void netplay_report() { // Append the session's rollback statistics to the netplay log
+    Netplay *n = &netplay;
+    if (n->tick == 0) return;
+
+    FILE *log = fopen(NETPLAY_LOG_FILE, "a");
+    if (!log) return;
+    char when[32];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(log, "%s %s player=%d delay=%ldms ticks=%u rollbacks=%ld resimulated=%ld deepest=%u rollback p50=%lluus p99=%lluus max=%lluus stalls=%ld skips=%ld\n",
+            when, n->game, n->local + 1, n->delay_us / 1000, n->tick, n->rollbacks, n->resimulated, n->deepest,
+            (unsigned long long)hist_percentile(&n->rollback_us, 50),
+            (unsigned long long)hist_percentile(&n->rollback_us, 99),
+            (unsigned long long)n->rollback_us.max, n->stalls, n->skips);
+    fclose(log);
+}
+
+static inline void netplay_stop() { // Send what is still queued and hang up
+    Netplay *n = &netplay;
+    if (n->fd < 0) return;
+    for (unsigned int i = n->queue_head; i != n->queue_tail; i++) n->queue[i % NETPLAY_QUEUE].due_us = 0;
+    for (int tries = 0; n->queue_head != n->queue_tail && n->connected && tries < 100; tries++) {
+        netplay_flush();
+        if (n->queue_head != n->queue_tail) usleep(1000);
+    }
+    close(n->fd);
+    n->fd = -1;
+    if (n->path[0]) unlink(n->path);
+    netplay_report();
+}
+
+static inline int netplay_hello_matches(const NetHello *a, const NetHello *b) {
+    return a->magic == NETPLAY_MAGIC && a->version == NETPLAY_VERSION && strcmp(a->game, b->game) == 0 &&
+           memcmp(a->settings, b->settings, sizeof(a->settings)) == 0;
+}
+
+// Join the game waiting on netplay-<game>.sock, or host one and wait for the
+// other player. The host's seed replaces *seed on the guest. Fails with
+// EPROTO when the two sides' settings differ.
+static inline int netplay_start(const char *game, uint64_t *seed, const uint32_t settings[NETPLAY_SETTINGS],
+                                const NetGame *calls, size_t snapshot_size, long delay_ms) {
+    Netplay *n = &netplay;
+    NetHello mine, theirs;
+    memset(&mine, 0, sizeof(mine));
+    mine.magic = NETPLAY_MAGIC;
+    mine.version = NETPLAY_VERSION;
+    snprintf(mine.game, sizeof(mine.game), "%s", game);
+    mine.seed = *seed;
+    memcpy(mine.settings, settings, sizeof(mine.settings));
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "netplay-%s.sock", game);
+    snprintf(n->game, sizeof(n->game), "%s", game);
+    n->path[0] = '\0';
+
+    n->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (n->fd < 0) return -1;
+    if (connect(n->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) { // Someone is waiting: join as player 2
+        if (recv(n->fd, &theirs, sizeof(theirs), 0) != (ssize_t)sizeof(theirs)) goto fail;
+        if (!netplay_hello_matches(&theirs, &mine)) {
+            send(n->fd, &theirs, 1, MSG_NOSIGNAL); // A short hello tells the host we refused
+            errno = EPROTO;
+            goto fail;
+        }
+        *seed = theirs.seed;
+        mine.seed = theirs.seed;
+        if (send(n->fd, &mine, sizeof(mine), MSG_NOSIGNAL) != (ssize_t)sizeof(mine)) goto fail;
+        n->local = 1;
+    } else { // Nobody there: host, and wait for player 2
+        close(n->fd);
+        int listener = n->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (listener < 0) return -1;
+        unlink(addr.sun_path); // Left over from a game that crashed
+        if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 1) != 0) goto fail;
+        snprintf(n->path, sizeof(n->path), "%s", addr.sun_path);
+        printf("Waiting for the other player, start ./%s --versus in another terminal\n", game);
+        fflush(stdout);
+        n->fd = accept(listener, NULL, NULL); // A signal gives up waiting
+        int saved = errno;
+        close(listener);
+        unlink(n->path); // The game is full
+        n->path[0] = '\0';
+        if (n->fd < 0) {
+            errno = saved;
+            return -1;
+        }
+        if (send(n->fd, &mine, sizeof(mine), MSG_NOSIGNAL) != (ssize_t)sizeof(mine)) goto fail;
+        ssize_t got = recv(n->fd, &theirs, sizeof(theirs), 0);
+        if (got != (ssize_t)sizeof(theirs) || !netplay_hello_matches(&theirs, &mine)) {
+            if (got >= 0) errno = EPROTO;
+            goto fail;
+        }
+        n->local = 0;
+    }
+    n->remote = 1 - n->local;
+
+    n->snapshot_size = (snapshot_size + 63) & ~(size_t)63;
+    n->snapshots = aligned_alloc(64, n->snapshot_size * NETPLAY_RING);
+    if (!n->snapshots) goto fail;
+    fcntl(n->fd, F_SETFL, fcntl(n->fd, F_GETFL) | O_NONBLOCK);
+    n->calls = *calls;
+    n->connected = 1;
+    n->tick = n->remote_ticks = n->last_skip = 0;
+    n->remote_last = 0;
+    n->rollback_from = NETPLAY_NO_ROLLBACK;
+    n->delay_us = delay_ms * 1000;
+    hist_reset(&n->rollback_us);
+    atexit(netplay_stop);
+    return 0;
+
+fail:;
+    int saved = errno;
+    close(n->fd);
+    n->fd = -1;
+    errno = saved;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef VGC_PREFETCH_H
+#define VGC_PREFETCH_H
+
+// Background warm-up of the game the launcher has highlighted.
+//
+// While the player browses, a worker thread pulls the highlighted binary,
+// its ELF interpreter and the shared libraries it needs into the page cache,
+// so the first launch after boot does not stall on the loop-mounted image.
+// A selection has to stay put for PREFETCH_SETTLE_MS before any I/O starts,
+// reads go out in PREFETCH_CHUNK pieces paced to PREFETCH_RATE, and a new
+// selection abandons the current one between chunks, so scrolling quickly
+// through the list costs almost nothing. Files already fully cached, as
+// reported by mincore(), are skipped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define PREFETCH_SETTLE_MS 200 // Selection must stay this long before prefetching starts
+#define PREFETCH_CHUNK (256 * 1024)
+#define PREFETCH_RATE (32L << 20) // Bytes per second, at most
+#define PREFETCH_MAX_FILES 16 // The binary plus its interpreter and libraries
+#define PREFETCH_PATH_LEN 256
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    char path[PREFETCH_PATH_LEN]; // Latest request
+    unsigned int generation; // Bumped on every new request
+    int running;
+} Prefetcher;
+
+static Prefetcher prefetcher = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static inline int prefetch_resident(const char *path) { // Percentage of a file that is in the page cache, -1 on error
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) { // Nothing to read, so nothing is missing
+        close(fd);
+        return 100;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = ((size_t)st.st_size + page - 1) / page, cached = 0;
+    unsigned char *vec = malloc(pages);
+    if (vec && mincore(map, (size_t)st.st_size, vec) == 0) {
+        for (size_t i = 0; i < pages; i++) cached += vec[i] & 1;
+    }
+    free(vec);
+    munmap(map, (size_t)st.st_size);
+    return (int)(cached * 100 / pages);
+}
+
+static inline int prefetch_find_library(const char *name, char *out, size_t size) { // Look a DT_NEEDED name up the way the loader usually would
+    static const char *const dirs[] = {
+        "/lib/x86_64-linux-gnu", "/usr/lib/x86_64-linux-gnu", "/lib/aarch64-linux-gnu", "/usr/lib/aarch64-linux-gnu",
+        "/lib64", "/usr/lib64", "/lib", "/usr/lib",
+    };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(out, size, "%s/%s", dirs[i], name);
+        if (access(out, R_OK) == 0) return 0;
+    }
+    return -1;
+}
+
+static inline int prefetch_files(const char *path, char files[][PREFETCH_PATH_LEN], int max) { // The binary followed by the files the loader will open for it
+    int count = 0;
+    snprintf(files[count++], PREFETCH_PATH_LEN, "%s", path);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return count;
+
+    Elf64_Ehdr eh;
+    Elf64_Phdr ph[32];
+    if (pread(fd, &eh, sizeof(eh), 0) != (ssize_t)sizeof(eh) || memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 ||
+        eh.e_ident[EI_CLASS] != ELFCLASS64 || eh.e_phentsize != sizeof(Elf64_Phdr) || eh.e_phnum > 32 ||
+        pread(fd, ph, eh.e_phnum * sizeof(Elf64_Phdr), (off_t)eh.e_phoff) != (ssize_t)(eh.e_phnum * sizeof(Elf64_Phdr))) {
+        close(fd);
+        return count; // Not something we can look into, warm just the file
+    }
+
+    const Elf64_Phdr *dynamic = NULL;
+    for (int i = 0; i < eh.e_phnum; i++) {
+        if (ph[i].p_type == PT_INTERP && count < max && ph[i].p_filesz < PREFETCH_PATH_LEN) {
+            char interp[PREFETCH_PATH_LEN] = "";
+            if (pread(fd, interp, ph[i].p_filesz, (off_t)ph[i].p_offset) == (ssize_t)ph[i].p_filesz) {
+                interp[PREFETCH_PATH_LEN - 1] = '\0';
+                snprintf(files[count++], PREFETCH_PATH_LEN, "%s", interp);
+            }
+        }
+        if (ph[i].p_type == PT_DYNAMIC) dynamic = &ph[i];
+    }
+
+    Elf64_Dyn dyn[64];
+    size_t dyn_count = dynamic ? dynamic->p_filesz / sizeof(Elf64_Dyn) : 0;
+    if (dyn_count > 64) dyn_count = 64;
+    if (dyn_count == 0 || pread(fd, dyn, dyn_count * sizeof(Elf64_Dyn), (off_t)dynamic->p_offset) != (ssize_t)(dyn_count * sizeof(Elf64_Dyn))) {
+        close(fd);
+        return count;
+    }
+
+    // DT_STRTAB is an address; find the file offset of the segment that maps it
+    uint64_t strtab = 0, strtab_offset = 0;
+    for (size_t i = 0; i < dyn_count && dyn[i].d_tag != DT_NULL; i++) {
+        if (dyn[i].d_tag == DT_STRTAB) strtab = dyn[i].d_un.d_ptr;
+    }
+    for (int i = 0; i < eh.e_phnum && strtab; i++) {
+        if (ph[i].p_type == PT_LOAD && strtab >= ph[i].p_vaddr && strtab < ph[i].p_vaddr + ph[i].p_filesz) {
+            strtab_offset = strtab - ph[i].p_vaddr + ph[i].p_offset;
+        }
+    }
+
+    for (size_t i = 0; i < dyn_count && dyn[i].d_tag != DT_NULL && strtab_offset && count < max; i++) {
+        if (dyn[i].d_tag != DT_NEEDED) continue;
+        char name[128] = "";
+        if (pread(fd, name, sizeof(name) - 1, (off_t)(strtab_offset + dyn[i].d_un.d_val)) <= 0) continue;
+        if (prefetch_find_library(name, files[count], PREFETCH_PATH_LEN) == 0) count++;
+    }
+    close(fd);
+    return count;
+}
+
+static inline unsigned int prefetch_generation() {
+    pthread_mutex_lock(&prefetcher.lock);
+    unsigned int generation = prefetcher.generation;
+    pthread_mutex_unlock(&prefetcher.lock);
+    return generation;
+}
+
+static inline void prefetch_warm(const char *path, unsigned int generation) { // Read a file into the page cache at PREFETCH_RATE
+    if (prefetch_resident(path) == 100) return;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+
+    const long chunk_ns = (long)((double)PREFETCH_CHUNK / PREFETCH_RATE * 1e9);
+    for (off_t offset = 0; offset < st.st_size && prefetch_generation() == generation; offset += PREFETCH_CHUNK) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        // readahead() waits for the pages, which is what makes the pacing honest
+        if (syscall(SYS_readahead, fd, offset, (size_t)PREFETCH_CHUNK) != 0) {
+            posix_fadvise(fd, offset, PREFETCH_CHUNK, POSIX_FADV_WILLNEED);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long spent = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+        if (spent < chunk_ns) {
+            struct timespec pause = { 0, chunk_ns - spent };
+            nanosleep(&pause, NULL);
+        }
+    }
+    close(fd);
+}
+
+static inline void *prefetch_worker(void *arg) { // Wait for a selection to settle, then warm it
+    (void)arg;
+    unsigned int done = 0;
+
+    pthread_mutex_lock(&prefetcher.lock);
+    while (prefetcher.running) {
+        if (prefetcher.generation == done) {
+            pthread_cond_wait(&prefetcher.wake, &prefetcher.lock);
+            continue;
+        }
+
+        // Let the selection settle; another request restarts the wait
+        unsigned int generation = prefetcher.generation;
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += PREFETCH_SETTLE_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        while (prefetcher.running && prefetcher.generation == generation &&
+               pthread_cond_timedwait(&prefetcher.wake, &prefetcher.lock, &until) == 0) {
+        }
+        if (!prefetcher.running || prefetcher.generation != generation) continue;
+
+        char path[PREFETCH_PATH_LEN];
+        snprintf(path, sizeof(path), "%s", prefetcher.path);
+        pthread_mutex_unlock(&prefetcher.lock);
+
+        static char files[PREFETCH_MAX_FILES][PREFETCH_PATH_LEN];
+        int count = prefetch_files(path, files, PREFETCH_MAX_FILES);
+        for (int i = 0; i < count && prefetch_generation() == generation; i++) {
+            prefetch_warm(files[i], generation);
+        }
+
+        pthread_mutex_lock(&prefetcher.lock);
+        done = generation;
+    }
+    pthread_mutex_unlock(&prefetcher.lock);
+    return NULL;
+}
+
+static inline void prefetch_request(const char *path) { // Warm path once the selection settles; repeats are free
+    pthread_mutex_lock(&prefetcher.lock);
+    if (prefetcher.running && strcmp(prefetcher.path, path) != 0) {
+        snprintf(prefetcher.path, sizeof(prefetcher.path), "%s", path);
+        prefetcher.generation++;
+        pthread_cond_signal(&prefetcher.wake);
+    }
+    pthread_mutex_unlock(&prefetcher.lock);
+}
+
+static inline void prefetch_stop() { // Abandon any prefetch in progress and stop the worker
+    pthread_mutex_lock(&prefetcher.lock);
+    int running = prefetcher.running;
+    prefetcher.running = 0;
+    prefetcher.generation++;
+    pthread_cond_signal(&prefetcher.wake);
+    pthread_mutex_unlock(&prefetcher.lock);
+    if (running) pthread_join(prefetcher.thread, NULL);
+}
+
+static inline int prefetch_start() { // Start the worker thread
+    prefetcher.running = 1;
+
+    sigset_t all, old; // Signals must reach the launcher's main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&prefetcher.thread, NULL, prefetch_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        prefetcher.running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+#endif
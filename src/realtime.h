@@ -0,0 +1,123 @@
+#ifndef VGC_REALTIME_H
+#define VGC_REALTIME_H
+
+// Tick pacing and jitter accounting for the game loops.
+//
+// Each game sleeps until an absolute deadline on CLOCK_MONOTONIC, so time
+// spent in a tick does not push the next one back, and records how late it
+// woke up. The launcher can give a game a reserved CPU and a real-time
+// policy (see main-screen.c); the game itself locks its memory when the
+// launcher asks for it through VGC_MLOCK, since locks do not survive exec.
+// At exit one line per session goes to jitter.log with the scheduling the
+// game actually ran under and the p50/p99/max lateness of its ticks, so runs
+// with and without --realtime can be compared.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "histogram.h"
+
+#define REALTIME_LOG_FILE "jitter.log"
+#define REALTIME_MLOCK_ENV "VGC_MLOCK"
+#define REALTIME_STALL_US 500000 // Later than this the game was waiting on purpose (game over, paused)
+
+typedef struct {
+    char game[16];
+    long interval_us;
+    long long deadline_us;
+    Histogram lateness; // Microseconds past each deadline
+    long stalls; // Deadlines skipped while the game was blocked
+    const char *locked; // "all", "current" or "no"
+} Realtime;
+
+static Realtime realtime;
+
+static inline long long realtime_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static inline void realtime_wait() { // Sleep until the next tick and record how late it came
+    Realtime *rt = &realtime;
+    struct timespec until = { rt->deadline_us / 1000000, (rt->deadline_us % 1000000) * 1000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+
+    long long now = realtime_now_us();
+    long long late = now - rt->deadline_us;
+    if (late > REALTIME_STALL_US) { // Start over from now rather than rushing to catch up
+        rt->stalls++;
+        rt->deadline_us = now + rt->interval_us;
+        return;
+    }
+    hist_record(&rt->lateness, late > 0 ? late : 0);
+    rt->deadline_us += rt->interval_us;
+    if (rt->deadline_us < now) rt->deadline_us = now; // Overran a whole tick, do not burst
+}
+
+static inline void realtime_schedule(char *out, size_t size) { // Describe the policy, priority and CPUs this process runs with
+    int policy = sched_getscheduler(0);
+    struct sched_param param;
+    sched_getparam(0, &param);
+
+    unsigned long mask[16] = { 0 };
+    int cpus = 0;
+    long got = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+    for (long i = 0; i < got / (long)sizeof(unsigned long); i++) cpus += __builtin_popcountl(mask[i]);
+
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        snprintf(out, size, "%s:%d cpus=%d", policy == SCHED_FIFO ? "fifo" : "rr", param.sched_priority, cpus);
+    } else {
+        snprintf(out, size, "other nice=%d cpus=%d", getpriority(PRIO_PROCESS, 0), cpus);
+    }
+}
+
+static inline void realtime_report() { // Append the session's tick lateness to the jitter log
+    Realtime *rt = &realtime;
+    if (rt->lateness.total == 0) return;
+
+    FILE *log = fopen(REALTIME_LOG_FILE, "a");
+    if (!log) return;
+    char when[32], schedule[64];
+    time_t now = time(NULL);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    realtime_schedule(schedule, sizeof(schedule));
+    fprintf(log, "%s %s tick=%ldus %s mlock=%s ticks=%llu late p50=%lluus p99=%lluus max=%lluus stalls=%ld\n",
+            when, rt->game, rt->interval_us, schedule, rt->locked, (unsigned long long)rt->lateness.total,
+            (unsigned long long)hist_percentile(&rt->lateness, 50),
+            (unsigned long long)hist_percentile(&rt->lateness, 99),
+            (unsigned long long)rt->lateness.max, rt->stalls);
+    fclose(log);
+}
+
+static inline void realtime_start(const char *game, long interval_us) { // Pace ticks every interval_us; call once the game's threads are running
+    Realtime *rt = &realtime;
+    snprintf(rt->game, sizeof(rt->game), "%s", game);
+    rt->interval_us = interval_us;
+    rt->locked = "no";
+
+    if (getenv(REALTIME_MLOCK_ENV)) {
+        // Locking future mappings too is only safe when the limit cannot make them fail
+        struct rlimit limit;
+        int unlimited = geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY);
+        if (unlimited && mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+            rt->locked = "all";
+        } else if (mlockall(MCL_CURRENT) == 0) {
+            rt->locked = "current";
+        }
+        unsetenv(REALTIME_MLOCK_ENV);
+    }
+
+    rt->deadline_us = realtime_now_us() + interval_us;
+    atexit(realtime_report);
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef VGC_RENDER_H
+#define VGC_RENDER_H
+
+// Render thread fed through a lock-free triple buffer.
+//
+// The simulation fills the back slot with an immutable snapshot of whatever
+// the game needs to draw and publishes it; the render thread always picks up
+// the most recent snapshot and does all terminal output. Publishing is a
+// single atomic exchange, so a slow tty only makes the renderer skip
+// snapshots and never delays the next simulation tick.
+//
+// The render thread also paces itself to the terminal. It times every flush,
+// waits for the tty output queue (TIOCOUTQ) to drain before drawing again and
+// keeps the redraw interval at RENDER_HEADROOM times the smoothed cost of
+// getting a frame out. On a slow link this lowers the frame rate instead of
+// letting output, and with it input lag, pile up; since the newest snapshot
+// is taken only after the wait, intermediate frames are coalesced away.
+//
+// A game stopped from the launcher (Ctrl+Z) comes back to a screen someone
+// else has drawn on; on SIGCONT the render thread repaints the last snapshot
+// in full without waiting for the next one.
+//
+// With --check-frames the renderer runs in lockstep instead: publishing waits
+// until the snapshot has been drawn, and there is no pacing, so every tick
+// produces exactly one frame and the frames do not depend on timing.
+//
+// When started from the launcher, the first frame that reaches the terminal
+// is reported back on the descriptor named by VGC_LAUNCH_FD, which is how the
+// launcher times a cold start.
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include "histogram.h"
+#include "compositor.h"
+#include "trace.h"
+
+#define TRIBUF_FRESH 4u // Set in the middle index when it holds an unread snapshot
+#define RENDER_HEADROOM 2 // Redraw interval as a multiple of the measured output cost
+#define RENDER_MAX_INTERVAL_US 250000L // Never drop below 4 FPS
+#define RENDER_OUTQ_LIMIT 512 // Bytes allowed to sit in the tty queue before drawing again
+#define RENDER_OUT_BUFFER 65536 // stdout buffer for anything printed outside the compositor
+#define RENDER_STAMP_LEN 256 // Keys in flight between the simulation and the screen
+
+typedef struct {
+    unsigned char *slots;
+    size_t slot_size;
+    atomic_uint middle; // Slot index shared by both sides, plus TRIBUF_FRESH
+    unsigned int back; // Owned by the producer
+    unsigned int front; // Owned by the consumer
+    uint64_t seq[3]; // Publish sequence number of each slot
+    uint64_t published; // Snapshots published so far (producer side)
+} TripleBuffer;
+
+typedef struct { // A key that first shows up in snapshot seq
+    uint64_t seq;
+    long long arrival_us;
+} InputStamp;
+
+typedef void (*RenderFn)(const void *frame);
+
+typedef struct {
+    TripleBuffer buffer;
+    RenderFn draw;
+    pthread_t thread;
+    sem_t ready; // Posted on every publish, wakes the render thread
+    sem_t drawn; // Lockstep: posted once a published snapshot has been drawn
+    int lockstep; // Draw every snapshot, unpaced, before the next one is published
+    atomic_int running;
+    atomic_int repaint; // Set on SIGCONT: redraw everything, even without a new snapshot
+    int launch_fd; // Launcher's first-frame pipe, -1 once reported or if there is none
+
+    long output_us; // Smoothed time to flush a frame and drain the tty queue
+    long interval_us; // Current minimum time between two draws
+    long long next_draw_us;
+    long long second_start_us;
+    int frames_this_second;
+    atomic_int fps; // Frames actually drawn during the last second
+    atomic_int skipped; // Published snapshots that were never drawn
+
+    InputStamp stamps[RENDER_STAMP_LEN]; // SPSC queue: simulation pushes, render thread pops
+    atomic_uint stamp_head, stamp_tail;
+    Histogram input_latency; // Keypress to frame on screen, recorded by the render thread
+} Renderer;
+
+static Renderer renderer;
+
+static inline int tribuf_init(TripleBuffer *tb, size_t slot_size) { // Allocate three zeroed snapshot slots
+    tb->slots = calloc(3, slot_size);
+    if (!tb->slots) return -1;
+    tb->slot_size = slot_size;
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+    return 0;
+}
+
+static inline void *tribuf_back(TripleBuffer *tb) { // Slot the producer may write the next snapshot into
+    return tb->slots + tb->back * tb->slot_size;
+}
+
+static inline void tribuf_publish(TripleBuffer *tb) { // Hand the back slot over and take the old middle one
+    tb->seq[tb->back] = ++tb->published;
+    unsigned int old = atomic_exchange_explicit(&tb->middle, tb->back | TRIBUF_FRESH, memory_order_acq_rel);
+    tb->back = old & ~TRIBUF_FRESH;
+}
+
+static inline const void *tribuf_latest(TripleBuffer *tb, int *fresh) { // Newest published snapshot, swapped in if there is one
+    *fresh = (atomic_load_explicit(&tb->middle, memory_order_acquire) & TRIBUF_FRESH) != 0;
+    if (*fresh) {
+        unsigned int old = atomic_exchange_explicit(&tb->middle, tb->front, memory_order_acq_rel);
+        tb->front = old & ~TRIBUF_FRESH;
+    }
+    return tb->slots + tb->front * tb->slot_size;
+}
+
+static inline long long render_now_us() { // Monotonic clock in microseconds
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static inline int render_outq() { // Bytes still waiting in the terminal's output queue
+    int pending = 0;
+    if (ioctl(STDOUT_FILENO, TIOCOUTQ, &pending) != 0) return 0; // Not a tty
+    return pending;
+}
+
+static inline void render_pace(Renderer *r) { // Wait until the terminal can take another frame
+    TRACE_SCOPE("pace");
+    long long now = render_now_us();
+    if (now < r->next_draw_us) {
+        usleep((useconds_t)(r->next_draw_us - now));
+    }
+
+    long long deadline = render_now_us() + RENDER_MAX_INTERVAL_US;
+    while (render_outq() > RENDER_OUTQ_LIMIT && render_now_us() < deadline && atomic_load(&r->running)) {
+        usleep(1000);
+    }
+}
+
+static inline void render_account(Renderer *r, long long start_us) { // Update pacing and FPS after a draw
+    long long end = render_now_us();
+
+    // Output that is still queued in the tty counts against this frame too
+    int pending = render_outq();
+    long long drain_deadline = end + RENDER_MAX_INTERVAL_US;
+    while (pending > RENDER_OUTQ_LIMIT && end < drain_deadline) {
+        usleep(1000);
+        pending = render_outq();
+        end = render_now_us();
+    }
+
+    long cost = (long)(end - start_us);
+    r->output_us = r->output_us ? (r->output_us * 7 + cost) / 8 : cost;
+    r->interval_us = r->output_us * RENDER_HEADROOM;
+    if (r->interval_us > RENDER_MAX_INTERVAL_US) r->interval_us = RENDER_MAX_INTERVAL_US;
+    r->next_draw_us = start_us + r->interval_us;
+
+    r->frames_this_second++;
+    if (end - r->second_start_us >= 1000000) {
+        atomic_store(&r->fps, r->frames_this_second);
+        r->frames_this_second = 0;
+        r->second_start_us = end;
+    }
+}
+
+static inline void *render_thread(void *arg) { // Draw the latest snapshot whenever one is published
+    Renderer *r = arg;
+    r->second_start_us = render_now_us();
+    trace_name_thread("render");
+
+    while (1) {
+        sem_wait(&r->ready);
+        if (!r->lockstep) render_pace(r);
+        int wakeups = 0;
+        while (sem_trywait(&r->ready) == 0) {
+            wakeups++; // Every extra wakeup is a snapshot superseded by a newer one
+        }
+        if (!atomic_load(&r->running)) break;
+
+        int fresh;
+        const void *frame = tribuf_latest(&r->buffer, &fresh);
+        int published = fresh;
+        atomic_fetch_add(&r->skipped, wakeups);
+        if (atomic_exchange(&r->repaint, 0) && r->buffer.seq[r->buffer.front]) {
+            comp_invalidate();
+            fresh = 1;
+        }
+        if (fresh) {
+            long long start = render_now_us();
+            {
+                TRACE_SCOPE("draw");
+                r->draw(frame);
+            }
+            if (!r->lockstep) render_account(r, start);
+            if (r->launch_fd >= 0) {
+                ssize_t sent = write(r->launch_fd, "", 1);
+                (void)sent; // The launcher may have stopped listening
+                close(r->launch_fd);
+                r->launch_fd = -1;
+            }
+
+            // Every key applied up to this snapshot, including skipped ones, is now on screen
+            uint64_t seq = r->buffer.seq[r->buffer.front];
+            unsigned int tail = atomic_load_explicit(&r->stamp_tail, memory_order_relaxed);
+            unsigned int head = atomic_load_explicit(&r->stamp_head, memory_order_acquire);
+            long long now = render_now_us();
+            while (tail != head && r->stamps[tail % RENDER_STAMP_LEN].seq <= seq) {
+                hist_record(&r->input_latency, now - r->stamps[tail % RENDER_STAMP_LEN].arrival_us);
+                tail++;
+            }
+            atomic_store_explicit(&r->stamp_tail, tail, memory_order_release);
+        }
+        if (r->lockstep && published) sem_post(&r->drawn);
+    }
+    return NULL;
+}
+
+static inline int render_fps() { // Effective frames per second reaching the terminal; always 0 in lockstep
+    return atomic_load(&renderer.fps);
+}
+
+static inline void render_continue(int sig) { // SIGCONT handler, only async-signal-safe calls
+    (void)sig;
+    atomic_store(&renderer.repaint, 1);
+    sem_post(&renderer.ready);
+}
+
+static inline int render_start(size_t frame_size, RenderFn draw) { // Start the render thread for snapshots of frame_size bytes
+    Renderer *r = &renderer;
+
+    if (tribuf_init(&r->buffer, frame_size) != 0) return -1;
+    r->draw = draw;
+    sem_init(&r->ready, 0, 0);
+    sem_init(&r->drawn, 0, 0);
+    setvbuf(stdout, NULL, _IOFBF, RENDER_OUT_BUFFER); // Batch stray prints; frames go out with one write of their own
+    atomic_store(&r->running, 1);
+
+    const char *launch_fd = getenv("VGC_LAUNCH_FD");
+    r->launch_fd = launch_fd ? atoi(launch_fd) : -1;
+    if (r->launch_fd >= 0) {
+        fcntl(r->launch_fd, F_SETFD, FD_CLOEXEC);
+        unsetenv("VGC_LAUNCH_FD");
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = render_continue;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCONT, &sa, NULL);
+
+    sigset_t all, old; // Keep SIGINT/SIGTERM handlers on the simulation thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&r->thread, NULL, render_thread, r);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (err != 0) {
+        atomic_store(&r->running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void *render_frame() { // Snapshot slot to fill before render_publish()
+    return tribuf_back(&renderer.buffer);
+}
+
+static inline void render_mark_input(long long arrival_us) { // The next snapshot reacts to a key that arrived at arrival_us
+    Renderer *r = &renderer;
+    unsigned int head = atomic_load_explicit(&r->stamp_head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->stamp_tail, memory_order_acquire) >= RENDER_STAMP_LEN) return; // Drop the sample
+
+    r->stamps[head % RENDER_STAMP_LEN].seq = r->buffer.published + 1;
+    r->stamps[head % RENDER_STAMP_LEN].arrival_us = arrival_us;
+    atomic_store_explicit(&r->stamp_head, head + 1, memory_order_release);
+}
+
+static inline void render_publish() { // Make the filled snapshot visible to the render thread
+    Renderer *r = &renderer;
+    tribuf_publish(&r->buffer);
+    sem_post(&r->ready);
+    if (r->lockstep && atomic_load(&r->running)) {
+        while (sem_wait(&r->drawn) != 0) {
+        }
+    }
+}
+
+static inline void render_lockstep() { // Draw every snapshot before the next is published; call before render_start()
+    renderer.lockstep = 1;
+}
+
+static inline void render_stop() { // Finish the frame in progress and stop the render thread
+    Renderer *r = &renderer;
+
+    if (!atomic_exchange(&r->running, 0)) return;
+    sem_post(&r->ready);
+    pthread_join(r->thread, NULL);
+}
+
+#endif
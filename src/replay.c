@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "compositor.h"
+#include "capture.h"
+
+// Play back a capture made with --capture: ./replay <file.vcap>
+// Space pauses, A/D seek 10 seconds back/forward, Q quits
+
+#define SEEK_STEP_MS 10000
+
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    CaptureIndex *blocks;
+    uint32_t block_count;
+    uint32_t length_ms;
+
+    unsigned char *raw; // Decoded current block
+    size_t raw_len, pos;
+    uint32_t block; // Index of the decoded block
+
+    int rows, cols;
+    char text[COMP_OUT_SIZE]; // Message on screen, if showing_text
+    int showing_text;
+    uint32_t shown_ms; // Time on the status line
+} Replay;
+
+struct termios orig_termios;
+Replay replay;
+
+void enable_raw_mode();
+void disable_raw_mode();
+void handle_signal(int sig);
+int kbhit();
+char getch();
+int open_capture(const char *path);
+int load_block(uint32_t block);
+int next_frame_time(uint32_t *time_ms);
+void apply_frame();
+void seek(uint32_t target_ms);
+void show(uint32_t now_ms, int paused);
+long long now_ms();
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture.vcap>\n", argv[0]);
+        return 1;
+    }
+    if (open_capture(argv[1]) != 0) {
+        fprintf(stderr, "Cannot read capture %s\n", argv[1]);
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    enable_raw_mode();
+
+    uint32_t position = replay.blocks[0].start_ms; // Capture time on screen
+    long long anchor = now_ms() - position; // Wall clock time at capture time 0
+    int paused = 0;
+    seek(position);
+    show(position, paused);
+
+    while (1) {
+        if (kbhit()) {
+            char key = getch();
+            if (key == 'q') break;
+            if (key == ' ') {
+                paused = !paused;
+            } else if (key == 'a' || key == 'd') {
+                long target = (long)position + (key == 'd' ? SEEK_STEP_MS : -SEEK_STEP_MS);
+                if (target < 0) target = 0;
+                if (target > (long)replay.length_ms) target = (long)replay.length_ms;
+                position = (uint32_t)target;
+                seek(position);
+            }
+            anchor = now_ms() - position;
+            show(position, paused);
+        }
+
+        if (!paused) {
+            long long at = now_ms() - anchor;
+            position = at < replay.length_ms ? (uint32_t)at : replay.length_ms;
+
+            uint32_t due;
+            int changed = 0;
+            while (next_frame_time(&due) && due <= position) {
+                apply_frame();
+                changed = 1;
+            }
+            if (position >= replay.length_ms) paused = 1;
+            if (changed || paused || position / 1000 != replay.shown_ms / 1000) show(position, paused);
+        }
+        usleep(10000);
+    }
+
+    disable_raw_mode();
+    printf("\033[H\033[J");
+    return 0;
+}
+
+int open_capture(const char *path) { // Map the file and find its blocks, from the index or by walking them
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CaptureHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const CaptureHeader *header = map;
+    if (header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION) return -1;
+    replay.base = map;
+    replay.size = (size_t)st.st_size;
+    replay.blocks = malloc(CAPTURE_MAX_BLOCKS * sizeof(CaptureIndex));
+    replay.raw = malloc(CAPTURE_BLOCK_RAW);
+    if (!replay.blocks || !replay.raw) return -1;
+
+    CaptureTrailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    if (replay.size >= sizeof(CaptureHeader) + sizeof(trailer)) {
+        memcpy(&trailer, replay.base + replay.size - sizeof(trailer), sizeof(trailer));
+    }
+    if (trailer.magic == CAPTURE_INDEX_MAGIC && trailer.count > 0 && trailer.count <= CAPTURE_MAX_BLOCKS &&
+        trailer.index_offset + (uint64_t)trailer.count * sizeof(CaptureIndex) + sizeof(trailer) == replay.size) {
+        memcpy(replay.blocks, replay.base + trailer.index_offset, trailer.count * sizeof(CaptureIndex));
+        replay.block_count = trailer.count;
+    } else { // No index, the game did not exit cleanly
+        uint64_t offset = sizeof(CaptureHeader);
+        while (offset + sizeof(CaptureBlock) <= replay.size && replay.block_count < CAPTURE_MAX_BLOCKS) {
+            CaptureBlock block;
+            memcpy(&block, replay.base + offset, sizeof(block));
+            if (block.magic != CAPTURE_BLOCK_MAGIC || block.packed_size > replay.size - offset - sizeof(block)) break;
+            replay.blocks[replay.block_count++] = (CaptureIndex){ offset, block.start_ms, block.end_ms };
+            offset += sizeof(block) + block.packed_size;
+        }
+    }
+    if (replay.block_count == 0) return -1;
+
+    replay.length_ms = replay.blocks[replay.block_count - 1].end_ms;
+    replay.block = UINT32_MAX;
+    return 0;
+}
+
+int load_block(uint32_t block) { // Decompress a block and rewind to its keyframe; 0 on success
+    if (block >= replay.block_count) return -1;
+    uint64_t offset = replay.blocks[block].offset;
+    CaptureBlock header;
+    if (offset + sizeof(header) > replay.size) return -1;
+    memcpy(&header, replay.base + offset, sizeof(header));
+    if (header.magic != CAPTURE_BLOCK_MAGIC || header.packed_size > replay.size - offset - sizeof(header) ||
+        header.raw_size > CAPTURE_BLOCK_RAW) return -1;
+
+    long got = capture_unpack(replay.base + offset + sizeof(header), header.packed_size, replay.raw, CAPTURE_BLOCK_RAW);
+    if (got != (long)header.raw_size) return -1;
+    replay.raw_len = (size_t)got;
+    replay.pos = 0;
+    replay.block = block;
+    return 0;
+}
+
+int next_frame_time(uint32_t *time_ms) { // Time of the next frame, moving on to the next block if needed; 0 at the end
+    while (replay.block >= replay.block_count || replay.pos + sizeof(CaptureFrame) > replay.raw_len) {
+        uint32_t next = replay.block >= replay.block_count ? 0 : replay.block + 1;
+        if (next >= replay.block_count || load_block(next) != 0) return 0;
+    }
+    CaptureFrame frame;
+    memcpy(&frame, replay.raw + replay.pos, sizeof(frame));
+    *time_ms = frame.time_ms;
+    return 1;
+}
+
+void apply_frame() { // Apply the next frame to the compositor's background layer
+    CaptureFrame frame;
+    memcpy(&frame, replay.raw + replay.pos, sizeof(frame));
+    const unsigned char *payload = replay.raw + replay.pos + sizeof(frame);
+    size_t left = replay.raw_len - replay.pos - sizeof(frame);
+    size_t len = frame.type == CAPTURE_KEY ? (left >= 2 ? 2 + (size_t)payload[0] * payload[1] : 2)
+               : frame.type == CAPTURE_DELTA ? 3 * (size_t)frame.count : frame.count;
+    if (len > left) { // Damaged block, skip the rest of it
+        replay.pos = replay.raw_len;
+        return;
+    }
+    replay.pos += sizeof(frame) + len;
+
+    if (frame.type == CAPTURE_KEY) {
+        if (payload[0] != replay.rows || payload[1] != replay.cols) {
+            replay.rows = payload[0];
+            replay.cols = payload[1];
+            comp_init(replay.rows + 1, replay.cols); // One row for the status line
+        }
+        for (int r = 0; r < replay.rows; r++) {
+            for (int c = 0; c < replay.cols; c++) comp_static_put(r, c, payload[2 + r * replay.cols + c]);
+        }
+        comp_seal();
+        replay.showing_text = 0;
+    } else if (frame.type == CAPTURE_DELTA) {
+        for (size_t i = 0; i < frame.count; i++) {
+            const unsigned char *cell = payload + 3 * i;
+            comp_static_change(cell[0], cell[1], cell[2]);
+        }
+        if (compositor.cell_count[compositor.current] >= COMP_MAX_CELLS) comp_invalidate(); // Too many to track
+        if (replay.showing_text) comp_invalidate(); // The board replaces the message
+        replay.showing_text = 0;
+    } else {
+        size_t kept = len < sizeof(replay.text) - 1 ? len : sizeof(replay.text) - 1;
+        memcpy(replay.text, payload, kept);
+        replay.text[kept] = '\0';
+        replay.showing_text = 1;
+    }
+}
+
+void seek(uint32_t target_ms) { // Jump to the last frame at or before target_ms
+    uint32_t block = 0;
+    for (uint32_t lo = 0, hi = replay.block_count; lo < hi;) { // Last block starting at or before the target
+        uint32_t mid = (lo + hi) / 2;
+        if (replay.blocks[mid].start_ms <= target_ms) {
+            block = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (load_block(block) != 0) return;
+
+    uint32_t due;
+    comp_begin();
+    while (next_frame_time(&due) && due <= target_ms) {
+        apply_frame();
+    }
+    comp_invalidate();
+}
+
+void show(uint32_t now_ms, int paused) { // Present the screen with a status line
+    replay.shown_ms = now_ms;
+    if (replay.showing_text) {
+        comp_present_text(replay.text);
+        return;
+    }
+    comp_printf(replay.rows, 0, "%u:%02u/%u:%02u %s", now_ms / 60000, now_ms / 1000 % 60,
+                replay.length_ms / 60000, replay.length_ms / 1000 % 60, paused ? "paused" : "      ");
+    comp_present();
+    comp_begin();
+}
+
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void handle_signal(int sig) {
+    disable_raw_mode();
+    printf("\033[H\033[J");
+    exit(0);
+}
+
+void enable_raw_mode() {
+    struct termios raw;
+
+    // Get current terminal settings
+    tcgetattr(STDIN_FILENO, &orig_termios);
+    raw = orig_termios;
+
+    // Disable canonical mode and echo
+    raw.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+}
+
+void disable_raw_mode() {
+    // Restore original terminal settings
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+}
+
+int kbhit() { // Check if a key has been pressed
+    struct termios oldt, newt;
+    int ch;
+    int oldf;
+
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+    newt.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
+    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
+
+    ch = getchar();
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    fcntl(STDIN_FILENO, F_SETFL, oldf);
+
+    if (ch != EOF) {
+        ungetc(ch, stdin);
+        return 1;
+    }
+
+    return 0;
+}
+
+char getch() { // Read a character from the input
+    struct termios oldt, newt;
+    char ch;
+
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+    newt.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    ch = getchar();
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+
+    return tolower(ch);
+}
@@ -0,0 +1,123 @@
+#ifndef VGC_SAVESTATE_H
+#define VGC_SAVESTATE_H
+
+// Suspend and resume: a game in progress is saved when the player quits or
+// the console stops it, and picked up again on the next launch.
+//
+// Each game keeps the state worth saving in one flat struct with no
+// pointers. A save is a fixed header followed by that struct (or a prefix of
+// it, for games with variable-length tails) written to save-<game>.state in
+// one write and moved into place with rename. Resuming reads the file,
+// checks the header, the game's layout version, the size and a checksum, and
+// copies the payload straight into the game's struct; the file is removed
+// so the same game is never resumed twice.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define SAVESTATE_MAGIC 0x45565356u // "VSVE"
+#define SAVESTATE_FORMAT 1 // Layout of SaveHeader
+#define SAVESTATE_NAME_LEN 16
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    char game[SAVESTATE_NAME_LEN];
+    uint32_t version; // Layout version of the game's state struct
+    uint32_t size; // Payload bytes following the header
+    uint64_t checksum; // FNV-1a of the payload
+    int64_t timestamp;
+} SaveHeader;
+
+static inline uint64_t savestate_checksum(const void *data, size_t size) {
+    const unsigned char *p = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static inline void savestate_path(char *path, size_t size, const char *game) {
+    snprintf(path, size, "save-%s.state", game);
+}
+
+static inline int savestate_write(const char *game, uint32_t version, const void *state, size_t size) { // Save state, replacing any older save of the game
+    SaveHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SAVESTATE_MAGIC;
+    header.format = SAVESTATE_FORMAT;
+    snprintf(header.game, sizeof(header.game), "%s", game);
+    header.version = version;
+    header.size = (uint32_t)size;
+    header.checksum = savestate_checksum(state, size);
+    header.timestamp = (int64_t)time(NULL);
+
+    char path[64], tmp_path[72];
+    savestate_path(path, sizeof(path), game);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    struct iovec iov[2] = { { &header, sizeof(header) }, { (void *)state, size } };
+    ssize_t written = writev(fd, iov, 2);
+    close(fd);
+
+    if (written != (ssize_t)(sizeof(header) + size) || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static inline long savestate_read(const char *game, uint32_t version, void *state, size_t size) { // Restore and remove a save; payload bytes restored, -1 if there is no valid one
+    char path[64];
+    savestate_path(path, sizeof(path), game);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    unlink(path); // Consumed whether or not it turns out to be usable
+
+    SaveHeader header;
+    ssize_t got = read(fd, &header, sizeof(header));
+    long restored = -1;
+    if (got == (ssize_t)sizeof(header) && header.magic == SAVESTATE_MAGIC && header.format == SAVESTATE_FORMAT &&
+        strncmp(header.game, game, sizeof(header.game)) == 0 && header.version == version && header.size <= size &&
+        read(fd, state, header.size) == (ssize_t)header.size &&
+        savestate_checksum(state, header.size) == header.checksum) {
+        restored = (long)header.size;
+    }
+    close(fd);
+    return restored;
+}
+
+static inline void savestate_discard(const char *game) { // Forget a save that no longer applies
+    char path[64];
+    savestate_path(path, sizeof(path), game);
+    unlink(path);
+}
+
+static inline void savestate_hold() { // Defer SIGINT/SIGTERM while the state is being changed
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static inline void savestate_release() { // Let deferred signals in; the state is consistent again
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+}
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef VGC_SEARCH_H
+#define VGC_SEARCH_H
+
+// Type-to-search over the launcher's catalog.
+//
+// Names are folded to lower case once and indexed two ways. A trigram index
+// maps every three-character run to the sorted list of names containing it;
+// a query of three or more characters intersects the lists of its trigrams,
+// shortest first, and confirms each candidate with a substring check. A
+// prefix index holds every word start of every name, sorted by the text
+// from there on. One and two characters match a large part of any catalog,
+// so the ranked results for every such prefix are worked out up front from
+// it. Typing another character only narrows the names containing the query,
+// so while the query grows the previous matches are filtered instead of
+// going back to the index.
+//
+// Results are ranked: the whole name, then a prefix of it, then a prefix of
+// a later word, then anywhere inside, with shorter names first. When fewer
+// than a screenful match exactly, names sharing at least a third of the
+// query's trigrams fill the rest, which catches most typos.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#define SEARCH_MAX_QUERY 64
+#define SEARCH_MAX_RESULTS 32 // Most results a query ranks
+#define SEARCH_WORD_SEPARATORS "_-. "
+
+typedef struct {
+    uint32_t id; // Name
+    uint32_t at; // Offset of the word in the folded name
+} SearchWord;
+
+typedef struct {
+    uint16_t key; // First character << 8, | the second for two-character prefixes
+    uint8_t found;
+    uint32_t count; // Names with a word starting with the prefix
+    uint32_t top[SEARCH_MAX_RESULTS]; // Best first
+} SearchPrefix;
+
+typedef struct {
+    int count;
+    char *folded; // Lower-case names, each NUL-terminated
+    uint32_t *folded_at; // Offset of each name in folded
+    uint16_t *lengths;
+
+    uint32_t *tri_keys; // Sorted trigrams
+    uint32_t *tri_start; // Postings of tri_keys[i] are postings[tri_start[i] .. tri_start[i + 1])
+    uint32_t tri_count;
+    uint32_t *postings; // Name ids, ascending per trigram
+
+    SearchWord *words; // Sorted by the folded text from each word start
+    uint32_t word_count;
+    SearchPrefix *prefixes; // Sorted by key
+    uint32_t prefix_count;
+
+    // Query state
+    char query[SEARCH_MAX_QUERY + 1]; // Query the matches below are for
+    uint32_t *matches; // Every name containing query, if it is 3 characters or more
+    uint32_t match_count; // Names matching query, not counting typos
+    uint32_t *stamp; // Per name: last query generation that saw it
+    uint32_t generation;
+    uint8_t *hits; // Per name: trigrams of the query it contains, for the typo fallback
+    uint32_t *touched; // Names with nonzero hits
+} Search;
+
+static Search search;
+
+static inline int search_word_cmp(const void *a, const void *b) { // Orders word starts by the text that follows
+    const SearchWord *x = a, *y = b;
+    int c = strcmp(search.folded + search.folded_at[x->id] + x->at, search.folded + search.folded_at[y->id] + y->at);
+    return c ? c : (x->id > y->id) - (x->id < y->id);
+}
+
+static inline int search_prefix_cmp(const void *a, const void *b) {
+    const SearchPrefix *x = a, *y = b;
+    return (int)x->key - (int)y->key;
+}
+
+static inline uint32_t search_trigram(const char *s) {
+    return (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+static inline const char *search_name(uint32_t id) { // Folded name
+    return search.folded + search.folded_at[id];
+}
+
+static inline void search_free() {
+    free(search.folded);
+    free(search.folded_at);
+    free(search.lengths);
+    free(search.tri_keys);
+    free(search.tri_start);
+    free(search.postings);
+    free(search.words);
+    free(search.prefixes);
+    free(search.matches);
+    free(search.stamp);
+    free(search.hits);
+    free(search.touched);
+    memset(&search, 0, sizeof(search));
+}
+
+static inline int search_score(uint32_t id, const char *query, int len) { // Rank of a name containing the query; higher is better
+    const char *name = search_name(id);
+    const char *found = strstr(name, query);
+    if (!found) return 0;
+    int base = 1000;
+    if (found == name) base = search.lengths[id] == len ? 4000 : 3000;
+    for (; found && base == 1000; found = strstr(found + 1, query)) { // Prefer a later occurrence that starts a word
+        if (strchr(SEARCH_WORD_SEPARATORS, found[-1])) base = 2000;
+    }
+    return base - (search.lengths[id] < 999 ? search.lengths[id] : 999);
+}
+
+static inline void search_rank(uint32_t id, int score, uint32_t *results, int *scores, int *found, int max) { // Insert into the top max
+    if (*found == max && score <= scores[max - 1]) return;
+    int i = *found < max ? (*found)++ : max - 1;
+    while (i > 0 && (scores[i - 1] < score || (scores[i - 1] == score && results[i - 1] > id))) {
+        results[i] = results[i - 1];
+        scores[i] = scores[i - 1];
+        i--;
+    }
+    results[i] = id;
+    scores[i] = score;
+}
+
+static inline int search_build(const char *const *names, int count) { // Index names; 0 on success
+    Search *s = &search;
+    search_free();
+    s->count = count;
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += strlen(names[i]) + 1;
+    s->folded = malloc(total ? total : 1);
+    s->folded_at = malloc(((size_t)count + 1) * sizeof(uint32_t));
+    s->lengths = malloc(((size_t)count + 1) * sizeof(uint16_t));
+    s->matches = malloc(((size_t)count + 1) * sizeof(uint32_t));
+    s->stamp = calloc((size_t)count + 1, sizeof(uint32_t));
+    s->hits = calloc((size_t)count + 1, 1);
+    s->touched = malloc(((size_t)count + 1) * sizeof(uint32_t));
+    if (!s->folded || !s->folded_at || !s->lengths || !s->matches || !s->stamp || !s->hits || !s->touched) return -1;
+
+    // Fold, and count trigrams and word starts
+    size_t at = 0, pairs = 0, words = 0;
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        if (len > UINT16_MAX) len = UINT16_MAX;
+        s->folded_at[i] = (uint32_t)at;
+        s->lengths[i] = (uint16_t)len;
+        for (size_t k = 0; k < len; k++) {
+            char c = (char)tolower((unsigned char)names[i][k]);
+            s->folded[at + k] = c;
+            if (k == 0 || strchr(SEARCH_WORD_SEPARATORS, s->folded[at + k - 1])) words += !strchr(SEARCH_WORD_SEPARATORS, c);
+        }
+        s->folded[at + len] = '\0';
+        if (len >= 3) pairs += len - 2;
+        at += len + 1;
+    }
+
+    // Trigram postings: a stable counting sort by key in two 12-bit passes keeps ids ascending
+    uint64_t *pair = malloc((pairs ? pairs : 1) * sizeof(uint64_t)), *sorted = malloc((pairs ? pairs : 1) * sizeof(uint64_t));
+    uint32_t *bucket = malloc(4097 * sizeof(uint32_t));
+    s->words = malloc((words ? words : 1) * sizeof(SearchWord));
+    if (!pair || !sorted || !bucket || !s->words) {
+        free(pair);
+        free(sorted);
+        free(bucket);
+        return -1;
+    }
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+        const char *name = search_name((uint32_t)i);
+        for (int k = 0; k + 2 < s->lengths[i]; k++) pair[n++] = (uint64_t)search_trigram(name + k) << 32 | (uint32_t)i;
+    }
+    for (int shift = 32; shift <= 44; shift += 12) {
+        memset(bucket, 0, 4097 * sizeof(uint32_t));
+        for (size_t i = 0; i < n; i++) bucket[((pair[i] >> shift) & 0xfff) + 1]++;
+        for (int b = 0; b < 4096; b++) bucket[b + 1] += bucket[b];
+        for (size_t i = 0; i < n; i++) sorted[bucket[(pair[i] >> shift) & 0xfff]++] = pair[i];
+        uint64_t *swap = pair;
+        pair = sorted;
+        sorted = swap;
+    }
+    free(sorted);
+    free(bucket);
+
+    size_t keys = 0;
+    for (size_t i = 0; i < n; i++) keys += i == 0 || pair[i] >> 32 != pair[i - 1] >> 32;
+    s->tri_keys = malloc((keys ? keys : 1) * sizeof(uint32_t));
+    s->tri_start = malloc((keys + 1) * sizeof(uint32_t));
+    s->postings = malloc((n ? n : 1) * sizeof(uint32_t));
+    if (!s->tri_keys || !s->tri_start || !s->postings) {
+        free(pair);
+        return -1;
+    }
+    size_t posted = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && pair[i] == pair[i - 1]) continue; // Same trigram twice in one name
+        if (i == 0 || pair[i] >> 32 != pair[i - 1] >> 32) {
+            s->tri_keys[s->tri_count] = (uint32_t)(pair[i] >> 32);
+            s->tri_start[s->tri_count++] = (uint32_t)posted;
+        }
+        s->postings[posted++] = (uint32_t)pair[i];
+    }
+    s->tri_start[s->tri_count] = (uint32_t)posted;
+    free(pair);
+
+    // Word starts, sorted by what follows them
+    for (int i = 0; i < count; i++) {
+        const char *name = search_name((uint32_t)i);
+        for (int k = 0; k < s->lengths[i]; k++) {
+            if (strchr(SEARCH_WORD_SEPARATORS, name[k])) continue;
+            if (k == 0 || strchr(SEARCH_WORD_SEPARATORS, name[k - 1])) s->words[s->word_count++] = (SearchWord){ (uint32_t)i, (uint32_t)k };
+        }
+    }
+    qsort(s->words, s->word_count, sizeof(SearchWord), search_word_cmp);
+
+    // Rank every one- and two-character prefix; each is a run of the sorted word starts
+    s->prefixes = malloc(((size_t)s->word_count * 2 + 1) * sizeof(SearchPrefix));
+    if (!s->prefixes) return -1;
+    for (int len = 1; len <= 2; len++) {
+        for (uint32_t i = 0, end; i < s->word_count; i = end) {
+            const char *word = search_name(s->words[i].id) + s->words[i].at;
+            for (end = i + 1; end < s->word_count; end++) {
+                if (strncmp(search_name(s->words[end].id) + s->words[end].at, word, (size_t)len) != 0) break;
+            }
+            if (len == 2 && word[1] == '\0') continue; // A one-letter word has no two-character prefix
+            char prefix[3] = { word[0], len == 2 ? word[1] : '\0', '\0' };
+            SearchPrefix *p = &s->prefixes[s->prefix_count++];
+            p->key = (uint16_t)((unsigned char)prefix[0] << 8 | (unsigned char)prefix[1]);
+            p->count = 0;
+            int scores[SEARCH_MAX_RESULTS], found = 0;
+            s->generation++;
+            for (uint32_t k = i; k < end; k++) {
+                uint32_t id = s->words[k].id;
+                if (s->stamp[id] == s->generation) continue; // Another word of the same name
+                s->stamp[id] = s->generation;
+                p->count++;
+                int score = strncmp(search_name(id), prefix, (size_t)len) == 0 ? (s->lengths[id] == len ? 4000 : 3000) : 2000;
+                search_rank(id, score - (s->lengths[id] < 999 ? s->lengths[id] : 999), p->top, scores, &found, SEARCH_MAX_RESULTS);
+            }
+            p->found = (uint8_t)found;
+        }
+    }
+    qsort(s->prefixes, s->prefix_count, sizeof(SearchPrefix), search_prefix_cmp);
+    s->query[0] = '\0';
+    s->match_count = 0;
+    return 0;
+}
+
+static inline int search_postings(uint32_t key, const uint32_t **list) { // Names containing a trigram
+    uint32_t lo = 0, hi = search.tri_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (search.tri_keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == search.tri_count || search.tri_keys[lo] != key) return 0;
+    *list = search.postings + search.tri_start[lo];
+    return (int)(search.tri_start[lo + 1] - search.tri_start[lo]);
+}
+
+static inline int search_contains(const uint32_t *list, int len, uint32_t id) { // Binary search in a posting list
+    int lo = 0, hi = len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (list[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < len && list[lo] == id;
+}
+
+static inline int search_seek(const uint32_t *list, int len, int *at, uint32_t id) { // Gallop a cursor forward to id; ids must come in ascending order
+    int lo = *at, step = 1;
+    while (lo + step < len && list[lo + step] < id) {
+        lo += step;
+        step *= 2;
+    }
+    int hi = lo + step < len ? lo + step : len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (list[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    *at = lo;
+    return lo < len && list[lo] == id;
+}
+
+static inline int search_exact(const char *query, int len, uint32_t *results, int *scores, int max) { // Rank every name containing the query and keep them in matches
+    Search *s = &search;
+    int found = 0;
+    size_t last = strlen(s->query);
+    if (last >= 3 && (size_t)len > last && strncmp(query, s->query, last) == 0) { // Growing: what matches now matched before
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < s->match_count; i++) {
+            uint32_t id = s->matches[i];
+            int score = search_score(id, query, len);
+            if (score == 0) continue;
+            s->matches[kept++] = id;
+            search_rank(id, score, results, scores, &found, max);
+        }
+        s->match_count = kept;
+        return found;
+    }
+
+    // Intersect the trigram lists, walking the shortest and probing the others
+    const uint32_t *lists[SEARCH_MAX_QUERY];
+    int lengths[SEARCH_MAX_QUERY], count = 0;
+    s->match_count = 0;
+    for (int k = 0; k + 2 < len; k++) {
+        lengths[count] = search_postings(search_trigram(query + k), &lists[count]);
+        if (lengths[count] == 0) return 0;
+        if (lengths[count] < lengths[0]) {
+            const uint32_t *list = lists[0];
+            lists[0] = lists[count];
+            lists[count] = list;
+            int length = lengths[0];
+            lengths[0] = lengths[count];
+            lengths[count] = length;
+        }
+        count++;
+    }
+    int at[SEARCH_MAX_QUERY] = { 0 };
+    for (int i = 0; i < lengths[0]; i++) {
+        uint32_t id = lists[0][i];
+        int all = 1;
+        for (int k = 1; k < count && all; k++) all = search_seek(lists[k], lengths[k], &at[k], id);
+        int score = all ? search_score(id, query, len) : 0; // Trigrams may be out of order
+        if (score == 0) continue;
+        s->matches[s->match_count++] = id;
+        search_rank(id, score, results, scores, &found, max);
+    }
+    return found;
+}
+
+static inline int search_typos(const char *query, int len, uint32_t *results, int *scores, int found, int max) { // Add names sharing a third of the query's trigrams
+    Search *s = &search;
+    const uint32_t *lists[SEARCH_MAX_QUERY];
+    int lengths[SEARCH_MAX_QUERY], trigrams = len - 2, need = (trigrams + 2) / 3, touched = 0;
+    for (int k = 0; k < trigrams; k++) { // Shortest first
+        const uint32_t *list = NULL;
+        int length = search_postings(search_trigram(query + k), &list), i = k;
+        for (; i > 0 && lengths[i - 1] > length; i--) {
+            lists[i] = lists[i - 1];
+            lengths[i] = lengths[i - 1];
+        }
+        lists[i] = list;
+        lengths[i] = length;
+    }
+
+    // A name missing from all of the shortest trigrams - need + 1 lists cannot reach need,
+    // so only those lists are walked and the longer ones are probed for names already seen
+    int walked = trigrams - need + 1;
+    for (int k = 0; k < trigrams; k++) {
+        if (k < walked) {
+            for (int i = 0; i < lengths[k]; i++) {
+                if (s->hits[lists[k][i]]++ == 0) s->touched[touched++] = lists[k][i];
+            }
+        } else if ((long)touched * 16 < lengths[k]) {
+            for (int i = 0; i < touched; i++) s->hits[s->touched[i]] += search_contains(lists[k], lengths[k], s->touched[i]);
+        } else {
+            for (int i = 0; i < lengths[k]; i++) s->hits[lists[k][i]] += s->hits[lists[k][i]] > 0;
+        }
+    }
+    for (int i = 0; i < touched; i++) {
+        uint32_t id = s->touched[i];
+        int hits = s->hits[id];
+        s->hits[id] = 0;
+        if (hits < need || (hits == trigrams && strstr(search_name(id), query))) continue; // Too far off, or already ranked
+        search_rank(id, 500 * hits / trigrams - (s->lengths[id] < 499 ? s->lengths[id] : 499), results, scores, &found, max);
+    }
+    return found;
+}
+
+static inline int search_run(const char *text, uint32_t *results, int max) { // Ranked names for text, at most max; returns how many
+    Search *s = &search;
+    char query[SEARCH_MAX_QUERY + 1];
+    int len = 0;
+    for (; text[len] && len < SEARCH_MAX_QUERY; len++) query[len] = (char)tolower((unsigned char)text[len]);
+    query[len] = '\0';
+    if (max > SEARCH_MAX_RESULTS) max = SEARCH_MAX_RESULTS;
+    if (len == 0 || s->count == 0) {
+        s->query[0] = '\0';
+        s->match_count = 0;
+        return 0;
+    }
+
+    if (len < 3) { // Ranked when the index was built
+        uint16_t key = (uint16_t)((unsigned char)query[0] << 8 | (unsigned char)query[1]);
+        uint32_t lo = 0, hi = s->prefix_count;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (s->prefixes[mid].key < key) lo = mid + 1;
+            else hi = mid;
+        }
+        memcpy(s->query, query, (size_t)len + 1);
+        s->match_count = 0;
+        if (lo == s->prefix_count || s->prefixes[lo].key != key) return 0;
+        int found = s->prefixes[lo].found < max ? s->prefixes[lo].found : max;
+        memcpy(results, s->prefixes[lo].top, (size_t)found * sizeof(uint32_t));
+        s->match_count = s->prefixes[lo].count;
+        return found;
+    }
+
+    int scores[SEARCH_MAX_RESULTS];
+    int found = search_exact(query, len, results, scores, max);
+    memcpy(s->query, query, (size_t)len + 1);
+    if (found < max) found = search_typos(query, len, results, scores, found, max);
+    return found;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef VGC_SESSION_H
+#define VGC_SESSION_H
+
+// Per-session arena for a game's mutable state.
+//
+// A game sizes its session once, from its board dimensions and entity caps,
+// and carves its state out of it with session_alloc() every time a game
+// starts. Starting over is session_reset(): the arena is rewound in O(1) and
+// the same layout is carved again, so retries and restarts never reach the
+// heap. The memory is zeroed only when the session is opened; games set up
+// what they read, and can tag entries with the generation number to tell
+// them apart from the ones an earlier game left behind.
+//
+// Built with -DSESSION_CHECK, every malloc/calloc/realloc is counted per
+// thread, and session_tick() aborts when its thread allocated since its
+// previous tick. Setting up before the first tick after a reset is not
+// counted. That shows the game loops are allocation-free.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SESSION_ALIGN 64 // Every allocation starts on its own cache line
+
+typedef struct {
+    unsigned char *base;
+    size_t size, used;
+    unsigned int generation; // Bumped by every reset
+    unsigned long heap_mark; // SESSION_CHECK: this thread's heap allocations at the last tick
+    int ticking; // A tick has been seen since the last reset
+} Session;
+
+#ifdef SESSION_CHECK
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static _Thread_local unsigned long session_heap_allocs; // Heap allocations made by this thread
+
+void *malloc(size_t size) {
+    session_heap_allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    session_heap_allocs++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    session_heap_allocs++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static inline size_t session_need(size_t size) { // Room an allocation takes in the arena
+    return (size + SESSION_ALIGN - 1) & ~(size_t)(SESSION_ALIGN - 1);
+}
+
+static inline int session_open(Session *s, size_t size) { // The session's only heap allocation, zeroed
+    s->size = session_need(size);
+    s->used = 0;
+    s->generation = 0;
+    s->base = aligned_alloc(SESSION_ALIGN, s->size);
+    if (!s->base) return -1;
+    memset(s->base, 0, s->size);
+    return 0;
+}
+
+static inline void session_close(Session *s) {
+    free(s->base);
+    s->base = NULL;
+}
+
+static inline void *session_alloc(Session *s, size_t size) { // Carve size bytes; the session is sized up front, so running out is a bug
+    size = session_need(size);
+    if (size > s->size - s->used) {
+        fprintf(stderr, "Session of %zu bytes is too small for another %zu\n", s->size, size);
+        abort();
+    }
+    void *p = s->base + s->used;
+    s->used += size;
+    return p;
+}
+
+static inline void session_reset(Session *s) { // Rewind for a new game, O(1)
+    s->used = 0;
+    s->generation++;
+    s->ticking = 0;
+}
+
+static inline void session_tick(Session *s) { // Call once per tick from the thread that plays the session
+#ifdef SESSION_CHECK
+    if (s->ticking && session_heap_allocs != s->heap_mark) {
+        fprintf(stderr, "%lu heap allocations during a tick\n", session_heap_allocs - s->heap_mark);
+        abort();
+    }
+    s->heap_mark = session_heap_allocs;
+#endif
+    s->ticking = 1;
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <termios.h>
 #include <unistd.h>
@@ -7,130 +8,343 @@
 #include <stdbool.h>
 #include <signal.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "hiscore.h"
+#include "render.h"
+#include "compositor.h"
+#include "spectate.h"
+#include "input.h"
+#include "savestate.h"
+#include "framecheck.h"
+#include "capture.h"
+#include "arena.h"
+#include "realtime.h"
+#include "tournament.h"
+#include "session.h"
+#include "trace.h"
+#include "netplay.h"
 
+#ifndef ROWS
 #define ROWS 15
+#endif
+#ifndef COLS
 #define COLS 15
+#endif
+#define CELLS (ROWS * COLS)
+#define BB_WORDS ((CELLS + 63) / 64)
+#define SOAK_DEFAULT_TICKS 1000000L
+#define SAVE_VERSION 1 // Bump when SnakeSave changes
+#define FRAME_BYTE_BUDGET 128 // --check-frames: most bytes a delta frame may take
+#define FRAME_WRITE_BUDGET 1 // Most write() calls a delta frame may take
+#define ARENA_VIEW_ROWS 40 // Corner of the arena shown while watching
+#define ARENA_VIEW_COLS 100
+#define TICK_US 150000 // One move every 150 ms
+#define TOURNAMENT_MAX_TICKS 100000 // Default --max-ticks for a tournament game
+#define VERSUS_POINTS 5 // A versus game ends when a player has this many
+
+typedef enum {
+    MODE_HUMAN,
+    MODE_DEMO, // Attract mode: the autopilot plays until a key is pressed
+    MODE_SOAK, // Unattended run of the autopilot at full speed
+    MODE_ARENA, // Many bot snakes on one large board
+    MODE_VERSUS // Two players, one snake each, over netplay.h
+} PlayMode;
 
 typedef struct {
     int x, y;
 } Point;
 
-Point *snake = NULL;
-int snake_length = 2;
-int snake_capacity;
-Point food;
-char direction = 'a';
+typedef struct { // One bit per board cell, row-major: bit x * COLS + y
+    uint64_t w[BB_WORDS];
+} Bitboard;
+
+typedef struct { // Saved game; only the first length body cells are written
+    int rows, cols;
+    int length;
+    char direction;
+    Point food;
+    Point body[ROWS * COLS];
+} SnakeSave;
+
+typedef struct { // Snapshot of everything draw_board() needs
+    Point body[ROWS * COLS];
+    int length;
+    Point food;
+    int new_game; // Repaint the whole board rather than erase the last game's snake cell by cell
+    char message[64]; // Shown instead of the board when not empty
+} SnakeFrame;
+
+typedef struct { // Snapshot of the arena corner draw_arena() shows
+    char cells[ARENA_VIEW_ROWS][ARENA_VIEW_COLS]; // 0 for an empty cell
+    int rows, cols;
+    long tick;
+    int alive;
+    long deaths;
+    int versus; // Two-player game: cells are two columns wide and the status shows points
+    int points[2]; // Versus: ours, then theirs
+    char message[40]; // Versus: shown after the points
+} ArenaFrame;
+
+// Game state, one copy per thread so tournament workers each play their own
+_Thread_local Session session; // Holds the body, the only state that depends on the board size
+_Thread_local Point *snake = NULL; // ROWS * COLS cells, tail first
+_Thread_local int snake_length = 2;
+_Thread_local Point food;
+_Thread_local char direction = 'a';
+_Thread_local uint64_t food_rng = 1; // Food generator state (xorshift64*), never zero
+_Thread_local int new_game = 1; // Set by initialize_game(), cleared once a frame has carried it
+PlayMode play_mode = MODE_HUMAN;
+int in_play = 1; // 0 while the game over message is up; only a game in play is saved
+volatile sig_atomic_t quit_requested = 0; // Set by SIGINT/SIGTERM, acted on by the game loops
+
+static const char *const snake_policies[] = { "autopilot", "greedy", NULL }; // First is the default
+
+// Autopilot masks, built once by autopilot_init()
+Bitboard board_mask;     // Every cell of the board
+Bitboard not_first_col;  // Cells with y != 0
+Bitboard not_last_col;   // Cells with y != COLS - 1
 
 // Terminal configuration
 struct termios orig_termios;
 
 // Function prototypes
 void initialize_game();
-void draw_board();
+void setup_screen();
+void publish_frame();
+void publish_message(const char *message);
+void draw_board(const void *data);
 void generate_food();
+uint64_t food_random();
 void update_snake(char input);
 bool is_collision(Point next_head);
+bool is_trapped();
+void game_over();
 void wait_for_valid_input();
-int kbhit();
-char getch();
+void autopilot_init();
+char autopilot_direction();
+void run_autopilot(long ticks);
+char greedy_direction();
+void play_tournament_game(uint64_t seed, const TourPolicy *policy, long max_ticks, TourResult *result);
+void run_arena(int snakes, long ticks, int threads, uint64_t seed);
+void publish_arena(const char *message);
+void draw_arena(const void *data);
+void run_versus(uint64_t seed, long delay_ms);
+int versus_points(int player);
+void process_input();
 void delay(int milliseconds);
 void enable_raw_mode();
 void disable_raw_mode();
+void save_game();
+int resume_game();
 void exit_game(int signal);
+void request_quit(int signal);
+void check_quit();
 void setup_signal_handlers();
 
-int main() {
+int main(int argc, char *argv[]) {
+    long soak_ticks = SOAK_DEFAULT_TICKS;
+    int spectate = 0;
+    int check_frames = 0;
+    const char *script = NULL;
+    int capture_frames = 0;
+    int tracing = 0;
+    long net_delay = 0;
+    int arena_snakes = 0, threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    long arena_ticks = 0, tournament_games = 0, max_ticks = TOURNAMENT_MAX_TICKS;
+    uint64_t seed = (uint64_t)time(NULL);
+    const char *policy_spec = snake_policies[0], *out = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--demo") == 0) {
+            play_mode = MODE_DEMO;
+        } else if (strcmp(argv[i], "--soak") == 0) {
+            play_mode = MODE_SOAK;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) soak_ticks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--spectate") == 0) {
+            spectate = 1;
+        } else if (strcmp(argv[i], "--check-frames") == 0) {
+            check_frames = 1;
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script = argv[++i]; // Testing: take keys at the frames the file gives
+        } else if (strcmp(argv[i], "--capture") == 0) {
+            capture_frames = 1;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            tracing = 1;
+        } else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+            play_mode = MODE_ARENA;
+            arena_snakes = atoi(argv[++i]);
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) arena_ticks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--tournament") == 0 && i + 1 < argc) {
+            tournament_games = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            policy_spec = argv[++i];
+        } else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc) {
+            max_ticks = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--versus") == 0) {
+            play_mode = MODE_VERSUS;
+        } else if (strcmp(argv[i], "--net-delay") == 0 && i + 1 < argc) {
+            net_delay = atol(argv[++i]); // Testing: hold every packet back this many milliseconds
+        }
+    }
+    if (tournament_games > 0) { // Headless, nothing touches the terminal
+        TourPolicy policy;
+        if (tour_policy_parse(&policy, policy_spec, snake_policies) != 0) {
+            fprintf(stderr, "Unknown policy %s, snake has autopilot and greedy\n", policy_spec);
+            return 1;
+        }
+        autopilot_init();
+        if (tour_run("snake", &policy, play_tournament_game, tournament_games, threads, seed, max_ticks, out) != 0) {
+            perror("Failed to run the tournament");
+            return 1;
+        }
+        return 0;
+    }
+    if (check_frames) {
+        framecheck_start("snake", FRAME_BYTE_BUDGET, FRAME_WRITE_BUDGET);
+    }
+    if (script && input_script(script) != 0) {
+        return 1;
+    }
+
+    if (tracing && trace_start("snake") != 0) {
+        perror("Failed to start tracing");
+    }
     enable_raw_mode();
     setup_signal_handlers();
+    if (play_mode == MODE_ARENA) {
+        run_arena(arena_snakes > 0 ? arena_snakes : 1, arena_ticks, threads, seed);
+    }
+    if (play_mode == MODE_VERSUS) {
+        run_versus(seed, net_delay);
+    }
+    food_rng = seed | 1;
+    hiscore_open("snake");
     initialize_game();
+    if (play_mode == MODE_HUMAN) {
+        resume_game();
+    }
+    setup_screen();
+    if (spectate && spectate_start("snake") != 0) {
+        perror("Failed to start spectator mode");
+    }
+    if (capture_frames && capture_start("snake") != 0) {
+        perror("Failed to start capture");
+    }
+    render_start(sizeof(SnakeFrame), draw_board);
+    input_start("snake");
+    if (play_mode != MODE_SOAK && !script) { // Scripted runs tick back to back
+        realtime_start("snake", TICK_US);
+    }
 
-    while (1) {
-        draw_board();
+    if (play_mode != MODE_HUMAN) {
+        autopilot_init();
+        run_autopilot(soak_ticks);
+    }
 
-        if (kbhit()) {
-            char input = getch();
-            if (input == 'q') {
-                exit_game(0);
-            }
-            input = tolower(input);
-            if ((input == 'w' && direction != 's') ||
-                (input == 's' && direction != 'w') ||
-                (input == 'a' && direction != 'd') ||
-                (input == 'd' && direction != 'a')) {
-                direction = input;
-            }
+    publish_frame();
+    while (1) {
+        {
+            TRACE_SCOPE("tick");
+            session_tick(&session);
+            process_input();
+            update_snake(direction);
+            publish_frame();
         }
-
-        update_snake(direction);
-        delay(150);
+        realtime_wait();
+        check_quit();
     }
 
     disable_raw_mode();
     return 0;
 }
 
-void initialize_game() { // Initialize the game state
-    snake_capacity = ROWS * COLS;
-    snake = (Point *)malloc(snake_capacity * sizeof(Point));
-    if (!snake) {
+void initialize_game() { // Initialize the game state; restarts reuse the session
+    if (!session.base && session_open(&session, ROWS * COLS * sizeof(Point)) != 0) {
         perror("Failed to allocate memory for snake");
         exit(EXIT_FAILURE);
     }
+    session_reset(&session);
+    snake = session_alloc(&session, ROWS * COLS * sizeof(Point)); // Cells past snake_length are never read
 
     snake_length = 2;
 
-    for (int i = 0; i < snake_capacity; i++) {
-        snake[i].x = -1;
-        snake[i].y = -1;
-    }
-
     snake[0].x = ROWS / 2;
     snake[0].y = COLS / 2;
     snake[1].x = ROWS / 2;
     snake[1].y = (COLS / 2) - 1;
 
     generate_food();
+    new_game = 1;
 }
 
-void draw_board() { // Draw the game state
-    printf("\033[H\033[J");
+void publish_frame() { // Hand the current state to the render thread
+    TRACE_SCOPE("publish_frame");
+    SnakeFrame *frame = render_frame();
+    frame->length = snake_length < ROWS * COLS ? snake_length : ROWS * COLS;
+    memcpy(frame->body, snake, frame->length * sizeof(Point));
+    frame->food = food;
+    frame->new_game = new_game;
+    frame->message[0] = '\0';
+    new_game = 0;
+    render_publish();
+}
 
+void publish_message(const char *message) { // Show a full-screen message instead of the board
+    SnakeFrame *frame = render_frame();
+    frame->length = 0;
+    snprintf(frame->message, sizeof(frame->message), "%s", message);
+    render_publish();
+}
+
+void setup_screen() { // Build the static board layer: one ". " cell per square
+    comp_init(ROWS + 1, COLS * 2);
     for (int i = 0; i < ROWS; i++) {
         for (int j = 0; j < COLS; j++) {
-            int is_snake = 0, is_head = 0;
+            comp_static_put(i, j * 2, '.');
+        }
+    }
+    comp_seal();
+}
 
-            if (snake[snake_length - 1].x == i && snake[snake_length - 1].y == j) {
-                is_head = 1;
-                printf("O ");
-            }
+void draw_board(const void *data) { // Draw a game state snapshot
+    TRACE_SCOPE("draw_board");
+    const SnakeFrame *frame = data;
 
-            if (!is_head) {
-                for (int k = 0; k < snake_length - 1; k++) {
-                    if (snake[k].x == i && snake[k].y == j) {
-                        is_snake = 1;
-                        printf("# ");
-                        break;
-                    }
-                }
-            }
+    if (frame->message[0]) {
+        char text[sizeof(frame->message) + 1];
+        snprintf(text, sizeof(text), "%s\n", frame->message);
+        comp_present_text(text);
+        return;
+    }
+    const Point *head = &frame->body[frame->length - 1];
 
-            if (!is_snake && !is_head) {
-                if (food.x == i && food.y == j) {
-                    printf("X ");
-                } else {
-                    printf(". ");
-                }
-            }
-        }
-        printf("\n");
+    if (frame->new_game) comp_invalidate();
+    comp_begin();
+    comp_put(frame->food.x, frame->food.y * 2, 'X');
+    for (int k = 0; k < frame->length - 1; k++) {
+        comp_put(frame->body[k].x, frame->body[k].y * 2, '#');
     }
+    comp_put(head->x, head->y * 2, 'O');
+    comp_printf(ROWS, 0, "FPS: %d", render_fps());
+    comp_present();
 }
 
 void generate_food() { // Generate food at a random location
-    srand(time(NULL));
+    if (snake_length >= ROWS * COLS) { // Board is full, nowhere left to put food
+        food.x = -1;
+        food.y = -1;
+        return;
+    }
+
     while (1) {
-        food.x = rand() % ROWS;
-        food.y = rand() % COLS;
+        food.x = (int)(food_random() % ROWS);
+        food.y = (int)(food_random() % COLS);
 
         int on_snake = 0;
         for (int i = 0; i < snake_length; i++) {
@@ -144,6 +358,13 @@ void generate_food() { // Generate food at a random location
     }
 }
 
+uint64_t food_random() { // Next number from the food generator (xorshift64*)
+    food_rng ^= food_rng >> 12;
+    food_rng ^= food_rng << 25;
+    food_rng ^= food_rng >> 27;
+    return food_rng * 0x2545F4914F6CDD1DULL;
+}
+
 bool is_collision(Point next_head) { // Check for collision with walls or itself
     if (next_head.x < 0 || next_head.x >= ROWS || next_head.y < 0 || next_head.y >= COLS) {
         return true;
@@ -158,48 +379,96 @@ bool is_collision(Point next_head) { // Check for collision with walls or itself
     return false;
 }
 
+bool is_trapped() { // No direction leads to a free cell, so the game is over
+    static const Point steps[4] = { { -1, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 } };
+    Point head = snake[snake_length - 1];
+    for (int k = 0; k < 4; k++) {
+        if (!is_collision((Point){ head.x + steps[k].x, head.y + steps[k].y })) return false;
+    }
+    return true;
+}
+
+void game_over() { // Score the game, then wait for a retry or an exit
+    in_play = 0;
+    hiscore_submit(snake_length - 2); // Score is the number of foods eaten
+    publish_message("Game Over! Q for exit, R for retry");
+    while (1) {
+        char choice = input_wait_key();
+        check_quit();
+        if (choice == 'q') exit_game(0);
+        if (choice == 'r') break;
+    }
+    initialize_game();
+    direction = 'a';
+    in_play = 1;
+}
+
+void process_input() { // Drain every key typed since the last tick; the latest valid direction wins
+    TRACE_SCOPE("process_input");
+    InputEvent ev;
+    char turn = direction;
+    long long turn_at = 0;
+
+    while (input_poll(&ev)) {
+        if (ev.key == 'q') {
+            exit_game(0);
+        }
+        if ((ev.key == 'w' && direction != 's') ||
+            (ev.key == 's' && direction != 'w') ||
+            (ev.key == 'a' && direction != 'd') ||
+            (ev.key == 'd' && direction != 'a')) {
+            turn = ev.key;
+            turn_at = ev.at_us;
+        }
+    }
+
+    if (turn_at) {
+        direction = turn;
+        render_mark_input(turn_at);
+    }
+}
+
 void wait_for_valid_input() { // Wait for valid input to change direction
     while (1) {
-        if (kbhit()) {
-            char new_input = getch();
-            new_input = tolower(new_input);
-
-            Point new_next_head = snake[snake_length - 1]; // Current head position
-
-            // Determine potential new head position based on input
-            if (new_input == 'w') new_next_head.x--;
-            else if (new_input == 'a') new_next_head.y--;
-            else if (new_input == 's') new_next_head.x++;
-            else if (new_input == 'd') new_next_head.y++;
-            else if (new_input == 'q') exit_game(0);
-
-            // Check if the cell is valid (inside the board and empty)
-            bool is_valid_cell = 
-                new_next_head.x >= 0 && new_next_head.x < ROWS &&
-                new_next_head.y >= 0 && new_next_head.y < COLS;
-
-            if (is_valid_cell) {
-                // Check if the cell is empty (".")
-                bool is_empty_cell = true;
-                for (int i = 0; i < snake_length; i++) {
-                    if (snake[i].x == new_next_head.x && snake[i].y == new_next_head.y) {
-                        is_empty_cell = false;
-                        break;
-                    }
-                }
+        char new_input = input_wait_key();
+        check_quit();
+
+        Point new_next_head = snake[snake_length - 1]; // Current head position
+
+        // Determine potential new head position based on input
+        if (new_input == 'w') new_next_head.x--;
+        else if (new_input == 'a') new_next_head.y--;
+        else if (new_input == 's') new_next_head.x++;
+        else if (new_input == 'd') new_next_head.y++;
+        else if (new_input == 'q') exit_game(0);
+
+        // Check if the cell is valid (inside the board and empty)
+        bool is_valid_cell = 
+            new_next_head.x >= 0 && new_next_head.x < ROWS &&
+            new_next_head.y >= 0 && new_next_head.y < COLS;
 
-                if (is_empty_cell) {
-                    // Set direction and exit
-                    direction = new_input;
+        if (is_valid_cell) {
+            // Check if the cell is empty (".")
+            bool is_empty_cell = true;
+            for (int i = 0; i < snake_length; i++) {
+                if (snake[i].x == new_next_head.x && snake[i].y == new_next_head.y) {
+                    is_empty_cell = false;
                     break;
                 }
             }
+
+            if (is_empty_cell) {
+                // Set direction and exit
+                direction = new_input;
+                break;
+            }
         }
     }
 }
 
 
 void update_snake(char input) { // Update the snake's position
+    TRACE_SCOPE("update_snake");
     Point next_head = snake[snake_length - 1];
 
     if (input == 'w') next_head.x--;
@@ -208,23 +477,19 @@ void update_snake(char input) { // Update the snake's position
     else if (input == 'd') next_head.y++;
 
     if (is_collision(next_head)) {
-        wait_for_valid_input();
+        if (is_trapped()) {
+            game_over();
+        } else {
+            wait_for_valid_input();
+        }
         return;
     }
 
+    savestate_hold(); // A signal now would save a half-moved snake
     bool ate_food = (next_head.x == food.x && next_head.y == food.y);
 
-    if (ate_food) { // Increase snake length and generate new food
-        if (snake_length >= snake_capacity) {
-            snake_capacity *= 2;
-            snake = (Point *)realloc(snake, snake_capacity * sizeof(Point));
-            if (!snake) {
-                perror("Failed to reallocate memory for snake");
-                exit(EXIT_FAILURE);
-            }
-        }
+    if (ate_food) { // Increase snake length; there is never food left to eat on a full board
         snake_length++;
-        generate_food();
     } else {
         for (int i = 0; i < snake_length - 1; i++) {
             snake[i] = snake[i + 1];
@@ -232,44 +497,505 @@ void update_snake(char input) { // Update the snake's position
     }
 
     snake[snake_length - 1] = next_head;
+    if (ate_food) generate_food(); // Only once the head is in place, so the food cannot land under it
+    savestate_release();
 }
 
-int kbhit() { // Check if a key has been pressed
-    struct termios oldt, newt;
-    int ch, oldf;
+// Autopilot
+//
+// The board is kept as bitboards so both searches advance a whole frontier
+// per step with word-wide shifts instead of visiting cells one by one. A BFS
+// from the food gives the distance of every candidate next cell; a flood fill
+// from each candidate checks that the snake still has room (or can reach its
+// tail) after the move. The nearest safe cell wins, otherwise the roomiest.
 
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
+static inline void bb_set(Bitboard *b, int x, int y) {
+    int i = x * COLS + y;
+    b->w[i >> 6] |= 1ULL << (i & 63);
+}
+
+static inline int bb_test(const Bitboard *b, int x, int y) {
+    int i = x * COLS + y;
+    return (b->w[i >> 6] >> (i & 63)) & 1;
+}
 
-    ch = getchar();
+static inline int bb_count(const Bitboard *b) {
+    int n = 0;
+    for (int k = 0; k < BB_WORDS; k++) n += __builtin_popcountll(b->w[k]);
+    return n;
+}
 
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
+static inline void bb_shift_up(Bitboard *out, const Bitboard *in, int n) { // out = in << n (towards higher cells)
+    int words = n >> 6, bits = n & 63;
+    for (int k = BB_WORDS - 1; k >= 0; k--) {
+        uint64_t hi = k - words >= 0 ? in->w[k - words] : 0;
+        uint64_t lo = k - words - 1 >= 0 ? in->w[k - words - 1] : 0;
+        out->w[k] = bits ? (hi << bits) | (lo >> (64 - bits)) : hi;
+    }
+}
 
-    if (ch != EOF) {
-        ungetc(ch, stdin);
-        return 1;
+static inline void bb_shift_down(Bitboard *out, const Bitboard *in, int n) { // out = in >> n (towards lower cells)
+    int words = n >> 6, bits = n & 63;
+    for (int k = 0; k < BB_WORDS; k++) {
+        uint64_t lo = k + words < BB_WORDS ? in->w[k + words] : 0;
+        uint64_t hi = k + words + 1 < BB_WORDS ? in->w[k + words + 1] : 0;
+        out->w[k] = bits ? (lo >> bits) | (hi << (64 - bits)) : lo;
     }
+}
 
-    return 0;
+static void bb_expand(Bitboard *out, const Bitboard *in, const Bitboard *free) { // Cells of free next to any cell of in
+    Bitboard right, left, down, up;
+    bb_shift_up(&right, in, 1);
+    bb_shift_down(&left, in, 1);
+    bb_shift_up(&down, in, COLS);
+    bb_shift_down(&up, in, COLS);
+    for (int k = 0; k < BB_WORDS; k++) {
+        out->w[k] = ((right.w[k] & not_first_col.w[k]) | (left.w[k] & not_last_col.w[k]) |
+                     down.w[k] | up.w[k]) & free->w[k];
+    }
 }
 
-char getch() { // Read a character from the input
-    struct termios oldt, newt;
-    char ch;
+static int flood_fill(const Bitboard *free, Point start, int enough, const Bitboard *goal) { // Size of the region around start, capped at enough
+    Bitboard region = {{0}}, frontier = {{0}}, open = *free, touch;
+    bb_set(&frontier, start.x, start.y);
+    region = frontier;
 
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    ch = getchar();
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    int area = 1;
+    while (area < enough) {
+        if (goal) { // Reaching the tail means the snake can always follow it out
+            bb_expand(&touch, &region, goal);
+            for (int k = 0; k < BB_WORDS; k++) {
+                if (touch.w[k]) return enough;
+            }
+        }
 
-    return tolower(ch);
+        bb_expand(&frontier, &frontier, &open);
+        int grown = 0;
+        for (int k = 0; k < BB_WORDS; k++) {
+            frontier.w[k] &= ~region.w[k];
+            region.w[k] |= frontier.w[k];
+            grown |= frontier.w[k] != 0;
+        }
+        if (!grown) break;
+        area = bb_count(&region);
+    }
+    return area;
+}
+
+void autopilot_init() { // Precompute the board and column masks
+    memset(&board_mask, 0, sizeof(board_mask));
+    memset(&not_first_col, 0, sizeof(not_first_col));
+    memset(&not_last_col, 0, sizeof(not_last_col));
+    for (int x = 0; x < ROWS; x++) {
+        for (int y = 0; y < COLS; y++) {
+            bb_set(&board_mask, x, y);
+            if (y != 0) bb_set(&not_first_col, x, y);
+            if (y != COLS - 1) bb_set(&not_last_col, x, y);
+        }
+    }
+}
+
+char autopilot_direction() { // Pick the direction for the next tick
+    TRACE_SCOPE("autopilot_direction");
+    static const char moves[4] = { 'w', 'a', 's', 'd' };
+    static const int dx[4] = { -1, 0, 1, 0 };
+    static const int dy[4] = { 0, -1, 0, 1 };
+
+    Bitboard free = board_mask;
+    for (int i = 0; i < snake_length; i++) {
+        int c = snake[i].x * COLS + snake[i].y;
+        free.w[c >> 6] &= ~(1ULL << (c & 63));
+    }
+
+    Point head = snake[snake_length - 1];
+    Point next[4];
+    int dist[4], valid[4], candidates = 0;
+    for (int m = 0; m < 4; m++) {
+        next[m].x = head.x + dx[m];
+        next[m].y = head.y + dy[m];
+        valid[m] = next[m].x >= 0 && next[m].x < ROWS && next[m].y >= 0 && next[m].y < COLS &&
+                   bb_test(&free, next[m].x, next[m].y);
+        dist[m] = CELLS + 1;
+        candidates += valid[m];
+    }
+    if (candidates == 0) return direction; // Trapped, any move loses
+
+    // BFS outwards from the food until every candidate cell has a distance
+    if (food.x >= 0) {
+        Bitboard frontier = {{0}}, seen = {{0}}, open = free;
+        bb_set(&frontier, food.x, food.y);
+        seen = frontier;
+        int found = 0;
+        for (int depth = 0; found < candidates; depth++) {
+            for (int m = 0; m < 4; m++) {
+                if (valid[m] && dist[m] > depth && bb_test(&frontier, next[m].x, next[m].y)) {
+                    dist[m] = depth;
+                    found++;
+                }
+            }
+            bb_expand(&frontier, &frontier, &open);
+            int grown = 0;
+            for (int k = 0; k < BB_WORDS; k++) {
+                frontier.w[k] &= ~seen.w[k];
+                seen.w[k] |= frontier.w[k];
+                grown |= frontier.w[k] != 0;
+            }
+            if (!grown) break;
+        }
+    }
+
+    int best = -1, best_area = -1, roomiest = -1;
+    for (int m = 0; m < 4; m++) {
+        if (!valid[m]) continue;
+
+        // Board after the move: head advances, tail leaves unless the food is eaten
+        int eats = next[m].x == food.x && next[m].y == food.y;
+        Bitboard after = free, tail = {{0}};
+        int c = next[m].x * COLS + next[m].y;
+        after.w[c >> 6] &= ~(1ULL << (c & 63));
+        Point tail_cell = eats ? snake[0] : snake[1 < snake_length - 1 ? 1 : 0];
+        if (!eats) {
+            bb_set(&after, snake[0].x, snake[0].y);
+        }
+        bb_set(&tail, tail_cell.x, tail_cell.y);
+
+        int need = snake_length + 1;
+        int area = flood_fill(&after, next[m], need, &tail);
+        if (area >= need && (best < 0 || dist[m] < dist[best])) {
+            best = m;
+        }
+        if (area > best_area) {
+            best_area = area;
+            roomiest = m;
+        }
+    }
+
+    return moves[best >= 0 ? best : roomiest];
+}
+
+void run_autopilot(long ticks) { // Attract mode and soak runs: the autopilot plays instead of the keyboard
+    long games = 1, deaths = 0, stalls = 0, tick = 0, last_growth = 0;
+    int best_length = snake_length, length_before;
+    long long decide_total_us = 0, decide_max_us = 0;
+
+    for (tick = 0; play_mode == MODE_DEMO || tick < ticks; tick++) {
+        check_quit();
+        session_tick(&session);
+        publish_frame();
+
+        InputEvent ev;
+        if (play_mode == MODE_DEMO && input_poll(&ev)) { // Any key ends the demo
+            exit_game(0);
+        }
+
+        long long start = render_now_us();
+        direction = autopilot_direction();
+        long long took = render_now_us() - start;
+        decide_total_us += took;
+        if (took > decide_max_us) decide_max_us = took;
+
+        Point next_head = snake[snake_length - 1];
+        if (direction == 'w') next_head.x--;
+        else if (direction == 'a') next_head.y--;
+        else if (direction == 's') next_head.x++;
+        else if (direction == 'd') next_head.y++;
+
+        int stalled = tick - last_growth > 4L * CELLS; // Circling without reaching the food
+        if (is_collision(next_head) || snake_length >= ROWS * COLS || stalled) { // Game over or board full, start again
+            if (stalled) stalls++;
+            else if (snake_length < ROWS * COLS) deaths++;
+            last_growth = tick;
+            initialize_game();
+            direction = 'a';
+            games++;
+            continue;
+        }
+
+        length_before = snake_length;
+        update_snake(direction);
+        if (snake_length > length_before) last_growth = tick;
+        if (snake_length > best_length) best_length = snake_length;
+
+        if (play_mode == MODE_DEMO) realtime_wait();
+    }
+
+    render_stop();
+    printf("\033[H\033[J");
+    printf("Soak run: %ld ticks, %ld games, %ld deaths, %ld stalls, best length %d\n",
+           tick, games, deaths, stalls, best_length);
+    printf("Autopilot decision: avg %.2f us, max %lld us (tick budget %d us)\n",
+           tick ? (double)decide_total_us / tick : 0.0, decide_max_us, TICK_US);
+    exit_game(0);
+}
+
+// Tournament
+//
+// --tournament N plays N seeded games headless on --threads workers (see
+// tournament.h), with the autopilot or the cheaper greedy policy. Each worker
+// has its own copy of the game state, so games run on the same functions as
+// the keyboard and the attract mode.
+
+char greedy_direction() { // The free neighbour nearest the food, without looking further ahead
+    static const char moves[4] = { 'w', 'a', 's', 'd' };
+    static const int dx[4] = { -1, 0, 1, 0 };
+    static const int dy[4] = { 0, -1, 0, 1 };
+
+    Point head = snake[snake_length - 1];
+    int best = -1, best_distance = 0;
+    for (int m = 0; m < 4; m++) {
+        Point next = { head.x + dx[m], head.y + dy[m] };
+        if (is_collision(next)) continue;
+        int distance = abs(next.x - food.x) + abs(next.y - food.y);
+        if (best < 0 || distance < best_distance) {
+            best = m;
+            best_distance = distance;
+        }
+    }
+    return best >= 0 ? moves[best] : direction;
+}
+
+void play_tournament_game(uint64_t seed, const TourPolicy *policy, long max_ticks, TourResult *result) { // One headless game
+    int greedy = strcmp(policy->name, "greedy") == 0;
+    food_rng = seed;
+    initialize_game();
+    direction = 'a';
+
+    long tick, last_growth = 0;
+    result->outcome = TOUR_CAPPED;
+    for (tick = 0; tick < max_ticks; tick++) {
+        session_tick(&session);
+        if (snake_length >= ROWS * COLS) {
+            result->outcome = TOUR_WON;
+            break;
+        }
+        direction = greedy ? greedy_direction() : autopilot_direction();
+
+        Point next_head = snake[snake_length - 1];
+        if (direction == 'w') next_head.x--;
+        else if (direction == 'a') next_head.y--;
+        else if (direction == 's') next_head.x++;
+        else if (direction == 'd') next_head.y++;
+        if (is_collision(next_head)) {
+            result->outcome = TOUR_LOST;
+            break;
+        }
+        if (tick - last_growth > 4L * CELLS) { // Circling without reaching the food
+            result->outcome = TOUR_STALLED;
+            break;
+        }
+
+        int length_before = snake_length;
+        update_snake(direction);
+        if (snake_length > length_before) last_growth = tick;
+    }
+
+    result->score = (uint32_t)(snake_length - 2);
+    result->ticks = (uint32_t)tick;
+}
+
+// Arena
+//
+// --arena N runs N bot snakes on a board sized for them (see arena.h). With
+// a tick count it runs headless at full speed and reports the cost of a tick;
+// without one it plays at the normal pace and shows the top-left corner.
+
+void publish_arena(const char *message) { // Hand the visible corner of the arena to the render thread
+    ArenaFrame *frame = render_frame();
+    frame->rows = arena.rows < ARENA_VIEW_ROWS ? arena.rows : ARENA_VIEW_ROWS;
+    frame->cols = arena.cols < ARENA_VIEW_COLS ? arena.cols : ARENA_VIEW_COLS;
+    for (int r = 0; r < frame->rows; r++) {
+        for (int c = 0; c < frame->cols; c++) {
+            uint32_t cell = (uint32_t)(r * arena.cols + c), owner = arena.owner[cell];
+            char glyph = 0;
+            int head = owner && owner != ARENA_FOOD && arena_head(&arena, (int)owner - 1) == cell;
+            if (owner == ARENA_FOOD) glyph = 'X';
+            else if (owner && play_mode == MODE_VERSUS && (int)owner - 1 != netplay.local) glyph = head ? '@' : '*';
+            else if (owner) glyph = head ? 'O' : '#';
+            frame->cells[r][c] = glyph;
+        }
+    }
+    frame->tick = arena.tick;
+    frame->deaths = arena.deaths;
+    frame->alive = 0;
+    for (int i = 0; i < arena.count; i++) frame->alive += arena.snakes[i].length != 0;
+    frame->versus = play_mode == MODE_VERSUS;
+    if (frame->versus) {
+        frame->points[0] = versus_points(netplay.local);
+        frame->points[1] = versus_points(netplay.remote);
+    }
+    snprintf(frame->message, sizeof(frame->message), "%s", message);
+    render_publish();
+}
+
+void draw_arena(const void *data) { // Draw an arena snapshot
+    const ArenaFrame *frame = data;
+    int width = frame->versus ? 2 : 1;
+
+    comp_begin();
+    for (int r = 0; r < frame->rows; r++) {
+        for (int c = 0; c < frame->cols; c++) {
+            if (frame->cells[r][c]) comp_put(r, c * width, (Glyph)frame->cells[r][c]);
+        }
+    }
+    if (frame->versus) {
+        comp_printf(frame->rows, 0, "You: %d  Them: %d  FPS: %d  %s", frame->points[0], frame->points[1], render_fps(),
+                    frame->message);
+        comp_present();
+        return;
+    }
+    comp_printf(frame->rows, 0, "Snakes: %d/%d  Tick: %ld  Deaths: %ld  FPS: %d",
+                frame->alive, arena.count, frame->tick, frame->deaths, render_fps());
+    comp_present();
+}
+
+void run_arena(int snakes, long ticks, int threads, uint64_t seed) { // Arena mode: watch the bots, or time ticks headless
+    if (arena_start(snakes, threads, seed) != 0) {
+        perror("Failed to set up the arena");
+        exit_game(0);
+    }
+
+    if (ticks == 0) {
+        int rows = arena.rows < ARENA_VIEW_ROWS ? arena.rows : ARENA_VIEW_ROWS;
+        int cols = arena.cols < ARENA_VIEW_COLS ? arena.cols : ARENA_VIEW_COLS;
+        comp_init(rows + 1, cols);
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) comp_static_put(r, c, '.');
+        }
+        comp_seal();
+        render_start(sizeof(ArenaFrame), draw_arena);
+        input_start("snake");
+
+        while (1) {
+            InputEvent ev;
+            while (input_poll(&ev)) {
+                if (ev.key == 'q') {
+                    arena_stop();
+                    exit_game(0);
+                }
+            }
+            arena_tick();
+            publish_arena("");
+            delay(150);
+            if (quit_requested) {
+                arena_stop();
+                exit_game(0);
+            }
+        }
+    }
+
+    Histogram tick_us;
+    hist_reset(&tick_us);
+    long long start = render_now_us();
+    for (long t = 0; t < ticks && !quit_requested; t++) {
+        long long before = render_now_us();
+        arena_tick();
+        hist_record(&tick_us, render_now_us() - before);
+    }
+    long long took = render_now_us() - start;
+    int used = arena.threads;
+    arena_stop();
+
+    printf("Arena: %d snakes on %dx%d, seed %llu, %d threads, %ld ticks in %.2f s\n",
+           arena.count, arena.rows, arena.cols, (unsigned long long)seed, used, ticks, took / 1e6);
+    printf("Tick: avg %.1f us (%.1f ns per snake), p50 %llu us, p99 %llu us, max %llu us\n",
+           (double)took / ticks, (double)took * 1000 / ticks / arena.count,
+           (unsigned long long)hist_percentile(&tick_us, 50), (unsigned long long)hist_percentile(&tick_us, 99),
+           (unsigned long long)tick_us.max);
+    printf("Deaths %ld, respawns %ld, food eaten %ld, longest snake %d, checksum %016llx\n",
+           arena.deaths, arena.respawns, arena.eaten, arena_longest(), (unsigned long long)arena_checksum());
+    exit_game(0);
+}
+
+// Versus
+//
+// --versus plays two people against each other in a two-snake arena (see
+// netplay.h). Each steers one snake with w/a/s/d; the arena moves both,
+// respawns the one that died and restocks the food. Every death scores a
+// point for the other player, and the first to VERSUS_POINTS wins. An input
+// is a direction plus one, held from tick to tick, so a late packet is
+// predicted by the other snake going on the way it was. The rollback
+// snapshot is the arena itself.
+
+int versus_points(int player) { // The other snake's deaths
+    return (int)arena.snakes[1 - player].deaths;
+}
+
+int versus_over() {
+    return versus_points(0) >= VERSUS_POINTS || versus_points(1) >= VERSUS_POINTS;
+}
+
+void versus_step(const NetInput inputs[2]) { // One arena tick with both players' directions
+    if (versus_over()) return; // The last tick stays on screen
+    for (int p = 0; p < 2; p++) {
+        ArenaSnake *s = &arena.snakes[p];
+        int turn = inputs[p] - 1;
+        if (inputs[p] && inputs[p] <= 4 && turn != ((s->direction + 2) & 3)) s->direction = (uint8_t)turn; // Never back into itself
+    }
+    arena_tick();
+}
+
+void versus_input(int *heading) { // The latest key that does not turn our snake back on itself
+    TRACE_SCOPE("process_input");
+    static const char keys[4] = { 'w', 'a', 's', 'd' }; // In ARENA_UP .. ARENA_RIGHT order
+    InputEvent ev;
+    int current = arena.snakes[netplay.local].direction;
+    long long turn_at = 0;
+
+    while (input_poll(&ev)) {
+        if (ev.key == 'q') exit_game(0);
+        for (int d = 0; d < 4; d++) {
+            if (ev.key == keys[d] && d != ((current + 2) & 3)) {
+                *heading = d;
+                turn_at = ev.at_us;
+            }
+        }
+    }
+    if (turn_at) render_mark_input(turn_at);
+}
+
+void run_versus(uint64_t seed, long delay_ms) { // Versus mode: connect, then play until someone wins or leaves
+    uint32_t settings[NETPLAY_SETTINGS] = { ARENA_MAX_LENGTH, VERSUS_POINTS, TICK_US, 0 };
+    NetGame calls = { arena_save, arena_load, versus_step };
+    if (netplay_start("snake", &seed, settings, &calls, arena_snapshot_size(2), delay_ms) != 0) {
+        check_quit(); // Interrupted while waiting for the other player
+        perror("Failed to start a versus game");
+        exit_game(0);
+    }
+    if (arena_start(2, 1, seed) != 0) { // The host's seed decides where the snakes and the food start
+        perror("Failed to set up the arena");
+        exit_game(0);
+    }
+    arena.snakes[0].steered = arena.snakes[1].steered = 1;
+
+    comp_init(arena.rows + 1, arena.cols * 2);
+    for (int r = 0; r < arena.rows; r++) {
+        for (int c = 0; c < arena.cols; c++) comp_static_put(r, c * 2, '.');
+    }
+    comp_seal();
+    render_start(sizeof(ArenaFrame), draw_arena);
+    input_start("snake");
+    realtime_start("snake", TICK_US);
+
+    int heading = ARENA_RIGHT;
+    while (1) {
+        {
+            TRACE_SCOPE("tick");
+            versus_input(&heading);
+            const char *message = "";
+            if (!netplay.connected) {
+                message = "They left. Q for exit";
+            } else if (versus_over() && netplay_confirmed((uint32_t)arena.tick)) {
+                int mine = versus_points(netplay.local), theirs = versus_points(netplay.remote);
+                message = mine > theirs ? "You win! Q for exit" : mine < theirs ? "You lose. Q for exit" : "Draw. Q for exit";
+                netplay_idle(); // The other side may still need our last inputs
+            } else {
+                netplay_tick((NetInput)(heading + 1));
+            }
+            publish_arena(message);
+        }
+        realtime_wait();
+        check_quit();
+    }
 }
 
 void delay(int milliseconds) {// Delay the program
@@ -290,16 +1016,58 @@ void disable_raw_mode() { // Disable raw mode and restore terminal settings
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
 }
 
+void save_game() { // Save the game in progress for the next launch
+    static SnakeSave save;
+    save.rows = ROWS;
+    save.cols = COLS;
+    save.length = snake_length;
+    save.direction = direction;
+    save.food = food;
+    memcpy(save.body, snake, snake_length * sizeof(Point));
+    savestate_write("snake", SAVE_VERSION, &save, offsetof(SnakeSave, body) + snake_length * sizeof(Point));
+}
+
+int resume_game() { // Continue a saved game if there is one; returns 1 if resumed
+    static SnakeSave save;
+    long size = savestate_read("snake", SAVE_VERSION, &save, sizeof(save));
+    if (size < (long)offsetof(SnakeSave, body) || save.rows != ROWS || save.cols != COLS ||
+        save.length < 2 || save.length > ROWS * COLS ||
+        size != (long)(offsetof(SnakeSave, body) + save.length * sizeof(Point))) {
+        return 0;
+    }
+    for (int i = 0; i < save.length; i++) {
+        if (save.body[i].x < 0 || save.body[i].x >= ROWS || save.body[i].y < 0 || save.body[i].y >= COLS) return 0;
+    }
+
+    snake_length = save.length;
+    direction = save.direction;
+    food = save.food;
+    memcpy(snake, save.body, save.length * sizeof(Point));
+    return 1;
+}
+
 void exit_game(int signal) { // Exit the game
     (void)signal;
+    render_stop();
     disable_raw_mode();
-    free(snake);
+    if (play_mode == MODE_HUMAN && in_play) {
+        save_game(); // Scored when it ends, not when it is put aside
+    }
     exit(0);
 }
 
+void request_quit(int signal) { // SIGINT/SIGTERM: saving and exiting are not async-signal-safe, so only ask for them
+    (void)signal;
+    quit_requested = 1;
+}
+
+void check_quit() { // Exit from the game thread once a signal asked for it
+    if (quit_requested) exit_game(0);
+}
+
 void setup_signal_handlers() { // Set up signal handlers for SIGINT and SIGTERM
     struct sigaction sa;
-    sa.sa_handler = exit_game;
+    sa.sa_handler = request_quit;
     sa.sa_flags = 0;
     sigemptyset(&sa.sa_mask);
 
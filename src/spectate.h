@@ -0,0 +1,234 @@
+#ifndef VGC_SPECTATE_H
+#define VGC_SPECTATE_H
+
+// Spectator fan-out: mirror a running game to any number of local viewers.
+//
+// The game appends every chunk of terminal output it produces to a ring
+// buffer in a memfd, once, no matter how many viewers there are. Viewers
+// connect to spectate-<game>.sock in the storage directory, receive the memfd
+// over SCM_RIGHTS and map it read-only. A viewer copies each record out of
+// the shared pages and checks that the game has not lapped it before writing
+// it to its terminal. Every SPECTATE_KEYFRAME_INTERVAL frames a full repaint
+// is appended as a keyframe. A viewer that joins late, falls a whole ring
+// behind or finds a record overwritten restarts from the newest keyframe. If
+// that keyframe has already been overwritten, it waits for the next one.
+// The game never waits on viewers: after a record it bumps a futex word and
+// issues one wake.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#include "compositor.h"
+
+#define SPECTATE_MAGIC 0x54435053u // "SPCT"
+#define SPECTATE_VERSION 1
+#define SPECTATE_RING_SIZE (1u << 20) // Ring data bytes, a multiple of 8
+#define SPECTATE_MAX_RECORD (SPECTATE_RING_SIZE / 4)
+#define SPECTATE_KEYFRAME_INTERVAL 50 // Frames between keyframes for late joiners
+#define SPECTATE_FLAG_KEYFRAME 1u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity; // Bytes in the data area
+    _Atomic uint64_t head; // Stream bytes written so far; data lives at offset % capacity
+    _Atomic uint64_t keyframe; // Stream offset of the newest keyframe record
+    _Atomic uint32_t frames; // Bumped after every record, viewers futex-wait on it
+    _Atomic uint32_t closed; // Set when the game exits
+} SpectateRing;
+
+typedef struct {
+    uint32_t len; // Payload bytes following the header
+    uint32_t flags;
+} SpectateRecord;
+
+typedef struct {
+    SpectateRing *ring;
+    unsigned char *data;
+    int memfd;
+    int listen_fd;
+    char path[108];
+    pthread_t listener;
+    int frames_since_keyframe;
+    atomic_int viewers; // Viewers that ever attached; no wakeups before the first
+} Spectator;
+
+static Spectator spectator;
+
+static inline uint64_t spectate_pad(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+static inline void spectate_copy_in(uint64_t pos, const void *src, size_t len) { // Copy into the ring, wrapping at the end
+    uint64_t cap = spectator.ring->capacity;
+    uint64_t at = pos % cap;
+    size_t first = len < cap - at ? len : (size_t)(cap - at);
+    memcpy(spectator.data + at, src, first);
+    memcpy(spectator.data, (const char *)src + first, len - first);
+}
+
+static inline void spectate_write(const char *bytes, size_t len, int keyframe) { // Append one record to the ring
+    SpectateRing *ring = spectator.ring;
+    if (len + sizeof(SpectateRecord) > SPECTATE_MAX_RECORD) return;
+
+    uint64_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // A viewer that reads the bytes below also sees the head before them
+    SpectateRecord record = { (uint32_t)len, keyframe ? SPECTATE_FLAG_KEYFRAME : 0 };
+    spectate_copy_in(pos, &record, sizeof(record));
+    spectate_copy_in(pos + sizeof(record), bytes, len);
+
+    atomic_store_explicit(&ring->head, pos + spectate_pad(sizeof(record) + len), memory_order_release);
+    if (keyframe) {
+        atomic_store_explicit(&ring->keyframe, pos, memory_order_release);
+    }
+    atomic_fetch_add_explicit(&ring->frames, 1, memory_order_release);
+    if (atomic_load(&spectator.viewers) > 0) {
+        syscall(SYS_futex, &ring->frames, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+    }
+}
+
+static inline void spectate_tap(const char *bytes, size_t len, int keyframe) { // Compositor tap: publish a frame once for all viewers
+    spectate_write(bytes, len, keyframe);
+
+    if (keyframe) {
+        spectator.frames_since_keyframe = 0;
+    } else if (++spectator.frames_since_keyframe >= SPECTATE_KEYFRAME_INTERVAL) {
+        size_t key_len;
+        const char *key = comp_keyframe(&key_len);
+        spectate_write(key, key_len, 1);
+        spectator.frames_since_keyframe = 0;
+    }
+}
+
+static inline int spectate_send_fd(int sock, int fd) { // Pass fd to the peer with SCM_RIGHTS
+    char byte = 'S';
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+static inline int spectate_recv_fd(int sock) { // Receive an fd sent with spectate_send_fd(), -1 on failure
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(sock, &msg, 0) != 1) return -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+static inline void spectate_socket_path(char *path, size_t size, const char *game) {
+    snprintf(path, size, "spectate-%s.sock", game);
+}
+
+static inline void *spectate_listener(void *arg) { // Hand the ring to every viewer that connects
+    (void)arg;
+    while (1) {
+        int client = accept(spectator.listen_fd, NULL, NULL);
+        if (client < 0) break;
+        if (spectate_send_fd(client, spectator.memfd) == 0) {
+            atomic_fetch_add(&spectator.viewers, 1);
+        }
+        close(client);
+    }
+    return NULL;
+}
+
+static inline void spectate_stop() { // Remove the socket and tell attached viewers the game is over
+    if (spectator.path[0]) {
+        unlink(spectator.path);
+        spectator.path[0] = '\0';
+    }
+    if (spectator.ring) {
+        atomic_store(&spectator.ring->closed, 1);
+        atomic_fetch_add(&spectator.ring->frames, 1);
+        syscall(SYS_futex, &spectator.ring->frames, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+    }
+}
+
+static inline int spectate_start(const char *game) { // Create the ring, listen for viewers and tap the compositor
+    Spectator *s = &spectator;
+    size_t size = sizeof(SpectateRing) + SPECTATE_RING_SIZE;
+
+    s->memfd = (int)syscall(SYS_memfd_create, "vgc-spectate", MFD_CLOEXEC);
+    if (s->memfd < 0 || ftruncate(s->memfd, (off_t)size) != 0) return -1;
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->memfd, 0);
+    if (map == MAP_FAILED) return -1;
+
+    s->ring = map;
+    s->data = (unsigned char *)map + sizeof(SpectateRing);
+    s->ring->magic = SPECTATE_MAGIC;
+    s->ring->version = SPECTATE_VERSION;
+    s->ring->capacity = SPECTATE_RING_SIZE;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    spectate_socket_path(addr.sun_path, sizeof(addr.sun_path), game);
+
+    s->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0) return -1;
+    unlink(addr.sun_path); // Left over from a game that crashed
+    if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s->listen_fd, 16) != 0) {
+        close(s->listen_fd);
+        return -1;
+    }
+    snprintf(s->path, sizeof(s->path), "%s", addr.sun_path);
+    atexit(spectate_stop);
+
+    sigset_t all, old; // Signals must reach the game thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&s->listener, NULL, spectate_listener, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) return -1;
+    pthread_detach(s->listener);
+
+    compositor.tap = spectate_tap;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ctype.h>
+#include <time.h>
+#include "spectate.h"
+
+// Watch a game started with --spectate: ./spectator <game>, Q to stop watching
+
+#define NO_KEYFRAME UINT64_MAX // Stream offset while waiting for a keyframe that can be read whole
+
+struct termios orig_termios;
+
+void enable_raw_mode();
+void disable_raw_mode();
+void handle_signal(int sig);
+int kbhit();
+char getch();
+int attach(const char *game);
+uint64_t newest_keyframe(const SpectateRing *ring, uint64_t safe_lag, uint64_t skip);
+void watch(const SpectateRing *ring);
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <game>   (e.g. %s snake)\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    int fd = attach(argv[1]);
+    if (fd < 0) {
+        fprintf(stderr, "No spectatable %s game is running\n", argv[1]);
+        return 1;
+    }
+
+    size_t size = sizeof(SpectateRing) + SPECTATE_RING_SIZE;
+    const SpectateRing *ring = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED || ring->magic != SPECTATE_MAGIC || ring->version != SPECTATE_VERSION) {
+        fprintf(stderr, "Incompatible spectator stream\n");
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    enable_raw_mode();
+
+    watch(ring);
+
+    disable_raw_mode();
+    printf("\033[H\033[J");
+    return 0;
+}
+
+int attach(const char *game) { // Connect to the game's socket and receive the ring's memfd
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    spectate_socket_path(addr.sun_path, sizeof(addr.sun_path), game);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    int fd = spectate_recv_fd(sock);
+    close(sock);
+    return fd;
+}
+
+// Offset of the newest keyframe if it is not skip and has not been overwritten, else NO_KEYFRAME
+uint64_t newest_keyframe(const SpectateRing *ring, uint64_t safe_lag, uint64_t skip) {
+    uint64_t key = atomic_load_explicit(&ring->keyframe, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return key == skip || head - key > safe_lag ? NO_KEYFRAME : key;
+}
+
+void watch(const SpectateRing *ring) { // Stream records from the shared ring until the game ends or Q is pressed
+    static unsigned char payload[SPECTATE_MAX_RECORD];
+    const unsigned char *data = (const unsigned char *)ring + sizeof(SpectateRing);
+    uint64_t cap = ring->capacity;
+    uint64_t safe_lag = cap - SPECTATE_MAX_RECORD; // Records further behind than this may be overwritten
+    uint64_t pos = NO_KEYFRAME;
+    uint64_t tried = NO_KEYFRAME; // Keyframe last resumed from; one that could not be read is not tried again
+
+    while (1) {
+        if (kbhit() && getch() == 'q') break;
+
+        uint32_t seen = atomic_load_explicit(&ring->frames, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (pos != NO_KEYFRAME && head - pos > safe_lag) pos = NO_KEYFRAME; // Lapped by the game
+        if (pos == NO_KEYFRAME) { // Resume from the newest keyframe, or wait for the next one
+            pos = newest_keyframe(ring, safe_lag, tried);
+            if (pos != NO_KEYFRAME) tried = pos;
+        }
+
+        while (pos != NO_KEYFRAME && pos < head) {
+            // Copy the record out first: the game may overwrite it while we read
+            SpectateRecord record;
+            memcpy(&record, data + pos % cap, sizeof(record));
+            size_t len = record.len + sizeof(record) <= SPECTATE_MAX_RECORD ? record.len : 0;
+            uint64_t at = (pos + sizeof(record)) % cap;
+            size_t first = len < cap - at ? len : (size_t)(cap - at);
+            memcpy(payload, data + at, first);
+            memcpy(payload + first, data, len - first);
+
+            atomic_thread_fence(memory_order_acquire); // The copies above are done before head is read
+            if (atomic_load_explicit(&ring->head, memory_order_relaxed) - pos > safe_lag || len != record.len) {
+                pos = NO_KEYFRAME; // Overwritten while we were reading it: repaint from a keyframe
+                break;
+            }
+            ssize_t written = write(STDOUT_FILENO, payload, len);
+            (void)written;
+            pos += spectate_pad(sizeof(record) + len);
+        }
+
+        if (atomic_load(&ring->closed) && (pos == NO_KEYFRAME || pos >= atomic_load(&ring->head))) break;
+
+        struct timespec timeout = { 0, 100 * 1000000L }; // Wake up now and then to check the keyboard
+        syscall(SYS_futex, &ring->frames, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    }
+}
+
+void handle_signal(int sig) {
+    disable_raw_mode();
+    printf("\033[H\033[J");
+    exit(0);
+}
+
+void enable_raw_mode() {
+    struct termios raw;
+
+    // Get current terminal settings
+    tcgetattr(STDIN_FILENO, &orig_termios);
+    raw = orig_termios;
+
+    // Disable canonical mode and echo
+    raw.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+}
+
+void disable_raw_mode() {
+    // Restore original terminal settings
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios);
+}
+
+int kbhit() { // Check if a key has been pressed
+    struct termios oldt, newt;
+    int ch;
+    int oldf;
+
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+    newt.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
+    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
+
+    ch = getchar();
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    fcntl(STDIN_FILENO, F_SETFL, oldf);
+
+    if (ch != EOF) {
+        ungetc(ch, stdin);
+        return 1;
+    }
+
+    return 0;
+}
+
+char getch() { // Read a character from the input
+    struct termios oldt, newt;
+    char ch;
+
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+    newt.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    ch = getchar();
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+
+    return tolower(ch);
+}
@@ -0,0 +1,374 @@
+#ifndef VGC_TOURNAMENT_H
+#define VGC_TOURNAMENT_H
+
+// Headless tournaments: large batches of seeded games played by a policy.
+//
+// Game i of a tournament is seeded from the tournament seed and i alone, so
+// any game can be played again and the results do not depend on the thread
+// count. Games are handed out as index ranges. Each worker owns one range,
+// packed into a single atomic word, and takes TOUR_GRAIN games at a time
+// from its front; a worker that runs dry steals the back half of another
+// worker's range with one compare-and-swap, so there is no shared queue to
+// fight over and a slow stretch of long games is split up as it happens.
+//
+// Results are fixed-size records written with pwrite() at their game's
+// offset in the output file, after a header naming the game, policy and
+// seed. Each worker batches the records of consecutive games before writing.
+// Scores and lengths are counted per worker and merged for the report: every
+// value below TOUR_EXACT exactly, so small ranges such as scores get true
+// percentiles, and larger ones in a histogram, reported as the middle of
+// their bucket.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include "histogram.h"
+
+#define TOUR_MAGIC 0x4e525456 // "VTRN"
+#define TOUR_VERSION 1
+#define TOUR_MAX_THREADS 64
+#define TOUR_GRAIN 16 // Games a worker takes from its own range at a time
+#define TOUR_BATCH 1024 // Results buffered before a write
+#define TOUR_MAX_GAMES 0xffffffffL
+#define TOUR_LOG_FILE "tournament.log"
+#define TOUR_EXACT 1024 // Scores and lengths below this are counted one value at a time
+
+enum { TOUR_LOST, TOUR_WON, TOUR_CAPPED, TOUR_STALLED, TOUR_OUTCOMES };
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    char game[16];
+    char policy[32];
+    uint64_t seed;
+    uint64_t games;
+    uint64_t max_ticks;
+} TourHeader;
+
+typedef struct { // One game, at sizeof(TourHeader) + index * sizeof(TourResult)
+    uint32_t score;
+    uint32_t ticks;
+    uint8_t outcome;
+    uint8_t reserved[3];
+} TourResult;
+
+typedef struct { // A built-in policy and its parameter, given as name[:param]
+    char name[24];
+    long param; // 0 when not given
+} TourPolicy;
+
+typedef struct { // Scores or lengths of the games played
+    uint64_t exact[TOUR_EXACT]; // Games per value, for values below TOUR_EXACT
+    Histogram hist; // Every value, for the count, mean and maximum and the values above TOUR_EXACT
+    uint64_t min;
+} TourDist;
+
+typedef void (*TourPlay)(uint64_t seed, const TourPolicy *policy, long max_ticks, TourResult *result);
+
+typedef struct {
+    _Alignas(64) atomic_ullong range; // Games [begin, end) still owned, begin in the high half
+    pthread_t thread;
+    int id;
+    uint64_t rng; // Picks steal victims
+
+    TourResult batch[TOUR_BATCH];
+    uint64_t batch_first; // Game index of batch[0]
+    int batch_count;
+
+    TourDist scores, ticks;
+    long outcomes[TOUR_OUTCOMES];
+    long played, steals;
+    uint64_t checksum;
+} TourWorker;
+
+typedef struct {
+    const char *game;
+    TourPolicy policy;
+    TourPlay play;
+    uint64_t seed;
+    long games, max_ticks;
+    int fd;
+    int threads;
+    TourWorker *workers;
+} Tournament;
+
+static Tournament tournament;
+
+static inline uint64_t tour_mix(uint64_t x) { // splitmix64 finaliser
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t tour_seed(uint64_t seed, uint64_t index) { // Seed of game index; never zero
+    uint64_t s = tour_mix(seed ^ tour_mix(index));
+    return s ? s : 1;
+}
+
+static inline int tour_policy_parse(TourPolicy *policy, const char *spec, const char *const *names) { // Fill policy from name[:param]; names is NULL-terminated
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (len == 0 || len >= sizeof(policy->name)) return -1;
+    memcpy(policy->name, spec, len);
+    policy->name[len] = '\0';
+    policy->param = colon ? atol(colon + 1) : 0;
+    for (int i = 0; names[i]; i++) {
+        if (strcmp(names[i], policy->name) == 0) return 0;
+    }
+    return -1;
+}
+
+static inline uint64_t tour_pack(uint64_t begin, uint64_t end) {
+    return begin << 32 | end;
+}
+
+static inline int tour_take(TourWorker *w, uint64_t *begin, uint64_t *end) { // Next games from the front of our own range
+    unsigned long long range = atomic_load_explicit(&w->range, memory_order_relaxed);
+    while (1) {
+        uint64_t b = range >> 32, e = range & 0xffffffffULL;
+        if (b >= e) return 0;
+        uint64_t take = e - b < TOUR_GRAIN ? e - b : TOUR_GRAIN;
+        if (atomic_compare_exchange_weak_explicit(&w->range, &range, tour_pack(b + take, e),
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            *begin = b;
+            *end = b + take;
+            return 1;
+        }
+    }
+}
+
+static inline int tour_steal(TourWorker *w) { // Move the back half of another worker's range to ours; 0 when all are empty
+    Tournament *t = &tournament;
+    w->rng = tour_mix(w->rng);
+    int start = (int)(w->rng % (uint64_t)t->threads);
+    for (int k = 0; k < t->threads; k++) {
+        TourWorker *victim = &t->workers[(start + k) % t->threads];
+        if (victim == w) continue;
+        unsigned long long range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+        while (1) {
+            uint64_t b = range >> 32, e = range & 0xffffffffULL;
+            if (b >= e) break;
+            uint64_t mid = b + (e - b) / 2; // A single game goes to the thief
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range, tour_pack(b, mid),
+                                                      memory_order_acq_rel, memory_order_relaxed)) {
+                // Ours is empty, so nobody else writes it until this store
+                atomic_store_explicit(&w->range, tour_pack(mid, e), memory_order_release);
+                w->steals++;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static inline void tour_dist_record(TourDist *d, uint64_t value) {
+    if (d->hist.total == 0 || value < d->min) d->min = value;
+    if (value < TOUR_EXACT) d->exact[value]++;
+    hist_record(&d->hist, (int64_t)value);
+}
+
+static inline void tour_dist_merge(TourDist *into, const TourDist *d) {
+    if (d->hist.total == 0) return;
+    if (into->hist.total == 0 || d->min < into->min) into->min = d->min;
+    for (int v = 0; v < TOUR_EXACT; v++) into->exact[v] += d->exact[v];
+    for (int b = 0; b < HIST_BUCKETS; b++) into->hist.counts[b] += d->hist.counts[b];
+    into->hist.total += d->hist.total;
+    into->hist.sum += d->hist.sum;
+    if (d->hist.max > into->hist.max) into->hist.max = d->hist.max;
+}
+
+static inline uint64_t tour_percentile(const TourDist *d, double percent) { // Value below which percent of the games fall; exact below TOUR_EXACT
+    const Histogram *h = &d->hist;
+    if (h->total == 0) return 0;
+    if (percent >= 100.0) return h->max;
+
+    uint64_t rank = (uint64_t)(percent / 100.0 * (double)h->total);
+    uint64_t seen = 0;
+    for (uint64_t v = 0; v < TOUR_EXACT && v <= h->max; v++) {
+        seen += d->exact[v];
+        if (seen > rank) return v;
+    }
+    for (int i = hist_index(TOUR_EXACT); i < HIST_BUCKETS - 1; i++) { // TOUR_EXACT starts a bucket
+        seen += h->counts[i];
+        if (seen > rank) {
+            uint64_t low = hist_bucket_value(i), mid = low + (hist_bucket_value(i + 1) - 1 - low) / 2;
+            return mid < d->min ? d->min : mid > h->max ? h->max : mid;
+        }
+    }
+    return h->max;
+}
+
+static inline void tour_flush(TourWorker *w) { // Write the buffered results at their place in the file
+    if (w->batch_count == 0) return;
+    if (tournament.fd >= 0) {
+        size_t size = (size_t)w->batch_count * sizeof(TourResult);
+        off_t offset = (off_t)(sizeof(TourHeader) + w->batch_first * sizeof(TourResult));
+        if (pwrite(tournament.fd, w->batch, size, offset) != (ssize_t)size) perror("Failed to write tournament results");
+    }
+    w->batch_count = 0;
+}
+
+static inline void tour_record(TourWorker *w, uint64_t index, const TourResult *result) {
+    if (w->batch_count == TOUR_BATCH || (w->batch_count && w->batch_first + (uint64_t)w->batch_count != index)) {
+        tour_flush(w);
+    }
+    if (w->batch_count == 0) w->batch_first = index;
+    w->batch[w->batch_count++] = *result;
+
+    tour_dist_record(&w->scores, result->score);
+    tour_dist_record(&w->ticks, result->ticks);
+    w->outcomes[result->outcome < TOUR_OUTCOMES ? result->outcome : TOUR_LOST]++;
+    w->played++;
+    // Summed so the total is the same whichever worker played which game
+    w->checksum += tour_mix(index ^ (uint64_t)result->score << 32 ^ (uint64_t)result->ticks << 8 ^ result->outcome);
+}
+
+static inline void *tour_worker(void *arg) { // Play our range, then steal until every range is empty
+    TourWorker *w = arg;
+    Tournament *t = &tournament;
+    do {
+        uint64_t begin, end;
+        while (tour_take(w, &begin, &end)) {
+            for (uint64_t i = begin; i < end; i++) {
+                TourResult result;
+                memset(&result, 0, sizeof(result));
+                t->play(tour_seed(t->seed, i), &t->policy, t->max_ticks, &result);
+                tour_record(w, i, &result);
+            }
+        }
+    } while (tour_steal(w));
+    tour_flush(w);
+    return NULL;
+}
+
+static inline void tour_report(double seconds) { // Merge the workers' counts and print the distribution
+    Tournament *t = &tournament;
+    static TourDist scores, ticks;
+    memset(&scores, 0, sizeof(scores));
+    memset(&ticks, 0, sizeof(ticks));
+    long outcomes[TOUR_OUTCOMES] = { 0 }, steals = 0;
+    uint64_t checksum = 0;
+    for (int i = 0; i < t->threads; i++) {
+        TourWorker *w = &t->workers[i];
+        tour_dist_merge(&scores, &w->scores);
+        tour_dist_merge(&ticks, &w->ticks);
+        for (int o = 0; o < TOUR_OUTCOMES; o++) outcomes[o] += w->outcomes[o];
+        steals += w->steals;
+        checksum += w->checksum;
+    }
+
+    printf("Tournament: %ld %s games, policy %s", t->games, t->game, t->policy.name);
+    if (t->policy.param) printf(":%ld", t->policy.param);
+    printf(", seed %llu, %d threads, %.2f s (%.0f games/s)\n", (unsigned long long)t->seed, t->threads, seconds,
+           seconds > 0 ? t->games / seconds : 0.0);
+    printf("Score: mean %.2f, p10 %llu, p50 %llu, p90 %llu, p99 %llu, max %llu\n",
+           scores.hist.total ? (double)scores.hist.sum / scores.hist.total : 0.0,
+           (unsigned long long)tour_percentile(&scores, 10), (unsigned long long)tour_percentile(&scores, 50),
+           (unsigned long long)tour_percentile(&scores, 90), (unsigned long long)tour_percentile(&scores, 99),
+           (unsigned long long)scores.hist.max);
+    printf("Ticks: mean %.0f, p50 %llu, p99 %llu, max %llu\n",
+           ticks.hist.total ? (double)ticks.hist.sum / ticks.hist.total : 0.0,
+           (unsigned long long)tour_percentile(&ticks, 50), (unsigned long long)tour_percentile(&ticks, 99),
+           (unsigned long long)ticks.hist.max);
+    printf("Outcomes: %ld lost, %ld won, %ld hit the tick limit, %ld stalled\n",
+           outcomes[TOUR_LOST], outcomes[TOUR_WON], outcomes[TOUR_CAPPED], outcomes[TOUR_STALLED]);
+    printf("Per thread:");
+    for (int i = 0; i < t->threads; i++) printf(" %ld", t->workers[i].played);
+    printf(" games, %ld steals, checksum %016llx\n", steals, (unsigned long long)checksum);
+
+    FILE *log = fopen(TOUR_LOG_FILE, "a");
+    if (log) {
+        char when[32];
+        time_t now = time(NULL);
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(log, "%s %s policy=%s:%ld seed=%llu games=%ld threads=%d games_per_s=%.0f score_p50=%llu p90=%llu p99=%llu max=%llu\n",
+                when, t->game, t->policy.name, t->policy.param, (unsigned long long)t->seed, t->games, t->threads,
+                seconds > 0 ? t->games / seconds : 0.0, (unsigned long long)tour_percentile(&scores, 50),
+                (unsigned long long)tour_percentile(&scores, 90), (unsigned long long)tour_percentile(&scores, 99),
+                (unsigned long long)scores.hist.max);
+        fclose(log);
+    }
+}
+
+static inline int tour_run(const char *game, const TourPolicy *policy, TourPlay play, long games, int threads,
+                           uint64_t seed, long max_ticks, const char *out) { // Play games on threads; results to out (or tournament-<game>-<time>.vtrn)
+    Tournament *t = &tournament;
+    if (games < 1 || games > TOUR_MAX_GAMES) return -1;
+    if (threads < 1) threads = 1;
+    if (threads > TOUR_MAX_THREADS) threads = TOUR_MAX_THREADS;
+    if ((long)threads > games) threads = (int)games;
+    t->game = game;
+    t->policy = *policy;
+    t->play = play;
+    t->seed = seed;
+    t->games = games;
+    t->max_ticks = max_ticks;
+    t->threads = threads;
+
+    char path[96];
+    if (!out) {
+        char stamp[32];
+        time_t now = time(NULL);
+        strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+        snprintf(path, sizeof(path), "tournament-%s-%s.vtrn", game, stamp);
+        out = path;
+    }
+    t->fd = open(out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (t->fd < 0) return -1;
+    TourHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TOUR_MAGIC;
+    header.version = TOUR_VERSION;
+    snprintf(header.game, sizeof(header.game), "%s", game);
+    snprintf(header.policy, sizeof(header.policy), "%s:%ld", policy->name, policy->param);
+    header.seed = seed;
+    header.games = (uint64_t)games;
+    header.max_ticks = (uint64_t)max_ticks;
+    if (pwrite(t->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        close(t->fd);
+        return -1;
+    }
+
+    t->workers = aligned_alloc(64, sizeof(TourWorker) * (size_t)threads);
+    if (!t->workers) {
+        close(t->fd);
+        return -1;
+    }
+    memset(t->workers, 0, sizeof(TourWorker) * (size_t)threads);
+    for (int i = 0; i < threads; i++) { // Even split to start with; stealing evens out the rest
+        TourWorker *w = &t->workers[i];
+        w->id = i;
+        w->rng = tour_mix(seed + (uint64_t)i);
+        atomic_init(&w->range, tour_pack((uint64_t)games * i / threads, (uint64_t)games * (i + 1) / threads));
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sigset_t all, old; // Signals must reach the main thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&t->workers[started].thread, NULL, tour_worker, &t->workers[started]) != 0) break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (started == 0) tour_worker(&t->workers[0]); // Steals everything from the others
+    for (int i = 0; i < started; i++) pthread_join(t->workers[i].thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    close(t->fd);
+    tour_report((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    printf("Results in %s\n", out);
+    free(t->workers);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef VGC_TRACE_H
+#define VGC_TRACE_H
+
+// Scoped phase tracing with Chrome trace-event export.
+//
+// TRACE_SCOPE("name") at the top of a block times that block. Tracing is off
+// unless the game was started with --trace, and then a scope costs one
+// well-predicted branch on the way in and out. Once trace_start() has run,
+// each thread that records gets its own ring of TRACE_RING_EVENTS complete
+// events. Only that thread writes to it, so recording an event is two clock
+// reads and a few stores, with no lock and no atomic read-modify-write. A
+// full ring overwrites its oldest events, so the trace keeps the last few
+// seconds of every thread however long the game has run.
+//
+// The rings are written to trace-<game>-<pid>.json at exit, and again on
+// every SIGUSR1 without stopping the game, so a slow frame can be caught
+// right after it happens. The file loads in chrome://tracing or Perfetto.
+// Other threads keep recording while the dump reads their rings: after
+// copying a ring it checks how far its writer got and drops any event that
+// may have been overwritten in the meantime. The dump uses only
+// async-signal-safe calls, so it can run in the signal handler.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_RING_EVENTS 65536 // Per thread, a power of two; around 20 seconds of a game's phases
+#define TRACE_DUMP_SIGNAL SIGUSR1
+#define TRACE_OUT_BUFFER 8192
+
+typedef struct {
+    const char *name; // A string literal, never escaped
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} TraceEvent;
+
+typedef struct TraceRing {
+    TraceEvent events[TRACE_RING_EVENTS];
+    atomic_ulong head; // Events recorded so far; only the owning thread stores it
+    struct TraceRing *next; // Rings are never freed, so the list only grows
+    int tid;
+    char thread[16];
+} TraceRing;
+
+typedef struct {
+    int enabled;
+    char game[16];
+    uint64_t base_ns; // Timestamps in the file count from trace_start()
+    _Atomic(TraceRing *) rings; // Every thread that recorded, newest first
+    atomic_int dumping; // A dump is in progress; a signal during it is dropped
+} Tracer;
+
+typedef struct { // What TRACE_SCOPE keeps on the stack until the scope ends
+    const char *name;
+    uint64_t start_ns;
+} TraceScope;
+
+static Tracer trace;
+static _Thread_local TraceRing *trace_ring; // This thread's ring, registered on its first event
+static _Thread_local const char *trace_thread = "worker"; // Name shown for this thread
+
+static inline uint64_t trace_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline TraceRing *trace_register() { // Give this thread a ring; NULL when out of memory
+    TraceRing *r = calloc(1, sizeof(TraceRing));
+    if (!r) return NULL;
+    r->tid = (int)syscall(SYS_gettid);
+    strncpy(r->thread, trace_thread, sizeof(r->thread) - 1);
+    r->next = atomic_load(&trace.rings);
+    while (!atomic_compare_exchange_weak(&trace.rings, &r->next, r)) {
+    }
+    trace_ring = r;
+    return r;
+}
+
+static inline void trace_name_thread(const char *name) { // Call at the top of a thread, before it records anything
+    trace_thread = name;
+    if (trace_ring) strncpy(trace_ring->thread, name, sizeof(trace_ring->thread) - 1);
+}
+
+static inline uint64_t trace_begin() { // Start of a traced scope, 0 when tracing is off
+    return __builtin_expect(trace.enabled, 0) ? trace_now_ns() : 0;
+}
+
+static inline void trace_end(const char *name, uint64_t start_ns) { // Record a scope that began at start_ns
+    if (__builtin_expect(start_ns == 0, 1)) return;
+    TraceRing *r = trace_ring ? trace_ring : trace_register();
+    if (!r) return;
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    TraceEvent *e = &r->events[head & (TRACE_RING_EVENTS - 1)];
+    e->name = name;
+    e->start_ns = start_ns;
+    e->duration_ns = trace_now_ns() - start_ns;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static inline void trace_scope_end(TraceScope *scope) {
+    trace_end(scope->name, scope->start_ns);
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Times the rest of the enclosing block, however it is left
+#define TRACE_SCOPE(name) \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__) __attribute__((cleanup(trace_scope_end))) = { (name), trace_begin() }
+
+// Output for the dump: stdio is not async-signal-safe, so it formats by hand into a buffer
+typedef struct {
+    int fd;
+    size_t len;
+    char buf[TRACE_OUT_BUFFER];
+} TraceOut;
+
+static inline void trace_flush(TraceOut *out) {
+    size_t done = 0;
+    while (done < out->len) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    out->len = 0;
+}
+
+static inline void trace_put(TraceOut *out, const char *text) {
+    for (; *text; text++) {
+        if (out->len == sizeof(out->buf)) trace_flush(out);
+        out->buf[out->len++] = *text;
+    }
+}
+
+static inline void trace_put_u64(TraceOut *out, uint64_t value) {
+    char digits[21];
+    int i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    do {
+        digits[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    trace_put(out, digits + i);
+}
+
+static inline void trace_put_us(TraceOut *out, uint64_t ns) { // Nanoseconds as microseconds with three decimals
+    char fraction[5] = { '.', (char)('0' + ns / 100 % 10), (char)('0' + ns / 10 % 10), (char)('0' + ns % 10), '\0' };
+    trace_put_u64(out, ns / 1000);
+    trace_put(out, fraction);
+}
+
+static inline void trace_put_ids(TraceOut *out, int pid, int tid) {
+    trace_put(out, ",\"pid\":");
+    trace_put_u64(out, (uint64_t)pid);
+    trace_put(out, ",\"tid\":");
+    trace_put_u64(out, (uint64_t)tid);
+}
+
+static inline void trace_put_ring(TraceOut *out, TraceRing *r, int pid) { // One thread's events, as far as they survived the copy
+    static TraceEvent copy[TRACE_RING_EVENTS]; // Only one dump runs at a time
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_acquire);
+    unsigned long from = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    for (unsigned long i = from; i < head; i++) copy[i & (TRACE_RING_EVENTS - 1)] = r->events[i & (TRACE_RING_EVENTS - 1)];
+    atomic_thread_fence(memory_order_acquire);
+
+    // The writer may be filling the slot of event now - TRACE_RING_EVENTS, so that one is gone too
+    unsigned long now = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (now >= TRACE_RING_EVENTS && from < now - TRACE_RING_EVENTS + 1) from = now - TRACE_RING_EVENTS + 1;
+
+    trace_put(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\"");
+    trace_put_ids(out, pid, r->tid);
+    trace_put(out, ",\"args\":{\"name\":\"");
+    trace_put(out, r->thread);
+    trace_put(out, "\"}}");
+    for (unsigned long i = from; i < head; i++) {
+        const TraceEvent *e = &copy[i & (TRACE_RING_EVENTS - 1)];
+        trace_put(out, ",\n{\"name\":\"");
+        trace_put(out, e->name);
+        trace_put(out, "\",\"ph\":\"X\"");
+        trace_put_ids(out, pid, r->tid);
+        trace_put(out, ",\"ts\":");
+        trace_put_us(out, e->start_ns > trace.base_ns ? e->start_ns - trace.base_ns : 0);
+        trace_put(out, ",\"dur\":");
+        trace_put_us(out, e->duration_ns);
+        trace_put(out, "}");
+    }
+}
+
+static inline void trace_dump() { // Write every ring to trace-<game>-<pid>.json; async-signal-safe
+    if (!trace.enabled || atomic_exchange(&trace.dumping, 1)) return;
+    static TraceOut out;
+    int pid = (int)getpid();
+
+    // Built by hand for the same reason as the output
+    char path[64], temp[72];
+    out.fd = -1;
+    out.len = 0;
+    trace_put(&out, "trace-");
+    trace_put(&out, trace.game);
+    trace_put(&out, "-");
+    trace_put_u64(&out, (uint64_t)pid);
+    trace_put(&out, ".json");
+    memcpy(path, out.buf, out.len);
+    path[out.len] = '\0';
+    memcpy(temp, path, out.len);
+    memcpy(temp + out.len, ".tmp", 5);
+    out.len = 0;
+
+    out.fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out.fd >= 0) {
+        trace_put(&out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\"");
+        trace_put_ids(&out, pid, pid);
+        trace_put(&out, ",\"args\":{\"name\":\"");
+        trace_put(&out, trace.game);
+        trace_put(&out, "\"}}");
+        for (TraceRing *r = atomic_load(&trace.rings); r; r = r->next) trace_put_ring(&out, r, pid);
+        trace_put(&out, "\n]}\n");
+        trace_flush(&out);
+        close(out.fd);
+        rename(temp, path); // A dump cut short leaves the previous one in place
+    }
+    atomic_store(&trace.dumping, 0);
+}
+
+static inline void trace_signal(int sig) {
+    int saved = errno;
+    trace_dump();
+    errno = saved;
+}
+
+static inline int trace_start(const char *game) { // Turn tracing on for this process; call from the main thread before other threads start
+    strncpy(trace.game, game, sizeof(trace.game) - 1);
+    trace.base_ns = trace_now_ns();
+    trace_name_thread("main");
+    if (!trace_register()) return -1; // Up front, so the game loop never allocates for it
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = trace_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(TRACE_DUMP_SIGNAL, &sa, NULL);
+    atexit(trace_dump);
+    trace.enabled = 1;
+    return 0;
+}
+
+#endif
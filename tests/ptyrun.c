@@ -0,0 +1,437 @@
+// Run a game on a pseudo-terminal, type a key script into it and record
+// everything it writes to the terminal, frame by frame.
+//
+// Usage: ptyrun SCRIPT SECONDS RECORDING program [args...]
+//
+// The program gets a fresh 80x24 pty as its terminal. Once it has drawn its
+// first frame, and so is in raw mode, every key of SCRIPT is typed into the
+// pty in order. SCRIPT is the file the game is given with --script (see
+// src/input.h), so the game holds each key back until its frame; typing them
+// all at once keeps the run independent of timing.
+//
+// The program runs under ptrace, and every write() or writev() any of its
+// threads makes to the terminal is recorded with the bytes it wrote: the
+// compositor's frames, but also stdio flushes and stray prints. With
+// --check-frames the game announces each frame it sends, and its budgets, on
+// descriptor FRAME_FD (src/framecheck.h). The output between two
+// announcements is one tick, written to RECORDING as one escaped line with
+// its size and its number of write calls. A delta tick over the game's
+// budget of bytes or write calls fails the run. Output after the last frame
+// follows as an "exit" line, and the screen as the terminal showed it at the
+// last frame ends the recording.
+//
+// The exit status is the program's, 1 if it succeeded but a tick was over
+// budget, or 124 if it did not finish within SECONDS.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define MAX_KEYS 4096 // Same as INPUT_SCRIPT_LEN
+#define MAX_THREADS 64 // Threads of the program whose system calls are followed at once
+#define MAX_IOV 64 // writev() entries recorded per call
+#define FRAME_FD 9 // Descriptor the game announces its frames on, as VGC_FRAME_FD; /dev/null
+#define SCREEN_ROWS 24
+#define SCREEN_COLS 80
+
+typedef struct {
+    pid_t tid; // 0 for a free slot
+    long nr; // System call the thread is in, -1 if none
+    unsigned long long args[3];
+} Pending;
+
+static Pending pending[MAX_THREADS];
+static char terminal[64]; // Path of the pty's slave side, which the program has as its terminal
+static FILE *record;
+
+static char *tick; // Terminal output since the last frame announcement
+static size_t tick_len, tick_cap;
+static int tick_writes;
+
+static size_t byte_budget; // Per delta frame, as announced by the game
+static int write_budget = -1; // -1 until announced
+static long over, first_over = -1; // Delta frames over budget, and the first of them
+static size_t first_over_bytes;
+static int first_over_writes;
+static long last_frame = -1;
+
+static char screen[SCREEN_ROWS][SCREEN_COLS][5]; // The terminal as decoded from the recorded output, one UTF-8 glyph per cell
+static int row, col;
+
+// Read the keys of a script; returns how many, or -1 if it cannot be read
+int read_keys(const char *path, char *keys) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    char line[128];
+    int count = 0;
+    while (fgets(line, sizeof(line), file) && count < MAX_KEYS) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        unsigned long long frame;
+        char key[16];
+        if (sscanf(line, "%llu %15s", &frame, key) != 2) continue; // The game reports bad lines
+        keys[count++] = strcmp(key, "space") == 0 ? ' ' : key[0];
+    }
+    fclose(file);
+    return count;
+}
+
+// Erase from row, col to the end of the line, or of the screen
+void clear_screen(int from_row, int from_col, int to_row) {
+    for (int r = from_row; r <= to_row && r < SCREEN_ROWS; r++) {
+        for (int c = (r == from_row ? from_col : 0); c < SCREEN_COLS; c++) {
+            if (r >= 0 && c >= 0) strcpy(screen[r][c], " ");
+        }
+    }
+}
+
+// Apply terminal output to the decoded screen; handles what the games send
+void decode(const char *bytes, size_t len) {
+    size_t i = 0;
+
+    while (i < len) {
+        unsigned char ch = (unsigned char)bytes[i];
+        if (ch == '\033' && i + 1 < len && bytes[i + 1] == '[') {
+            int params[2] = { 0, 0 }, count = 0;
+            i += 2;
+            while (i < len && (unsigned char)bytes[i] < 0x40) { // Parameter bytes, including private ones such as '?'
+                if (bytes[i] == ';') {
+                    if (count < 1) count++;
+                } else if (bytes[i] >= '0' && bytes[i] <= '9') {
+                    params[count] = params[count] * 10 + (bytes[i] - '0');
+                }
+                i++;
+            }
+            if (i >= len) break;
+            if (bytes[i] == 'H') {
+                row = params[0] ? params[0] - 1 : 0;
+                col = params[1] ? params[1] - 1 : 0;
+            } else if (bytes[i] == 'J') {
+                if (params[0] == 2) clear_screen(0, 0, SCREEN_ROWS - 1);
+                else clear_screen(row, col, SCREEN_ROWS - 1);
+            } else if (bytes[i] == 'K') {
+                clear_screen(row, col, row);
+            }
+            i++;
+        } else if (ch == '\033') { // Some other escape: skip it and the byte after
+            i += 2;
+        } else if (ch == '\n') { // The tty's output processing turns it into CR LF
+            row++;
+            col = 0;
+            i++;
+        } else if (ch == '\r') {
+            col = 0;
+            i++;
+        } else if (ch < ' ') {
+            i++;
+        } else {
+            size_t glyph_len = ch < 0x80 ? 1 : ch >= 0xf0 ? 4 : ch >= 0xe0 ? 3 : ch >= 0xc0 ? 2 : 1;
+            if (i + glyph_len > len) glyph_len = len - i;
+            if (row >= 0 && row < SCREEN_ROWS && col >= 0 && col < SCREEN_COLS) {
+                memcpy(screen[row][col], bytes + i, glyph_len);
+                screen[row][col][glyph_len] = '\0';
+            }
+            col++;
+            i += glyph_len;
+        }
+    }
+}
+
+// Append bytes to the recording, escaped so that a frame stays on one line
+void write_escaped(const char *bytes, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)bytes[i];
+        if (ch == '\\') fputs("\\\\", record);
+        else if (ch == '\033') fputs("\\e", record);
+        else if (ch == '\n') fputs("\\n", record);
+        else if (ch < ' ' || ch == 0x7f) fprintf(record, "\\x%02x", ch);
+        else fputc(ch, record);
+    }
+    fputc('\n', record);
+}
+
+// Record the output since the last announcement as the tick of frame, and check it against the budget
+void end_tick(long frame, const char *kind) {
+    fprintf(record, "frame %ld %s %zuB %dw ", frame, kind, tick_len, tick_writes);
+    write_escaped(tick, tick_len);
+    decode(tick, tick_len);
+
+    if (strcmp(kind, "delta") == 0 && write_budget >= 0 && (tick_len > byte_budget || tick_writes > write_budget)) {
+        if (over++ == 0) {
+            first_over = frame;
+            first_over_bytes = tick_len;
+            first_over_writes = tick_writes;
+        }
+    }
+    last_frame = frame;
+    tick_len = 0;
+    tick_writes = 0;
+}
+
+// Copy len bytes at addr out of a thread of the program; returns 0 on success
+int peek(pid_t tid, unsigned long long addr, void *buf, size_t len) {
+    struct iovec local = { buf, len };
+    struct iovec remote = { (void *)(uintptr_t)addr, len };
+    return process_vm_readv(tid, &local, 1, &remote, 1, 0) == (ssize_t)len ? 0 : -1;
+}
+
+// Add len bytes at addr in the program to the current tick
+void take_output(pid_t tid, unsigned long long addr, size_t len) {
+    if (tick_len + len > tick_cap) {
+        size_t cap = tick_cap ? tick_cap : 4096;
+        while (cap < tick_len + len) cap *= 2;
+        char *grown = realloc(tick, cap);
+        if (!grown) return;
+        tick = grown;
+        tick_cap = cap;
+    }
+    if (peek(tid, addr, tick + tick_len, len) == 0) tick_len += len;
+}
+
+// Whether fd of a thread of the program is the terminal
+int is_terminal(pid_t tid, int fd) {
+    char path[64], target[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd/%d", tid, fd);
+    ssize_t n = readlink(path, target, sizeof(target) - 1);
+    if (n < 0) return 0;
+    target[n] = '\0';
+    return strcmp(target, terminal) == 0;
+}
+
+// Act on an announcement the game wrote to FRAME_FD
+void announce(pid_t tid, unsigned long long addr, long len) {
+    char text[64];
+    if (len <= 0) return;
+    if (len > (long)sizeof(text) - 1) len = sizeof(text) - 1;
+    if (peek(tid, addr, text, (size_t)len) != 0) return;
+    text[len] = '\0';
+
+    long frame;
+    char kind[16];
+    if (sscanf(text, "budget %zu %d", &byte_budget, &write_budget) == 2) return;
+    if (sscanf(text, "frame %ld %15s", &frame, kind) == 2) end_tick(frame, kind);
+}
+
+// Slot for a thread's system call state
+Pending *pending_for(pid_t tid) {
+    Pending *free_slot = NULL;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        if (pending[i].tid == tid) return &pending[i];
+        if (!pending[i].tid && !free_slot) free_slot = &pending[i];
+    }
+    if (free_slot) {
+        free_slot->tid = tid;
+        free_slot->nr = -1;
+    }
+    return free_slot;
+}
+
+// A thread stopped entering or leaving a system call: record what it wrote to the terminal
+void on_syscall(pid_t tid) {
+    struct __ptrace_syscall_info info;
+    Pending *p = pending_for(tid);
+    if (!p || ptrace(PTRACE_GET_SYSCALL_INFO, tid, sizeof(info), &info) <= 0) return;
+
+    if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+        p->nr = (long)info.entry.nr;
+        memcpy(p->args, info.entry.args, sizeof(p->args));
+        return;
+    }
+    long nr = p->nr;
+    p->nr = -1;
+    if (info.op != PTRACE_SYSCALL_INFO_EXIT || (nr != SYS_write && nr != SYS_writev)) return;
+
+    int fd = (int)p->args[0];
+    long written = (long)info.exit.rval;
+    if (fd == FRAME_FD) {
+        if (nr == SYS_write) announce(tid, p->args[1], written);
+        return;
+    }
+    if (!is_terminal(tid, fd)) return;
+
+    tick_writes++; // Every call counts, even one that wrote nothing
+    if (written <= 0) return;
+    if (nr == SYS_write) {
+        take_output(tid, p->args[1], (size_t)written);
+        return;
+    }
+    struct iovec iov[MAX_IOV];
+    int count = p->args[2] < MAX_IOV ? (int)p->args[2] : MAX_IOV;
+    if (peek(tid, p->args[1], iov, (size_t)count * sizeof(iov[0])) != 0) return;
+    for (int i = 0; i < count && written > 0; i++) {
+        size_t take = iov[i].iov_len < (size_t)written ? iov[i].iov_len : (size_t)written;
+        take_output(tid, (uintptr_t)iov[i].iov_base, take);
+        written -= (long)take;
+    }
+}
+
+// Handle a wait status of a thread of the program and let it run on; returns 1 once the program has exited
+int on_stop(pid_t tid, int status, pid_t pid, int *exit_status) {
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        Pending *p = pending_for(tid);
+        if (p) p->tid = 0;
+        if (tid != pid) return 0;
+        *exit_status = status;
+        return 1;
+    }
+    if (!WIFSTOPPED(status)) return 0;
+
+    int sig = WSTOPSIG(status);
+    if (sig == (SIGTRAP | 0x80)) {
+        on_syscall(tid);
+        sig = 0;
+    } else if (sig == SIGTRAP && (status >> 16)) { // A clone or exec event
+        sig = 0;
+    } else if (sig == SIGSTOP) { // A new thread's first stop; nothing else stops the program here
+        sig = 0;
+    }
+    ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(intptr_t)sig);
+    return 0;
+}
+
+// End the recording with whatever followed the last frame and the screen at that frame
+void finish_record() {
+    if (tick_len || tick_writes) {
+        fprintf(record, "exit %zuB %dw ", tick_len, tick_writes);
+        write_escaped(tick, tick_len);
+    }
+
+    fprintf(record, "screen %dx%d at frame %ld\n", SCREEN_ROWS, SCREEN_COLS, last_frame);
+    int rows = SCREEN_ROWS;
+    while (rows > 0) { // Leave out empty rows at the bottom
+        int c = 0;
+        while (c < SCREEN_COLS && strcmp(screen[rows - 1][c], " ") == 0) c++;
+        if (c < SCREEN_COLS) break;
+        rows--;
+    }
+    for (int r = 0; r < rows; r++) {
+        int end = SCREEN_COLS;
+        while (end > 0 && strcmp(screen[r][end - 1], " ") == 0) end--;
+        for (int c = 0; c < end; c++) fputs(screen[r][c], record);
+        fputc('\n', record);
+    }
+    fclose(record);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s SCRIPT SECONDS RECORDING program [args...]\n", argv[0]);
+        return 2;
+    }
+    static char keys[MAX_KEYS];
+    int key_count = read_keys(argv[1], keys);
+    if (key_count < 0) return 2;
+    int seconds = atoi(argv[2]);
+    record = fopen(argv[3], "w");
+    if (!record) {
+        perror(argv[3]);
+        return 2;
+    }
+    clear_screen(0, 0, SCREEN_ROWS - 1);
+
+    // Stops of the traced threads arrive as SIGCHLD, read through a descriptor so one poll() waits for everything
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    int signals = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    int master;
+    struct winsize size = { .ws_row = SCREEN_ROWS, .ws_col = SCREEN_COLS };
+    pid_t pid = forkpty(&master, terminal, NULL, &size);
+    if (pid < 0 || signals < 0) {
+        perror("forkpty");
+        return 2;
+    }
+    if (pid == 0) {
+        sigprocmask(SIG_UNBLOCK, &chld, NULL);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0 && null != FRAME_FD) {
+            dup2(null, FRAME_FD);
+            close(null);
+        }
+        char fd_text[8];
+        snprintf(fd_text, sizeof(fd_text), "%d", FRAME_FD);
+        setenv("VGC_FRAME_FD", fd_text, 1);
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP); // Wait for the options below
+        execv(argv[4], argv + 4);
+        perror(argv[4]);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           (void *)(intptr_t)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL));
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    time_t deadline = time(NULL) + seconds;
+    int started = 0, typed = 0, exited = 0, hung_up = 0;
+    while (!exited) {
+        struct pollfd fds[2] = {
+            { hung_up ? -1 : master, POLLIN | (started && typed < key_count ? POLLOUT : 0), 0 },
+            { signals, POLLIN, 0 },
+        };
+        if (poll(fds, 2, 100) < 0 && errno != EINTR) break;
+
+        if (fds[0].revents & POLLIN) { // The bytes are recorded from the program's writes; only keep the pty flowing
+            char buf[4096];
+            ssize_t n = read(master, buf, sizeof(buf));
+            if (n > 0) started = 1;
+        } else if (fds[0].revents & (POLLHUP | POLLERR)) { // The program has closed the terminal and is exiting
+            hung_up = 1;
+        }
+        if (fds[0].revents & POLLOUT) {
+            ssize_t n = write(master, keys + typed, (size_t)(key_count - typed));
+            if (n > 0) typed += (int)n;
+        }
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(signals, &info, sizeof(info)) > 0) {}
+        }
+
+        pid_t tid;
+        int stop;
+        while (!exited && (tid = waitpid(-1, &stop, __WALL | WNOHANG)) > 0) {
+            exited = on_stop(tid, stop, pid, &status);
+        }
+
+        if (!exited && time(NULL) > deadline) {
+            fprintf(stderr, "%s: still running after %d seconds, %d of %d keys typed\n", argv[4], seconds, typed,
+                    key_count);
+            kill(pid, SIGKILL);
+            while (waitpid(pid, &status, __WALL) < 0 && errno == EINTR) {}
+            finish_record();
+            return 124;
+        }
+    }
+    close(master);
+    finish_record();
+
+    if (over) {
+        fprintf(stderr, "%s: %ld delta frames over %zu bytes or %d writes at the terminal, first frame %ld with %zu bytes in %d writes\n",
+                argv[4], over, byte_budget, write_budget, first_over, first_over_bytes, first_over_writes);
+    }
+    if (!exited) return 2;
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return code == 0 && over ? 1 : code;
+}
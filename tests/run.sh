@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# Golden-frame tests
+#
+# Each case plays a game on a pty (tests/ptyrun.c) with a fixed seed and a
+# key script. ptyrun records every byte the game writes to the terminal, one
+# tick per line, and the recording is compared byte for byte with its golden
+# copy. A delta tick over the game's byte or write() budget fails the case, and
+# so does a frame that leaves the terminal different from the compositor's
+# layers, which the game checks itself (--check-frames, see src/framecheck.h).
+#
+#   tests/run.sh              build the games and run every case
+#   tests/run.sh NAME...      run only the named cases
+#   tests/run.sh --update     record the golden copies again after an intended change
+#
+# Case NAME is three files in tests/frames: NAME.args holds the game and its
+# flags, NAME.keys its --script (see src/input.h) and NAME.frames the golden
+# recording. An optional NAME.sed is applied to the recording first, to mask
+# what depends on the machine, such as timings the game prints on exit.
+
+CASES_DIR="tests/frames"
+TIMEOUT_SECONDS=60 # Per case; every case takes well under a second
+
+cd "$(dirname "$0")/.." || exit 1
+update=0
+if [ "${1:-}" = "--update" ]; then
+    update=1
+    shift
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Build the games as the README does, and the pty runner
+for game in snake breakout dinosaur; do
+    gcc -O2 -pthread -o "$work/$game" "src/$game.c" || exit 1
+done
+gcc -O2 -o "$work/ptyrun" tests/ptyrun.c -lutil || exit 1
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$CASES_DIR" && ls *.args | sed 's/\.args$//')
+fi
+
+failed=0
+for name in "$@"; do
+    run="$work/$name" # Fresh storage directory: no saves or scores from other runs
+    mkdir "$run"
+    read -r game args < "$CASES_DIR/$name.args"
+    keys="$PWD/$CASES_DIR/$name.keys"
+
+    (cd "$run" && "$work/ptyrun" "$keys" "$TIMEOUT_SECONDS" frames "$work/$game" --script "$keys" --check-frames $args)
+    status=$?
+    [ -f "$CASES_DIR/$name.sed" ] && sed -i -E -f "$CASES_DIR/$name.sed" "$run/frames"
+    if [ $status -ne 0 ]; then
+        echo "FAIL $name: exit status $status"
+        [ -f "$run/framecheck.log" ] && sed 's/^/     /' "$run/framecheck.log"
+        failed=$((failed + 1))
+    elif [ $update -eq 1 ]; then
+        cp "$run/frames" "$CASES_DIR/$name.frames"
+        echo "rec  $name: $(grep -c '^frame ' "$run/frames") frames"
+    elif ! cmp -s "$CASES_DIR/$name.frames" "$run/frames"; then
+        # Show both lines from a little before the first byte that differs
+        where=$(cmp "$CASES_DIR/$name.frames" "$run/frames" 2>&1)
+        byte=$(echo "$where" | sed -n 's/.* \(byte\|char\) \([0-9]*\).*/\2/p')
+        line=$(echo "$where" | sed -n 's/.*line \([0-9]*\).*/\1/p')
+        from=$((byte - $(head -n $((line - 1)) "$CASES_DIR/$name.frames" | wc -c) - 40))
+        [ $from -lt 1 ] && from=1
+        echo "FAIL $name: frames differ from the golden copy at line $line"
+        echo "     want: $(sed -n "${line}p" "$CASES_DIR/$name.frames" | cut -c$from-$((from + 120)))"
+        echo "     got:  $(sed -n "${line}p" "$run/frames" | cut -c$from-$((from + 120)))"
+        failed=$((failed + 1))
+    else
+        echo "ok   $name: $(grep -c '^frame ' "$run/frames") frames"
+    fi
+done
+
+if [ $failed -ne 0 ]; then
+    echo "$failed of $# cases failed"
+    exit 1
+fi
+echo "All $# cases passed"